@@ -0,0 +1,256 @@
+#include "aligned_buffer_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+const size_t kDefaultLargePageSize = 2 * 1024 * 1024;
+
+size_t RoundUp(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+// Returns nullptr when the OS does not grant large pages.
+uint8_t* LargePageAlloc(size_t& size) {
+#ifdef _WIN32
+    size_t page_size = GetLargePageMinimum();
+    if (page_size == 0) {
+        return nullptr;
+    }
+    size = RoundUp(size, page_size);
+    return static_cast<uint8_t*>(
+            VirtualAlloc(nullptr, size,
+                         MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                         PAGE_READWRITE));
+#else
+    size = RoundUp(size, kDefaultLargePageSize);
+    uint8_t* buffer = AlignedAlloc(size, kDefaultLargePageSize);
+#ifdef MADV_HUGEPAGE
+    if (buffer) {
+        madvise(buffer, size, MADV_HUGEPAGE);
+    }
+#endif
+    return buffer;
+#endif
+}
+
+void LargePageFree(uint8_t* buffer) {
+#ifdef _WIN32
+    VirtualFree(buffer, 0, MEM_RELEASE);
+#else
+    AlignedFree(buffer);
+#endif
+}
+
+void FreeSlab(uint8_t* slab, bool large_pages) {
+    if (large_pages) {
+        LargePageFree(slab);
+    } else {
+        AlignedFree(slab);
+    }
+}
+}  // namespace
+
+uint8_t* AlignedAlloc(size_t size, size_t alignment) {
+#ifdef _WIN32
+    return static_cast<uint8_t*>(_aligned_malloc(size, alignment));
+#else
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, alignment, size) != 0) {
+        return nullptr;
+    }
+    return static_cast<uint8_t*>(buffer);
+#endif
+}
+
+void AlignedFree(uint8_t* buffer) {
+#ifdef _WIN32
+    _aligned_free(buffer);
+#else
+    free(buffer);
+#endif
+}
+
+BufferPoolOptions ParseBufferPoolOptions(const nlohmann::json& config,
+                                         const BufferPoolOptions& defaults) {
+    BufferPoolOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    options.alignment = config.value("alignment", options.alignment);
+    options.large_pages = config.value("large_pages", options.large_pages);
+    options.max_num_buffer =
+            config.value("max_num_buffer", options.max_num_buffer);
+    if (options.alignment == 0 ||
+        (options.alignment & (options.alignment - 1)) != 0) {
+        throw std::runtime_error("2");
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const BufferPoolStats& stats) {
+    os << "buffers " << stats.buffers << " x " << stats.buffer_size
+       << " bytes" << (stats.large_pages ? " (large pages)" : "")
+       << ", in use " << stats.in_use << ", high water "
+       << stats.high_water_mark << ", fallback allocations "
+       << stats.fallback_allocations;
+    return os;
+}
+
+AlignedBufferPool::AlignedBufferPool()
+        : slab_(nullptr),
+          slab_size_(0),
+          slab_large_pages_(false),
+          slot_size_(0) {}
+
+AlignedBufferPool::~AlignedBufferPool() {
+    Free();
+    for (const RetiredSlab& retired : retired_) {
+        FreeSlab(retired.data, retired.large_pages);
+    }
+}
+
+void AlignedBufferPool::Reserve(size_t buffer_size, size_t count,
+                                const BufferPoolOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Grab results of the previous slab may still be held downstream.
+    if (slab_ && stats_.in_use > 0) {
+        retired_.push_back(RetiredSlab{slab_, slab_size_, slab_large_pages_,
+                                       stats_.in_use});
+        slab_ = nullptr;
+    }
+    Free();
+
+    options_ = options;
+    slot_size_ = RoundUp(buffer_size, options_.alignment);
+    slab_size_ = slot_size_ * count;
+    if (slab_size_ == 0) {
+        return;
+    }
+
+    if (options_.large_pages) {
+        slab_ = LargePageAlloc(slab_size_);
+        slab_large_pages_ = slab_ != nullptr;
+        if (!slab_) {
+            std::cerr << "޷ҳڴ, ͨڴ" << std::endl;
+            slab_size_ = slot_size_ * count;
+        }
+    }
+    if (!slab_) {
+        slab_ = AlignedAlloc(slab_size_, options_.alignment);
+    }
+    if (!slab_) {
+        throw std::runtime_error("޷ͼ񻺳");
+    }
+    // Touch every page now rather than on the first grab.
+    std::memset(slab_, 0, slab_size_);
+
+    free_.reserve(count);
+    for (size_t i = count; i > 0; --i) {
+        free_.push_back(slab_ + (i - 1) * slot_size_);
+    }
+
+    stats_ = BufferPoolStats();
+    stats_.buffers = count;
+    stats_.buffer_size = slot_size_;
+    stats_.large_pages = slab_large_pages_;
+}
+
+uint8_t* AlignedBufferPool::TryAcquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+        return nullptr;
+    }
+    uint8_t* buffer = free_.back();
+    free_.pop_back();
+    ++stats_.in_use;
+    stats_.high_water_mark = std::max(stats_.high_water_mark, stats_.in_use);
+    return buffer;
+}
+
+uint8_t* AlignedBufferPool::Acquire(size_t size) {
+    if (size <= BufferSize()) {
+        uint8_t* buffer = TryAcquire();
+        if (buffer) {
+            return buffer;
+        }
+    }
+
+    uint8_t* buffer = AlignedAlloc(size, options_.alignment);
+    if (!buffer) {
+        throw std::runtime_error("޷ͼ񻺳");
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.fallback_allocations;
+    return buffer;
+}
+
+void AlignedBufferPool::Release(uint8_t* buffer) {
+    if (!buffer) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!Owns(buffer)) {
+        if (!ReleaseRetired(buffer)) {
+            AlignedFree(buffer);
+        }
+        return;
+    }
+    free_.push_back(buffer);
+    --stats_.in_use;
+}
+
+size_t AlignedBufferPool::BufferSize() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return slot_size_;
+}
+
+BufferPoolStats AlignedBufferPool::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+// Called with mutex_ held.
+void AlignedBufferPool::Free() {
+    if (slab_) {
+        FreeSlab(slab_, slab_large_pages_);
+    }
+    slab_ = nullptr;
+    slab_size_ = 0;
+    slab_large_pages_ = false;
+    slot_size_ = 0;
+    free_.clear();
+}
+
+// Called with mutex_ held.
+bool AlignedBufferPool::Owns(const uint8_t* buffer) const {
+    return slab_ && buffer >= slab_ && buffer < slab_ + slab_size_;
+}
+
+// Called with mutex_ held.
+bool AlignedBufferPool::ReleaseRetired(uint8_t* buffer) {
+    for (auto it = retired_.begin(); it != retired_.end(); ++it) {
+        if (buffer < it->data || buffer >= it->data + it->size) {
+            continue;
+        }
+        if (--it->in_use == 0) {
+            FreeSlab(it->data, it->large_pages);
+            retired_.erase(it);
+        }
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,101 @@
+#ifndef ALIGNED_BUFFER_POOL_H_
+#define ALIGNED_BUFFER_POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "json.hpp"
+
+// Heap block starting at a multiple of `alignment`, a power of two. Returns
+// nullptr on failure. Free it with AlignedFree().
+uint8_t* AlignedAlloc(size_t size, size_t alignment);
+void AlignedFree(uint8_t* buffer);
+
+struct BufferPoolOptions {
+    // Start of every buffer; 64 keeps AVX-512 loads and cache lines whole.
+    size_t alignment = 64;
+    // Back the pool with large pages when the OS grants them (needs the
+    // "Lock pages in memory" privilege on Windows); falls back silently.
+    bool large_pages = false;
+    // pylon MaxNumBuffer. 0 keeps the camera's setting.
+    size_t max_num_buffer = 0;
+};
+
+// Reads {"alignment": N, "large_pages": b, "max_num_buffer": N}.
+BufferPoolOptions ParseBufferPoolOptions(
+        const nlohmann::json& config,
+        const BufferPoolOptions& defaults = BufferPoolOptions());
+
+struct BufferPoolStats {
+    size_t buffers = 0;
+    size_t buffer_size = 0;
+    bool large_pages = false;
+    // Buffers currently handed out, and the most ever at once.
+    size_t in_use = 0;
+    size_t high_water_mark = 0;
+    // Acquire() calls served from the heap because the pool was empty or
+    // its buffers too small.
+    uint64_t fallback_allocations = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, const BufferPoolStats& stats);
+
+// Fixed set of equally sized buffers carved from one aligned slab, which is
+// written once on Reserve() so no page faults happen while grabbing.
+// Thread-safe.
+class AlignedBufferPool {
+public:
+    AlignedBufferPool();
+    ~AlignedBufferPool();
+
+    AlignedBufferPool(const AlignedBufferPool&) = delete;
+    AlignedBufferPool& operator=(const AlignedBufferPool&) = delete;
+
+public:
+    // Replaces the slab. Buffers of the previous one may still be out: that
+    // slab is freed when the last of them is released.
+    void Reserve(size_t buffer_size, size_t count,
+                 const BufferPoolOptions& options = BufferPoolOptions());
+
+    // Returns nullptr when no pool buffer is free.
+    uint8_t* TryAcquire();
+    // Falls back to an aligned heap allocation when the pool is exhausted or
+    // `size` does not fit a pool buffer.
+    uint8_t* Acquire(size_t size);
+    void Release(uint8_t* buffer);
+
+    size_t BufferSize() const;
+    BufferPoolStats GetStats() const;
+
+private:
+    // A slab replaced by Reserve() with buffers still out.
+    struct RetiredSlab {
+        uint8_t* data;
+        size_t size;
+        bool large_pages;
+        size_t in_use;
+    };
+
+    void Free();
+    bool Owns(const uint8_t* buffer) const;
+    // Returns false if `buffer` is from no retired slab.
+    bool ReleaseRetired(uint8_t* buffer);
+
+private:
+    BufferPoolOptions options_;
+
+    mutable std::mutex mutex_;
+    uint8_t* slab_;
+    size_t slab_size_;
+    bool slab_large_pages_;
+    size_t slot_size_;
+    std::vector<uint8_t*> free_;
+    std::vector<RetiredSlab> retired_;
+
+    BufferPoolStats stats_;
+};
+
+#endif
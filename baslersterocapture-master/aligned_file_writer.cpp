@@ -0,0 +1,289 @@
+#include "aligned_file_writer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "aligned_buffer_pool.h"
+
+namespace {
+#ifdef _WIN32
+void* const kNoFile = nullptr;
+
+void* OpenOutputFile(const std::string& path, bool create, bool direct) {
+    HANDLE handle = CreateFileA(
+            path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr, create ? CREATE_ALWAYS : OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | (direct ? FILE_FLAG_NO_BUFFERING : 0),
+            nullptr);
+    return handle == INVALID_HANDLE_VALUE ? kNoFile : handle;
+}
+
+bool WriteOutputFileAt(void* handle, const uint8_t* data, size_t size,
+                       int64_t offset) {
+    while (size > 0) {
+        // A multiple of any sector size, as unbuffered writes need.
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD written = 0;
+        if (!WriteFile(handle, data, chunk, &written, &overlapped) ||
+            written == 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+void CloseOutputFile(void* handle) {
+    CloseHandle(handle);
+}
+#else
+const int kNoFile = -1;
+
+int OpenOutputFile(const std::string& path, bool create, bool direct) {
+    int flags = O_WRONLY | (create ? O_CREAT | O_TRUNC : 0);
+#ifdef O_DIRECT
+    if (direct) {
+        flags |= O_DIRECT;
+    }
+#endif
+    return open(path.c_str(), flags, 0644);
+}
+
+bool WriteOutputFileAt(int fd, const uint8_t* data, size_t size,
+                       int64_t offset) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+void CloseOutputFile(int fd) {
+    close(fd);
+}
+#endif
+}  // namespace
+
+FileWriterOptions ParseFileWriterOptions(const nlohmann::json& config,
+                                         const FileWriterOptions& defaults) {
+    FileWriterOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    options.buffer_size = config.value("buffer_size", options.buffer_size);
+    options.alignment = config.value("alignment", options.alignment);
+    options.direct_io = config.value("direct_io", options.direct_io);
+    options.slow_write_ms =
+            config.value("slow_write_ms", options.slow_write_ms);
+    if (options.alignment == 0 ||
+        (options.alignment & (options.alignment - 1)) != 0) {
+        throw std::runtime_error("ļд2");
+    }
+    if (options.buffer_size == 0 ||
+        options.buffer_size % options.alignment != 0) {
+        throw std::runtime_error("ļдСǶ");
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const FileWriterStats& stats) {
+    os << (stats.direct_io ? "direct I/O" : "cached I/O") << ", writes "
+       << stats.writes << ", " << stats.bytes / 1e6 << " MB, mean "
+       << stats.mean_ms << " ms, max " << stats.max_ms << " ms, slow writes "
+       << stats.slow_writes;
+    return os;
+}
+
+AlignedFileWriter::AlignedFileWriter()
+        : is_opened_(false),
+          direct_(kNoFile),
+          cached_(kNoFile),
+          buffer_(nullptr),
+          base_(0),
+          filled_(0),
+          position_(0),
+          total_ms_(0.0) {}
+
+AlignedFileWriter::~AlignedFileWriter() {
+    try {
+        Close();
+    } catch (...) {
+    }
+}
+
+void AlignedFileWriter::Open(const std::string& path,
+                             const FileWriterOptions& options) {
+    Close();
+    if (options.buffer_size == 0 || options.alignment == 0 ||
+        options.buffer_size % options.alignment != 0) {
+        throw std::runtime_error("ļдСǶ");
+    }
+    options_ = options;
+    path_ = path;
+
+    buffer_ = AlignedAlloc(options_.buffer_size, options_.alignment);
+    if (!buffer_) {
+        throw std::runtime_error("޷ļд");
+    }
+    direct_ = OpenOutputFile(path_, true, options_.direct_io);
+    cached_ = options_.direct_io ? OpenOutputFile(path_, false, false)
+                                 : direct_;
+    if (direct_ == kNoFile || cached_ == kNoFile) {
+        Free();
+        throw std::runtime_error("޷ļ: " + path_);
+    }
+
+    is_opened_ = true;
+    base_ = 0;
+    filled_ = 0;
+    position_ = 0;
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_ = FileWriterStats();
+    stats_.direct_io = options_.direct_io;
+    total_ms_ = 0.0;
+}
+
+void AlignedFileWriter::Close() {
+    if (!is_opened_) {
+        return;
+    }
+    is_opened_ = false;
+    try {
+        // Not a whole buffer, so it goes through the cache.
+        if (filled_ > 0) {
+            WriteAt(cached_, buffer_, filled_, base_);
+        }
+    } catch (...) {
+        Free();
+        throw;
+    }
+    Free();
+}
+
+void AlignedFileWriter::Write(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        if (position_ < base_) {
+            size_t count = static_cast<size_t>(
+                    std::min<int64_t>(size, base_ - position_));
+            WriteAt(cached_, data, count, position_);
+            data += count;
+            size -= count;
+            position_ += count;
+            continue;
+        }
+
+        size_t offset = static_cast<size_t>(position_ - base_);
+        if (offset > filled_) {
+            // Seeked past the end; the gap reads as zeros.
+            size_t end = std::min(offset, options_.buffer_size);
+            std::memset(buffer_ + filled_, 0, end - filled_);
+            filled_ = end;
+        } else {
+            size_t count = std::min(size, options_.buffer_size - offset);
+            std::memcpy(buffer_ + offset, data, count);
+            filled_ = std::max(filled_, offset + count);
+            data += count;
+            size -= count;
+            position_ += count;
+        }
+        if (filled_ == options_.buffer_size) {
+            Flush();
+        }
+    }
+}
+
+int64_t AlignedFileWriter::Seek(int64_t offset, int whence) {
+    int64_t origin = 0;
+    if (whence == SEEK_CUR) {
+        origin = position_;
+    } else if (whence == SEEK_END) {
+        origin = Size();
+    } else if (whence != SEEK_SET) {
+        return -1;
+    }
+    if (origin + offset < 0) {
+        return -1;
+    }
+    position_ = origin + offset;
+    return position_;
+}
+
+int64_t AlignedFileWriter::Size() const {
+    return base_ + static_cast<int64_t>(filled_);
+}
+
+FileWriterStats AlignedFileWriter::GetStats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+void AlignedFileWriter::Flush() {
+    WriteAt(direct_, buffer_, filled_, base_);
+    base_ += filled_;
+    filled_ = 0;
+}
+
+void AlignedFileWriter::WriteAt(Handle handle, const uint8_t* data,
+                                size_t size, int64_t offset) {
+    auto start = std::chrono::steady_clock::now();
+    bool written = WriteOutputFileAt(handle, data, size, offset);
+    double elapsed_ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        ++stats_.writes;
+        stats_.bytes += size;
+        total_ms_ += elapsed_ms;
+        stats_.mean_ms = total_ms_ / stats_.writes;
+        stats_.max_ms = std::max(stats_.max_ms, elapsed_ms);
+        if (elapsed_ms > options_.slow_write_ms) {
+            ++stats_.slow_writes;
+        }
+    }
+    if (!written) {
+        throw std::runtime_error("дļʧ: " + path_);
+    }
+}
+
+void AlignedFileWriter::Free() {
+    if (cached_ != kNoFile && cached_ != direct_) {
+        CloseOutputFile(cached_);
+    }
+    if (direct_ != kNoFile) {
+        CloseOutputFile(direct_);
+    }
+    direct_ = kNoFile;
+    cached_ = kNoFile;
+    AlignedFree(buffer_);
+    buffer_ = nullptr;
+}
@@ -0,0 +1,103 @@
+#ifndef ALIGNED_FILE_WRITER_H_
+#define ALIGNED_FILE_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include "json.hpp"
+
+struct FileWriterOptions {
+    // Bytes per write to the disk; a multiple of `alignment`.
+    size_t buffer_size = 8 * 1024 * 1024;
+    // Of the buffer and of the file offsets it is written at. With
+    // direct_io, at least the disk's sector size.
+    size_t alignment = 4096;
+    // Bypass the OS file cache (O_DIRECT, FILE_FLAG_NO_BUFFERING), so long
+    // recordings do not evict everything else and writeback does not come
+    // in bursts.
+    bool direct_io = false;
+    // Writes slower than this are counted as outliers.
+    double slow_write_ms = 50.0;
+};
+
+// Reads {"buffer_size": N, "alignment": N, "direct_io": b,
+// "slow_write_ms": x}.
+FileWriterOptions ParseFileWriterOptions(
+        const nlohmann::json& config,
+        const FileWriterOptions& defaults = FileWriterOptions());
+
+struct FileWriterStats {
+    bool direct_io = false;
+    uint64_t writes = 0;
+    uint64_t bytes = 0;
+    double mean_ms = 0.0;
+    double max_ms = 0.0;
+    uint64_t slow_writes = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, const FileWriterStats& stats);
+
+// Seekable output file that collects writes in one aligned buffer and
+// writes it out whole, at aligned offsets, when it fills up. Writes behind
+// the buffer, such as a muxer patching its header, go straight to the file
+// through a second, cached handle, as does the unaligned tail on Close().
+// Not thread-safe, except GetStats().
+class AlignedFileWriter {
+public:
+    AlignedFileWriter();
+    ~AlignedFileWriter();
+
+    AlignedFileWriter(const AlignedFileWriter&) = delete;
+    AlignedFileWriter& operator=(const AlignedFileWriter&) = delete;
+
+public:
+    // Creates or truncates `path`. Throws on failure.
+    void Open(const std::string& path,
+              const FileWriterOptions& options = FileWriterOptions());
+    // Writes what is buffered and closes the file. Throws on failure.
+    void Close();
+
+    void Write(const uint8_t* data, size_t size);
+    // Like lseek(); returns the new position.
+    int64_t Seek(int64_t offset, int whence);
+    // Bytes up to the furthest write.
+    int64_t Size() const;
+
+    FileWriterStats GetStats() const;
+
+private:
+#ifdef _WIN32
+    // A HANDLE, without pulling in windows.h.
+    using Handle = void*;
+#else
+    using Handle = int;
+#endif
+
+    void Flush();
+    void WriteAt(Handle handle, const uint8_t* data, size_t size,
+                 int64_t offset);
+    void Free();
+
+private:
+    FileWriterOptions options_;
+    std::string path_;
+    bool is_opened_;
+    // For the whole aligned buffers; the same as cached_ without direct_io.
+    Handle direct_;
+    Handle cached_;
+
+    uint8_t* buffer_;
+    // File offset of buffer_[0] and the bytes of the buffer in use.
+    int64_t base_;
+    size_t filled_;
+    int64_t position_;
+
+    mutable std::mutex stats_mutex_;
+    FileWriterStats stats_;
+    double total_ms_;
+};
+
+#endif
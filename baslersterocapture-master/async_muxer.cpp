@@ -0,0 +1,349 @@
+#include "async_muxer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+#include "utils.h"
+#include "video_encoder.h"
+
+namespace {
+// Only collects the small header and index writes of the muxer; packets
+// bypass it, as the file writer has its own large buffer.
+const int kIoBufferSize = 64 * 1024;
+}  // namespace
+
+MuxerOptions ParseMuxerOptions(const nlohmann::json& config,
+                               const MuxerOptions& defaults) {
+    MuxerOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    if (config.count("packet_queue")) {
+        options.packet_queue = ParseQueueOptions(config["packet_queue"],
+                                                 options.packet_queue);
+    }
+    if (options.packet_queue.policy != OverflowPolicy::kBlock) {
+        throw std::runtime_error("װֻʹblock");
+    }
+    options.file = ParseFileWriterOptions(config, options.file);
+    if (config.count("affinity")) {
+        options.affinity = config["affinity"].get<std::vector<int>>();
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const MuxerStats& stats) {
+    os << "packets " << stats.packets << ", mean " << stats.mean_ms
+       << " ms, max " << stats.max_ms << " ms; queue " << stats.packet_queue
+       << "; " << stats.file;
+    return os;
+}
+
+void AsyncMuxer::PacketDeleter::operator()(AVPacket* packet) const {
+    av_packet_free(&packet);
+}
+
+AsyncMuxer::AsyncMuxer()
+        : is_opened_(false),
+          format_context_(nullptr),
+          io_context_(nullptr),
+          total_ms_(0.0) {}
+
+AsyncMuxer::~AsyncMuxer() {
+    try {
+        Close();
+    } catch (...) {
+    }
+}
+
+void AsyncMuxer::Open(const std::string& name, AVOutputFormat* format,
+                      const std::vector<MuxerTrack>& tracks, double fps,
+                      const MuxerOptions& options,
+                      PacketCallback on_written) {
+    Close();
+    options_ = options;
+    on_written_ = std::move(on_written);
+    error_ = nullptr;
+
+    try {
+        avformat_alloc_output_context2(&format_context_, format,
+                                       format->name, name.c_str());
+        if (!format_context_) {
+            throw std::runtime_error("޷װ");
+        }
+
+        for (const MuxerTrack& track : tracks) {
+            AVStream* stream = avformat_new_stream(format_context_, nullptr);
+            if (!stream) {
+                throw std::runtime_error("޷Ƶ");
+            }
+            if (avcodec_parameters_from_context(stream->codecpar,
+                                                track.context) < 0) {
+                throw std::runtime_error("޷Ƶ");
+            }
+            AVRational time_base = track.time_base.num > 0
+                                           ? track.time_base
+                                           : track.context->time_base;
+            // Only a hint; the header may pick its own time base.
+            stream->time_base = time_base;
+            stream->r_frame_rate = stream->avg_frame_rate =
+                    AVRational{static_cast<int>(fps), 1};
+            if (!track.title.empty()) {
+                av_dict_set(&stream->metadata, "title", track.title.c_str(),
+                            0);
+            }
+            streams_.push_back(stream);
+            packet_time_bases_.push_back(time_base);
+        }
+        pending_ = std::vector<std::deque<PacketPtr>>(streams_.size());
+
+        av_dump_format(format_context_, 0, name.c_str(), 1);
+
+        file_.Open(name, options_.file);
+        uint8_t* buffer = static_cast<uint8_t*>(av_malloc(kIoBufferSize));
+        if (!buffer) {
+            throw std::runtime_error("޷ļд");
+        }
+        io_context_ = avio_alloc_context(buffer, kIoBufferSize, 1, this,
+                                         nullptr, WriteCallback,
+                                         SeekCallback);
+        if (!io_context_) {
+            av_free(buffer);
+            throw std::runtime_error("޷ļд");
+        }
+        io_context_->direct = 1;
+        format_context_->pb = io_context_;
+
+        int ret = avformat_write_header(format_context_, nullptr);
+        if (ret < 0) {
+            throw std::runtime_error("޷дļͷ: " + GetErrorString(ret));
+        }
+    } catch (...) {
+        Free();
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_ = MuxerStats();
+        total_ms_ = 0.0;
+    }
+    is_opened_ = true;
+    packets_.Configure(options_.packet_queue);
+    packets_.Open();
+    thread_ = std::thread([this]() { Run(); });
+}
+
+void AsyncMuxer::Close() {
+    if (!is_opened_) {
+        return;
+    }
+    is_opened_ = false;
+    packets_.Close();
+    thread_.join();
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error = error_;
+    }
+    if (!error) {
+        try {
+            int ret = av_write_trailer(format_context_);
+            if (ret < 0) {
+                throw std::runtime_error("дļβ: " +
+                                         GetErrorString(ret));
+            }
+            avio_flush(io_context_);
+            file_.Close();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        // A failed file write is more telling than the muxer's error code.
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error_) {
+            error = error_;
+        }
+    }
+    Free();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void AsyncMuxer::Write(const AVPacket* packet, size_t track) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+    PacketPtr copy(av_packet_alloc());
+    if (!copy || av_packet_ref(copy.get(), packet) < 0) {
+        throw std::runtime_error("޷ʼƵݰ");
+    }
+    copy->stream_index = static_cast<int>(track);
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    packets_.Push(std::move(copy));
+}
+
+MuxerStats AsyncMuxer::GetStats() const {
+    MuxerStats stats;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats = stats_;
+    }
+    stats.packet_queue = packets_.GetStats();
+    stats.file = file_.GetStats();
+    return stats;
+}
+
+void AsyncMuxer::Run() {
+    if (!options_.affinity.empty() &&
+        !SetCurrentThreadAffinity(options_.affinity)) {
+        std::cerr << "޷÷װ̵߳CPU׺" << std::endl;
+    }
+    PacketPtr packet;
+    while (packets_.WaitNotEmpty()) {
+        while (packets_.TryPop(packet)) {
+            bool failed;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                failed = error_ != nullptr;
+            }
+            // After an error the queue is still drained, so Write() does
+            // not block on it.
+            if (!failed) {
+                try {
+                    Interleave(std::move(packet), false);
+                } catch (...) {
+                    Fail(std::current_exception());
+                }
+            }
+            packet.reset();
+        }
+    }
+
+    bool failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed = error_ != nullptr;
+    }
+    if (!failed) {
+        try {
+            Interleave(nullptr, true);
+        } catch (...) {
+            Fail(std::current_exception());
+        }
+    }
+}
+
+void AsyncMuxer::Interleave(PacketPtr packet, bool flush) {
+    if (packet) {
+        pending_[packet->stream_index].push_back(std::move(packet));
+    }
+    while (true) {
+        size_t next = pending_.size();
+        for (size_t i = 0; i < pending_.size(); ++i) {
+            if (pending_[i].empty()) {
+                if (!flush) {
+                    return;
+                }
+                continue;
+            }
+            if (next == pending_.size() ||
+                av_compare_ts(pending_[i].front()->dts,
+                              packet_time_bases_[i],
+                              pending_[next].front()->dts,
+                              packet_time_bases_[next]) < 0) {
+                next = i;
+            }
+        }
+        if (next == pending_.size()) {
+            return;
+        }
+        PacketPtr ready = std::move(pending_[next].front());
+        pending_[next].pop_front();
+        Mux(ready.get());
+    }
+}
+
+void AsyncMuxer::Mux(AVPacket* packet) {
+    size_t track = packet->stream_index;
+    int64_t pts = packet->pts;
+    packet->stream_index = streams_[track]->index;
+    av_packet_rescale_ts(packet, packet_time_bases_[track],
+                         streams_[track]->time_base);
+
+    auto start = std::chrono::steady_clock::now();
+    int64_t offset = avio_tell(format_context_->pb);
+    int ret = av_write_frame(format_context_, packet);
+    if (ret >= 0 && on_written_ &&
+        (format_context_->oformat->flags & AVFMT_ALLOW_FLUSH)) {
+        ret = av_write_frame(format_context_, nullptr);
+    }
+    double elapsed_ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.packets;
+        total_ms_ += elapsed_ms;
+        stats_.mean_ms = total_ms_ / stats_.packets;
+        stats_.max_ms = std::max(stats_.max_ms, elapsed_ms);
+    }
+    if (ret < 0) {
+        throw std::runtime_error("дƵݰ: " +
+                                 GetErrorString(ret));
+    }
+    if (on_written_) {
+        on_written_(track, pts, offset,
+                    avio_tell(format_context_->pb) - offset);
+    }
+}
+
+void AsyncMuxer::Fail(std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_) {
+        error_ = error;
+    }
+}
+
+void AsyncMuxer::Free() {
+    avformat_free_context(format_context_);
+    format_context_ = nullptr;
+    streams_.clear();
+    packet_time_bases_.clear();
+    pending_.clear();
+    if (io_context_) {
+        av_freep(&io_context_->buffer);
+        avio_context_free(&io_context_);
+    }
+    try {
+        file_.Close();
+    } catch (...) {
+    }
+}
+
+int AsyncMuxer::WriteCallback(void* opaque, uint8_t* data, int size) {
+    AsyncMuxer* muxer = static_cast<AsyncMuxer*>(opaque);
+    try {
+        muxer->file_.Write(data, size);
+        return size;
+    } catch (...) {
+        muxer->Fail(std::current_exception());
+        return AVERROR(EIO);
+    }
+}
+
+int64_t AsyncMuxer::SeekCallback(void* opaque, int64_t offset, int whence) {
+    AsyncMuxer* muxer = static_cast<AsyncMuxer*>(opaque);
+    if (whence & AVSEEK_SIZE) {
+        return muxer->file_.Size();
+    }
+    int64_t position = muxer->file_.Seek(offset, whence & ~AVSEEK_FORCE);
+    return position < 0 ? AVERROR(EINVAL) : position;
+}
@@ -0,0 +1,141 @@
+#ifndef ASYNC_MUXER_H_
+#define ASYNC_MUXER_H_
+
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json.hpp"
+
+#include "aligned_file_writer.h"
+#include "capture_queue.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+struct MuxerOptions {
+    // Packets waiting for the I/O thread. Packets cannot be dropped, so the
+    // policy is always kBlock; size it for the longest disk stall to ride
+    // out.
+    QueueOptions packet_queue = {256, OverflowPolicy::kBlock};
+    FileWriterOptions file;
+    // CPUs the I/O thread runs on; empty leaves it to the OS.
+    std::vector<int> affinity;
+};
+
+// Reads {"packet_queue": {"capacity": N}, "buffer_size": N, "alignment": N,
+// "direct_io": b, "slow_write_ms": x, "affinity": [cpu, ...]}.
+MuxerOptions ParseMuxerOptions(const nlohmann::json& config,
+                               const MuxerOptions& defaults = MuxerOptions());
+
+struct MuxerStats {
+    QueueStats packet_queue;
+    FileWriterStats file;
+    uint64_t packets = 0;
+    // av_write_frame() time, including the file writes it causes.
+    double mean_ms = 0.0;
+    double max_ms = 0.0;
+};
+
+std::ostream& operator<<(std::ostream& os, const MuxerStats& stats);
+
+// A video stream of the file.
+struct MuxerTrack {
+    const AVCodecContext* context = nullptr;
+    // Of the packets' pts and dts; {0, 1} means the codec time base.
+    AVRational time_base = {0, 1};
+    // "title" metadata, e.g. "left"; empty leaves it unset.
+    std::string title;
+};
+
+// Muxes one video stream per track on its own I/O thread, so the encoders
+// only hand packets to a queue and never wait for the disk. The container
+// writes through a custom AVIOContext into an AlignedFileWriter. Packets of
+// several tracks are interleaved by their timestamps.
+class AsyncMuxer {
+public:
+    // `pts` is in the track's time base.
+    using PacketCallback = std::function<void(
+            size_t track, int64_t pts, int64_t offset, int64_t size)>;
+
+    AsyncMuxer();
+    ~AsyncMuxer();
+
+    AsyncMuxer(const AsyncMuxer&) = delete;
+    AsyncMuxer& operator=(const AsyncMuxer&) = delete;
+
+public:
+    // Creates `name` as `format` with a stream set up from each track's
+    // context, in order, writes the header and starts the I/O thread.
+    // `on_written` gets, on the I/O thread, the bytes of the file the muxer
+    // wrote for each packet, in the order written; muxers that can flush,
+    // such as matroska, then close a cluster after every packet so the range
+    // holds it alone.
+    // Throws on failure.
+    void Open(const std::string& name, AVOutputFormat* format,
+              const std::vector<MuxerTrack>& tracks, double fps,
+              const MuxerOptions& options = MuxerOptions(),
+              PacketCallback on_written = PacketCallback());
+    // Writes the queued packets and the trailer and closes the file.
+    // Rethrows the first error of the I/O thread.
+    void Close();
+
+    // Queues a reference to `packet` of track `track`, whose pts and dts are
+    // in that track's time base. Only blocks while the queue is full.
+    // Rethrows the first error of the I/O thread. Calls may come from the
+    // threads of several encoders.
+    void Write(const AVPacket* packet, size_t track = 0);
+
+    MuxerStats GetStats() const;
+
+private:
+    struct PacketDeleter {
+        void operator()(AVPacket* packet) const;
+    };
+    using PacketPtr = std::unique_ptr<AVPacket, PacketDeleter>;
+
+    void Run();
+    // Holds packets back until every track has one and writes them in dts
+    // order, like av_interleaved_write_frame(), but each with its own
+    // av_write_frame(). `flush` writes what is left.
+    void Interleave(PacketPtr packet, bool flush);
+    void Mux(AVPacket* packet);
+    void Fail(std::exception_ptr error);
+    void Free();
+
+    static int WriteCallback(void* opaque, uint8_t* data, int size);
+    static int64_t SeekCallback(void* opaque, int64_t offset, int whence);
+
+private:
+    bool is_opened_;
+    MuxerOptions options_;
+    AVFormatContext* format_context_;
+    AVIOContext* io_context_;
+    std::vector<AVStream*> streams_;
+    std::vector<AVRational> packet_time_bases_;
+    PacketCallback on_written_;
+    // I/O thread only; one per track.
+    std::vector<std::deque<PacketPtr>> pending_;
+    AlignedFileWriter file_;
+
+    CaptureQueue<PacketPtr> packets_;
+    // Held by Write(), as the queue takes a single producer.
+    std::mutex write_mutex_;
+    std::thread thread_;
+
+    mutable std::mutex mutex_;
+    std::exception_ptr error_;
+    MuxerStats stats_;
+    double total_ms_;
+};
+
+#endif
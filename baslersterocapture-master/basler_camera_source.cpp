@@ -0,0 +1,453 @@
+#include "basler_camera_source.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+#include "utils.h"
+
+using namespace Pylon;
+using namespace Basler_UniversalCameraParams;
+
+namespace {
+const bool kIoLow = true;
+const bool kIoHigh = false;
+
+PixelFormat ToPixelFormat(EPixelType pixel_type) {
+    switch (pixel_type) {
+        case PixelType_BGR8packed:
+            return PixelFormat::kBgr8;
+        case PixelType_BayerRG8:
+            return PixelFormat::kBayerRG8;
+        case PixelType_BayerBG8:
+            return PixelFormat::kBayerBG8;
+        case PixelType_Mono8:
+            return PixelFormat::kMono8;
+        case PixelType_YUV422_YUYV_Packed:
+            return PixelFormat::kYCbCr422_8;
+        default:
+            return PixelFormat::kUnknown;
+    }
+}
+}  // namespace
+
+void PrintDeviceInfo(const CDeviceInfo& device);
+std::pair<size_t, size_t> FindCameras(const std::string& left_camera_sn,
+                                      const std::string& right_camera_sn,
+                                      const DeviceInfoList_t& devices);
+
+TriggerOutput ParseTriggerOutput(const std::string& name) {
+    if (name == "user_output") {
+        return TriggerOutput::kUserOutput;
+    }
+    if (name == "timer") {
+        return TriggerOutput::kTimer;
+    }
+    throw std::runtime_error("δ֪Ĵʽ: " + name);
+}
+
+TriggerOptions ParseTriggerOptions(const nlohmann::json& config,
+                                   const TriggerOptions& defaults) {
+    TriggerOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    if (config.count("output")) {
+        options.output = ParseTriggerOutput(config["output"]);
+    }
+    options.pulse_width_us =
+            config.value("pulse_width_us", options.pulse_width_us);
+    options.spin_us = config.value("spin_us", options.spin_us);
+    options.line = config.value("line", options.line);
+    options.free_run_line_source = config.value(
+            "free_run_line_source", options.free_run_line_source);
+    if (options.pulse_width_us <= 0) {
+        throw std::runtime_error("0");
+    }
+    return options;
+}
+
+PoolBufferFactory::PoolBufferFactory(AlignedBufferPool* pool) : pool_(pool) {}
+
+void PoolBufferFactory::AllocateBuffer(size_t buffer_size,
+                                       void** created_buffer,
+                                       intptr_t& buffer_context) {
+    *created_buffer = pool_->Acquire(buffer_size);
+    buffer_context = 0;
+}
+
+void PoolBufferFactory::FreeBuffer(void* created_buffer,
+                                   intptr_t buffer_context) {
+    pool_->Release(static_cast<uint8_t*>(created_buffer));
+}
+
+// The factory is owned by BaslerCameraSource.
+void PoolBufferFactory::DestroyBufferFactory() {}
+
+BaslerCameraSource::BaslerCameraSource(
+        IPylonDevice* device, const TriggerOptions& trigger_options,
+        const BufferPoolOptions& buffer_pool_options)
+        : buffer_factory_(&buffer_pool_),
+          buffer_pool_options_(buffer_pool_options),
+          held_buffers_(std::make_shared<HeldBuffers>()),
+          trigger_options_(trigger_options) {
+    camera_.Attach(device);
+    camera_.Open();
+}
+
+BaslerCameraSource::~BaslerCameraSource() {
+    StopGrabbing();
+}
+
+std::string BaslerCameraSource::Name() const {
+    return std::string(camera_.GetDeviceInfo().GetSerialNumber().c_str());
+}
+
+void BaslerCameraSource::LoadFeatures(const std::string& feature_file) {
+    CFeaturePersistence::Load(feature_file.c_str(), &camera_.GetNodeMap(),
+                              true);
+}
+
+void BaslerCameraSource::SetPixelFormat(PixelFormat pixel_format) {
+    if (pixel_format == PixelFormat::kUnknown) {
+        return;
+    }
+    std::string name = PixelFormatName(pixel_format);
+    if (!camera_.PixelFormat.CanSetValue(name.c_str())) {
+        throw std::runtime_error(Name() + " ֧ظʽ: " + name);
+    }
+    camera_.PixelFormat.SetValue(name.c_str());
+}
+
+void BaslerCameraSource::Configure(CameraRole role, SyncMode sync_mode,
+                                   double frame_rate) {
+    if (role == CameraRole::kMaster) {
+        camera_.GainAuto.SetValue(GainAuto_Continuous);
+        camera_.ExposureAuto.SetValue(ExposureAuto_Continuous);
+        camera_.BalanceWhiteAuto.SetValue(BalanceWhiteAuto_Continuous);
+
+        if (sync_mode == SyncMode::kFreeRun) {
+            ConfigureFreeRun(frame_rate);
+            return;
+        }
+
+        camera_.UserOutputSelector.SetValue(UserOutputSelector_UserOutput3);
+        camera_.UserOutputValue.SetValue(kIoLow);
+        SetOutputLineSource("UserOutput3");
+
+        if (trigger_options_.output == TriggerOutput::kTimer &&
+            !ConfigureTimerOutput()) {
+            std::cerr << Name() << " ֶ֧ʱ,  UserOutput3"
+                      << std::endl;
+            trigger_options_.output = TriggerOutput::kUserOutput;
+        }
+    } else {
+        camera_.GainAuto.SetValue(GainAuto_Off);
+        camera_.ExposureAuto.SetValue(ExposureAuto_Off);
+        camera_.BalanceWhiteAuto.SetValue(BalanceWhiteAuto_Off);
+    }
+}
+
+void BaslerCameraSource::StartGrabbing() {
+    if (buffer_pool_options_.max_num_buffer > 0) {
+        camera_.MaxNumBuffer.SetValue(
+                static_cast<int64_t>(buffer_pool_options_.max_num_buffer));
+    }
+    size_t count = static_cast<size_t>(camera_.MaxNumBuffer.GetValue());
+    size_t payload_size = static_cast<size_t>(camera_.PayloadSize.GetValue());
+    // Buffers of an earlier grab may still be held downstream; the pool
+    // keeps their slab until they are released, but reuse it when it fits.
+    BufferPoolStats stats = buffer_pool_.GetStats();
+    if (stats.buffers < count || stats.buffer_size < payload_size) {
+        buffer_pool_.Reserve(payload_size, count, buffer_pool_options_);
+    }
+    camera_.SetBufferFactory(&buffer_factory_, Cleanup_None);
+    camera_.StartGrabbing();
+}
+
+void BaslerCameraSource::StopGrabbing() {
+    if (camera_.IsGrabbing()) {
+        camera_.StopGrabbing();
+    }
+}
+
+void BaslerCameraSource::WaitForFrameTriggerReady(unsigned int timeout_ms) {
+    camera_.WaitForFrameTriggerReady(timeout_ms,
+                                     TimeoutHandling_ThrowException);
+}
+
+std::chrono::steady_clock::time_point BaslerCameraSource::Trigger() {
+    using Clock = std::chrono::steady_clock;
+    if (trigger_options_.output == TriggerOutput::kTimer) {
+        auto before = Clock::now();
+        camera_.SoftwareSignalPulse.Execute();
+        return before + (Clock::now() - before) / 2;
+    }
+
+    // The edge happens somewhere inside the node write round trip.
+    auto before = Clock::now();
+    camera_.UserOutputValue.SetValue(kIoHigh);
+    auto after = Clock::now();
+    auto rising_edge = before + (after - before) / 2;
+    auto falling_edge = rising_edge + std::chrono::microseconds(
+                                              trigger_options_.pulse_width_us);
+    SleepUntil(falling_edge,
+               std::chrono::microseconds(trigger_options_.spin_us));
+    camera_.UserOutputValue.SetValue(kIoLow);
+    return rising_edge;
+}
+
+CameraFrame BaslerCameraSource::RetrieveFrame(unsigned int timeout_ms) {
+    CGrabResultPtr grab_result;
+    camera_.RetrieveResult(timeout_ms, grab_result,
+                           TimeoutHandling_ThrowException);
+
+    CameraFrame frame;
+    frame.block_id = grab_result->GetBlockID();
+    frame.timestamp = grab_result->GetTimeStamp();
+    frame.width = static_cast<int>(grab_result->GetWidth());
+    frame.height = static_cast<int>(grab_result->GetHeight());
+    frame.pixel_format = ToPixelFormat(grab_result->GetPixelType());
+    size_t stride = 0;
+    if (!grab_result->GetStride(stride)) {
+        stride = frame.width * BytesPerPixel(frame.pixel_format);
+    }
+    frame.stride = stride;
+    frame.buffer = static_cast<uint8_t*>(grab_result->GetBuffer());
+    auto held_buffers = held_buffers_;
+    size_t held = ++held_buffers->count;
+    size_t high_water_mark = held_buffers->high_water_mark;
+    while (held > high_water_mark &&
+           !held_buffers->high_water_mark.compare_exchange_weak(
+                   high_water_mark, held)) {
+    }
+    frame.holder = std::shared_ptr<CGrabResultPtr>(
+            new CGrabResultPtr(grab_result),
+            [held_buffers](CGrabResultPtr* released) {
+                delete released;
+                --held_buffers->count;
+            });
+    frame.succeeded = grab_result->GrabSucceeded();
+    return frame;
+}
+
+// GigE cameras count at GevTimestampTickFrequency; USB3 ones count ns.
+double BaslerCameraSource::TimestampTickNs() {
+    if (camera_.GevTimestampTickFrequency.IsReadable()) {
+        return 1e9 / static_cast<double>(
+                             camera_.GevTimestampTickFrequency.GetValue());
+    }
+    return 1.0;
+}
+
+// The grab engine keeps every pool buffer allocated while grabbing, so
+// usage is what the application holds.
+BufferPoolStats BaslerCameraSource::GetBufferStats() const {
+    BufferPoolStats stats = buffer_pool_.GetStats();
+    stats.in_use = held_buffers_->count;
+    stats.high_water_mark = held_buffers_->high_water_mark;
+    return stats;
+}
+
+bool BaslerCameraSource::ConfigureTimerOutput() {
+    if (!camera_.TimerSelector.CanSetValue("Timer1") ||
+        !camera_.SoftwareSignalSelector.CanSetValue("SoftwareSignal1") ||
+        !camera_.LineSelector.CanSetValue(trigger_options_.line.c_str())) {
+        return false;
+    }
+    camera_.TimerSelector.SetValue("Timer1");
+    if (!camera_.TimerTriggerSource.CanSetValue("SoftwareSignal1")) {
+        return false;
+    }
+    camera_.TimerTriggerSource.SetValue("SoftwareSignal1");
+    camera_.TimerDelay.TrySetValue(0.0);
+    camera_.TimerDuration.SetValue(
+            static_cast<double>(trigger_options_.pulse_width_us));
+
+    camera_.LineSelector.SetValue(trigger_options_.line.c_str());
+    if (!camera_.LineSource.CanSetValue("Timer1Active")) {
+        return false;
+    }
+    camera_.LineSource.SetValue("Timer1Active");
+    camera_.SoftwareSignalSelector.SetValue("SoftwareSignal1");
+    return true;
+}
+
+void BaslerCameraSource::ConfigureFreeRun(double frame_rate) {
+    camera_.TriggerSelector.SetValue(TriggerSelector_FrameStart);
+    camera_.TriggerMode.SetValue(TriggerMode_Off);
+
+    camera_.AcquisitionFrameRateEnable.TrySetValue(true);
+    if (!camera_.AcquisitionFrameRate.TrySetValue(frame_rate) &&
+        !camera_.AcquisitionFrameRateAbs.TrySetValue(frame_rate)) {
+        throw std::runtime_error("޷֡");
+    }
+
+    SetOutputLineSource(trigger_options_.free_run_line_source);
+}
+
+// Fails instead of pulsing an output that is not wired to the slave.
+void BaslerCameraSource::SetOutputLineSource(const std::string& source) {
+    if (!camera_.LineSelector.CanSetValue(trigger_options_.line.c_str())) {
+        throw std::runtime_error("֧: " +
+                                 trigger_options_.line);
+    }
+    camera_.LineSelector.SetValue(trigger_options_.line.c_str());
+    if (!camera_.LineSource.CanSetValue(source.c_str())) {
+        throw std::runtime_error(" " + trigger_options_.line +
+                                 " ֧ź: " + source);
+    }
+    camera_.LineSource.SetValue(source.c_str());
+}
+
+CameraParameters BaslerCameraSource::GetParameters() {
+    CameraParameters parameters;
+    parameters.gain = camera_.Gain.GetValue(false, true);
+    parameters.exposure_time = camera_.ExposureTime.GetValue(false, true);
+
+    camera_.BalanceRatioSelector.SetValue(BalanceRatioSelector_Red);
+    parameters.balance_red = camera_.BalanceRatio.GetValue(false, true);
+
+    camera_.BalanceRatioSelector.SetValue(BalanceRatioSelector_Green);
+    parameters.balance_green = camera_.BalanceRatio.GetValue(false, true);
+
+    camera_.BalanceRatioSelector.SetValue(BalanceRatioSelector_Blue);
+    parameters.balance_blue = camera_.BalanceRatio.GetValue(false, true);
+    return parameters;
+}
+
+void BaslerCameraSource::SetParameters(const CameraParameters& parameters) {
+    camera_.Gain.SetValue(parameters.gain);
+    camera_.ExposureTime.SetValue(parameters.exposure_time);
+
+    camera_.BalanceRatioSelector.SetValue(BalanceRatioSelector_Red);
+    camera_.BalanceRatio.SetValue(parameters.balance_red);
+
+    camera_.BalanceRatioSelector.SetValue(BalanceRatioSelector_Green);
+    camera_.BalanceRatio.SetValue(parameters.balance_green);
+
+    camera_.BalanceRatioSelector.SetValue(BalanceRatioSelector_Blue);
+    camera_.BalanceRatio.SetValue(parameters.balance_blue);
+}
+
+std::pair<std::unique_ptr<CameraSource>, std::unique_ptr<CameraSource>>
+OpenBaslerCameras(const std::string& left_camera_sn,
+                  const std::string& right_camera_sn,
+                  const TriggerOptions& trigger_options,
+                  const BufferPoolOptions& buffer_pool_options) {
+    CTlFactory& tl_factory = CTlFactory::GetInstance();
+    DeviceInfoList_t devices;
+    if (tl_factory.EnumerateDevices(devices) == 0) {
+        throw std::runtime_error("δ.");
+    }
+
+    for (size_t i = 0; i < devices.size(); ++i) {
+        std::cout << " " << i << " Ϣ: " << std::endl;
+        PrintDeviceInfo(devices[i]);
+        std::cout << std::endl;
+    }
+
+    auto camera_index = FindCameras(left_camera_sn, right_camera_sn, devices);
+
+    std::unique_ptr<CameraSource> left_camera(new BaslerCameraSource(
+            tl_factory.CreateDevice(devices[camera_index.first]),
+            trigger_options, buffer_pool_options));
+    std::unique_ptr<CameraSource> right_camera(new BaslerCameraSource(
+            tl_factory.CreateDevice(devices[camera_index.second]),
+            trigger_options, buffer_pool_options));
+    return std::make_pair(std::move(left_camera), std::move(right_camera));
+}
+
+void PrintDeviceInfo(const CDeviceInfo& device) {
+    if (device.IsSerialNumberAvailable()) {
+        std::cout << "SerialNumber: " << device.GetSerialNumber() << std::endl;
+    }
+
+    if (device.IsUserDefinedNameAvailable()) {
+        std::cout << "UserDefinedName: " << device.GetUserDefinedName()
+                  << std::endl;
+    }
+
+    if (device.IsModelNameAvailable()) {
+        std::cout << "ModelName: " << device.GetModelName() << std::endl;
+    }
+
+    if (device.IsDeviceVersionAvailable()) {
+        std::cout << "DeviceVersion: " << device.GetDeviceVersion()
+                  << std::endl;
+    }
+
+    if (device.IsDeviceFactoryAvailable()) {
+        std::cout << "DeviceFactory: " << device.GetDeviceFactory()
+                  << std::endl;
+    }
+
+    if (device.IsInterfaceIDAvailable()) {
+        std::cout << "InterfaceID: " << device.GetInterfaceID() << std::endl;
+    }
+
+    if (device.IsDeviceGUIDAvailable()) {
+        std::cout << "DeviceGUID: " << device.GetDeviceGUID() << std::endl;
+    }
+
+    if (device.IsManufacturerInfoAvailable()) {
+        std::cout << "ManufacturerInfo: " << device.GetManufacturerInfo()
+                  << std::endl;
+    }
+
+    if (device.IsDeviceIdxAvailable()) {
+        std::cout << "DeviceIdx: " << device.GetDeviceIdx() << std::endl;
+    }
+
+    if (device.IsProductIdAvailable()) {
+        std::cout << "ProductId: " << device.GetProductId() << std::endl;
+    }
+
+    if (device.IsVendorIdAvailable()) {
+        std::cout << "VendorId: " << device.GetVendorId() << std::endl;
+    }
+
+    if (device.IsDriverKeyNameAvailable()) {
+        std::cout << "DriverKeyName: " << device.GetDriverKeyName()
+                  << std::endl;
+    }
+
+    if (device.IsUsbDriverTypeAvailable()) {
+        std::cout << "UsbDriverType: " << device.GetUsbDriverType()
+                  << std::endl;
+    }
+
+    if (device.IsTransferModeAvailable()) {
+        std::cout << "TransferMode: " << device.GetTransferMode() << std::endl;
+    }
+}
+
+std::pair<size_t, size_t> FindCameras(const std::string& left_camera_sn,
+                                      const std::string& right_camera_sn,
+                                      const DeviceInfoList_t& devices) {
+    int left_index = -1;
+    int right_index = -1;
+
+    for (int i = 0; i < devices.size(); ++i) {
+        if (std::string(devices[i].GetSerialNumber().c_str()) ==
+            left_camera_sn) {
+            left_index = i;
+        }
+
+        if (std::string(devices[i].GetSerialNumber().c_str()) ==
+            right_camera_sn) {
+            right_index = i;
+        }
+    }
+
+    if (left_index == -1) {
+        throw std::runtime_error("δ");
+    }
+
+    if (right_index == -1) {
+        throw std::runtime_error("δ");
+    }
+
+    return std::make_pair(static_cast<size_t>(left_index),
+                          static_cast<size_t>(right_index));
+}
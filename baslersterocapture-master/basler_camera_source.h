@@ -0,0 +1,132 @@
+#ifndef BASLER_CAMERA_SOURCE_H_
+#define BASLER_CAMERA_SOURCE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+// Include files to use the pylon API.
+#include <pylon/PylonIncludes.h>
+#ifdef PYLON_WIN_BUILD
+#include <pylon/PylonGUI.h>
+#endif
+
+// Settings to use any camera type.
+#include <pylon/BaslerUniversalInstantCamera.h>
+
+#include "json.hpp"
+
+#include "aligned_buffer_pool.h"
+#include "camera_source.h"
+
+// How the master generates the trigger pulse on the shared trigger line.
+// Every mode drives TriggerOptions::line; on ace USB cameras UserOutput3 is
+// Line4, so that is the GPIO wired to the slave's trigger input.
+enum class TriggerOutput {
+    // The host raises UserOutput3 on `line`, waits pulse_width_us and lowers
+    // it.
+    kUserOutput,
+    // The host fires SoftwareSignal1 and the camera's Timer1 drives `line`
+    // for pulse_width_us, so the width does not depend on the host at all.
+    kTimer,
+};
+
+TriggerOutput ParseTriggerOutput(const std::string& name);
+
+struct TriggerOptions {
+    TriggerOutput output = TriggerOutput::kUserOutput;
+    int64_t pulse_width_us = 50;
+    // Part of a kUserOutput pulse spent spinning instead of sleeping.
+    int64_t spin_us = 200;
+    // Master output line wired to the trigger inputs, driven by UserOutput3,
+    // Timer1 or, in free-run, `free_run_line_source`.
+    std::string line = "Line4";
+    std::string free_run_line_source = "ExposureActive";
+};
+
+// Reads {"output": "user_output"|"timer", "pulse_width_us": N,
+// "spin_us": N, "line": "LineN", "free_run_line_source": "ExposureActive"}.
+TriggerOptions ParseTriggerOptions(
+        const nlohmann::json& config,
+        const TriggerOptions& defaults = TriggerOptions());
+
+// Serves the pylon grab engine from an AlignedBufferPool instead of its
+// default allocator.
+class PoolBufferFactory : public Pylon::IBufferFactory {
+public:
+    explicit PoolBufferFactory(AlignedBufferPool* pool);
+
+public:
+    void AllocateBuffer(size_t buffer_size, void** created_buffer,
+                        intptr_t& buffer_context) override;
+    void FreeBuffer(void* created_buffer, intptr_t buffer_context) override;
+    void DestroyBufferFactory() override;
+
+private:
+    AlignedBufferPool* pool_;
+};
+
+class BaslerCameraSource : public CameraSource {
+public:
+    BaslerCameraSource(Pylon::IPylonDevice* device,
+                       const TriggerOptions& trigger_options,
+                       const BufferPoolOptions& buffer_pool_options);
+    ~BaslerCameraSource() override;
+
+public:
+    std::string Name() const override;
+
+    void LoadFeatures(const std::string& feature_file) override;
+    void SetPixelFormat(PixelFormat pixel_format) override;
+    void Configure(CameraRole role, SyncMode sync_mode,
+                   double frame_rate) override;
+
+    void StartGrabbing() override;
+    void StopGrabbing() override;
+
+    void WaitForFrameTriggerReady(unsigned int timeout_ms) override;
+    std::chrono::steady_clock::time_point Trigger() override;
+    CameraFrame RetrieveFrame(unsigned int timeout_ms) override;
+    double TimestampTickNs() override;
+
+    BufferPoolStats GetBufferStats() const override;
+
+    CameraParameters GetParameters() override;
+    void SetParameters(const CameraParameters& parameters) override;
+
+private:
+    bool ConfigureTimerOutput();
+    void ConfigureFreeRun(double frame_rate);
+    void SetOutputLineSource(const std::string& source);
+
+private:
+    // Grab results handed out and not yet released.
+    struct HeldBuffers {
+        std::atomic<size_t> count{0};
+        std::atomic<size_t> high_water_mark{0};
+    };
+
+private:
+    // Declared before camera_ so they outlive the grab engine's buffers.
+    AlignedBufferPool buffer_pool_;
+    PoolBufferFactory buffer_factory_;
+    BufferPoolOptions buffer_pool_options_;
+    std::shared_ptr<HeldBuffers> held_buffers_;
+
+    Pylon::CBaslerUniversalInstantCamera camera_;
+    TriggerOptions trigger_options_;
+};
+
+// Enumerates the connected cameras and opens the two with the given serial
+// numbers.
+std::pair<std::unique_ptr<CameraSource>, std::unique_ptr<CameraSource>>
+OpenBaslerCameras(const std::string& left_camera_sn,
+                  const std::string& right_camera_sn,
+                  const TriggerOptions& trigger_options = TriggerOptions(),
+                  const BufferPoolOptions& buffer_pool_options =
+                          BufferPoolOptions());
+
+#endif
@@ -0,0 +1,60 @@
+#include "camera_source.h"
+
+#include <stdexcept>
+
+namespace {
+struct PixelFormatEntry {
+    PixelFormat pixel_format;
+    const char* name;
+    size_t bytes_per_pixel;
+};
+
+const PixelFormatEntry kPixelFormats[] = {
+        {PixelFormat::kBgr8, "BGR8", 3},
+        {PixelFormat::kBayerRG8, "BayerRG8", 1},
+        {PixelFormat::kBayerBG8, "BayerBG8", 1},
+        {PixelFormat::kMono8, "Mono8", 1},
+        {PixelFormat::kYCbCr422_8, "YCbCr422_8", 2},
+};
+}  // namespace
+
+PixelFormat ParsePixelFormat(const std::string& name) {
+    for (const auto& entry : kPixelFormats) {
+        if (name == entry.name) {
+            return entry.pixel_format;
+        }
+    }
+    throw std::runtime_error("ֵ֧ظʽ: " + name);
+}
+
+std::string PixelFormatName(PixelFormat pixel_format) {
+    for (const auto& entry : kPixelFormats) {
+        if (pixel_format == entry.pixel_format) {
+            return entry.name;
+        }
+    }
+    return "Unknown";
+}
+
+size_t BytesPerPixel(PixelFormat pixel_format) {
+    for (const auto& entry : kPixelFormats) {
+        if (pixel_format == entry.pixel_format) {
+            return entry.bytes_per_pixel;
+        }
+    }
+    return 0;
+}
+
+SyncMode ParseSyncMode(const std::string& name) {
+    if (name == "software_trigger") {
+        return SyncMode::kSoftwareTrigger;
+    }
+    if (name == "free_run") {
+        return SyncMode::kFreeRun;
+    }
+    throw std::runtime_error("δ֪ͬʽ: " + name);
+}
+
+bool CameraFrame::IsValid() const {
+    return succeeded && buffer != nullptr;
+}
@@ -0,0 +1,112 @@
+#ifndef CAMERA_SOURCE_H_
+#define CAMERA_SOURCE_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "aligned_buffer_pool.h"
+
+enum class PixelFormat {
+    kUnknown,
+    kBgr8,
+    kBayerRG8,
+    kBayerBG8,
+    kMono8,
+    kYCbCr422_8,
+};
+
+PixelFormat ParsePixelFormat(const std::string& name);
+std::string PixelFormatName(PixelFormat pixel_format);
+size_t BytesPerPixel(PixelFormat pixel_format);
+
+struct CameraParameters {
+    double gain = 0.0;
+    double exposure_time = 0.0;
+    double balance_red = 1.0;
+    double balance_green = 1.0;
+    double balance_blue = 1.0;
+};
+
+// One image delivered by a CameraSource. `holder` owns whatever backs
+// `buffer` (a pylon grab result, a synthetic buffer, ...), so copies of the
+// frame keep the pixels alive.
+struct CameraFrame {
+    uint64_t block_id = 0;
+    // Camera clock, in the camera's timestamp ticks (ns for the synthetic
+    // and replay sources).
+    uint64_t timestamp = 0;
+    int width = 0;
+    int height = 0;
+    PixelFormat pixel_format = PixelFormat::kUnknown;
+    size_t stride = 0;
+    uint8_t* buffer = nullptr;
+    std::shared_ptr<void> holder;
+    // False for frames lost or damaged in transfer; they carry a BlockID
+    // but no usable pixels.
+    bool succeeded = true;
+    // ParameterSync epoch in force when the frame was triggered.
+    uint64_t parameter_epoch = 0;
+    // Host steady_clock time of the trigger pulse, in ns. 0 in free-run.
+    int64_t trigger_time = 0;
+    // Written to the slave in parameter_epoch; left at the defaults when
+    // that epoch is unknown.
+    CameraParameters parameters;
+
+    bool IsValid() const;
+};
+
+// The master runs the auto functions and is triggered by the host; the
+// slave follows it through the trigger line and parameter sync.
+enum class CameraRole { kMaster, kSlave };
+
+// How the master is paced. In both modes the master's output line triggers
+// the slave.
+enum class SyncMode {
+    kSoftwareTrigger,  // the host triggers the master for every frame
+    kFreeRun,          // the master runs at its own frame rate
+};
+
+SyncMode ParseSyncMode(const std::string& name);
+
+// One camera of the stereo rig. SteroCamera only talks to cameras through
+// this interface, so the grab/pair/encode path can run against synthetic or
+// recorded frames as well as real Basler cameras. Failures are reported by
+// throwing, as the pylon API does.
+class CameraSource {
+public:
+    virtual ~CameraSource() = default;
+
+public:
+    virtual std::string Name() const = 0;
+
+    virtual void LoadFeatures(const std::string& feature_file) = 0;
+    // Called after LoadFeatures(); kUnknown keeps the current format.
+    virtual void SetPixelFormat(PixelFormat pixel_format) = 0;
+    // `frame_rate` is only used by a kFreeRun master.
+    virtual void Configure(CameraRole role, SyncMode sync_mode,
+                           double frame_rate) = 0;
+
+    virtual void StartGrabbing() = 0;
+    virtual void StopGrabbing() = 0;
+
+    virtual void WaitForFrameTriggerReady(unsigned int timeout_ms) = 0;
+    // Fires the shared trigger line and returns when the pulse started.
+    // Only called on a kSoftwareTrigger master.
+    virtual std::chrono::steady_clock::time_point Trigger() = 0;
+    // Returns one frame per exposure, including failed ones.
+    virtual CameraFrame RetrieveFrame(unsigned int timeout_ms) = 0;
+    // Length of a CameraFrame::timestamp tick, in ns.
+    virtual double TimestampTickNs() = 0;
+
+    // Frame buffers behind the delivered frames; `in_use` counts those still
+    // held by the application.
+    virtual BufferPoolStats GetBufferStats() const = 0;
+
+    virtual CameraParameters GetParameters() = 0;
+    virtual void SetParameters(const CameraParameters& parameters) = 0;
+};
+
+#endif
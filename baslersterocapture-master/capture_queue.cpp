@@ -0,0 +1,61 @@
+#include "capture_queue.h"
+
+#include <stdexcept>
+
+namespace {
+struct PolicyName {
+    OverflowPolicy policy;
+    const char* name;
+};
+
+const PolicyName kPolicyNames[] = {
+        {OverflowPolicy::kBlock, "block"},
+        {OverflowPolicy::kDropOldest, "drop_oldest"},
+        {OverflowPolicy::kDropNewest, "drop_newest"},
+        {OverflowPolicy::kDropPair, "drop_pair"},
+};
+}  // namespace
+
+OverflowPolicy ParseOverflowPolicy(const std::string& name) {
+    for (const auto& entry : kPolicyNames) {
+        if (name == entry.name) {
+            return entry.policy;
+        }
+    }
+    throw std::runtime_error("δ֪Ķ: " + name);
+}
+
+std::string OverflowPolicyName(OverflowPolicy policy) {
+    for (const auto& entry : kPolicyNames) {
+        if (policy == entry.policy) {
+            return entry.name;
+        }
+    }
+    return "unknown";
+}
+
+QueueOptions ParseQueueOptions(const nlohmann::json& config,
+                               const QueueOptions& defaults) {
+    QueueOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    if (config.count("capacity")) {
+        options.capacity = config["capacity"];
+        if (options.capacity == 0) {
+            throw std::runtime_error("0");
+        }
+    }
+    if (config.count("overflow_policy")) {
+        options.policy = ParseOverflowPolicy(config["overflow_policy"]);
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const QueueStats& stats) {
+    os << "size " << stats.size << "/" << stats.capacity << ", high water "
+       << stats.high_water_mark << ", pushed " << stats.pushed << ", popped "
+       << stats.popped << ", dropped " << stats.dropped << ", blocked "
+       << stats.blocked;
+    return os;
+}
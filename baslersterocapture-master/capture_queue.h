@@ -0,0 +1,312 @@
+#ifndef CAPTURE_QUEUE_H_
+#define CAPTURE_QUEUE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include "json.hpp"
+
+#include "notifier.h"
+#include "spmc_ring.h"
+
+// What a producer does when its queue is at capacity.
+enum class OverflowPolicy {
+    kBlock,       // wait for the consumer to make room
+    kDropOldest,  // evict the oldest queued item
+    kDropNewest,  // discard the item being pushed
+    kDropPair,    // evict the oldest item here and its partner in the
+                  // paired queue
+};
+
+OverflowPolicy ParseOverflowPolicy(const std::string& name);
+std::string OverflowPolicyName(OverflowPolicy policy);
+
+struct QueueOptions {
+    size_t capacity = 32;
+    OverflowPolicy policy = OverflowPolicy::kBlock;
+};
+
+// Reads {"capacity": N, "overflow_policy": "..."}; missing keys keep the
+// values from `defaults`.
+QueueOptions ParseQueueOptions(const nlohmann::json& config,
+                               const QueueOptions& defaults = QueueOptions());
+
+struct QueueStats {
+    size_t size = 0;
+    size_t capacity = 0;
+    size_t high_water_mark = 0;
+    uint64_t pushed = 0;
+    uint64_t popped = 0;
+    uint64_t dropped = 0;
+    uint64_t blocked = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, const QueueStats& stats);
+
+// Bounded queue for one producer and one consumer thread, applying an
+// OverflowPolicy. The drop policies evict from the producer thread while the
+// consumer pops, which the SpmcRing underneath allows.
+// Close() wakes every waiter; a closed queue can still be drained.
+template <typename T>
+class CaptureQueue {
+public:
+    explicit CaptureQueue(const QueueOptions& options = QueueOptions());
+    ~CaptureQueue() = default;
+
+    CaptureQueue(const CaptureQueue&) = delete;
+    CaptureQueue& operator=(const CaptureQueue&) = delete;
+
+public:
+    // Only valid while neither side is running. Clears the queue and its
+    // statistics.
+    void Configure(const QueueOptions& options);
+
+    // Queue holding the partners of our items. Under kDropPair an evicted
+    // item takes the sibling's item with the same pair key (e.g. BlockID)
+    // with it, whether that one is still queued or not pushed yet. Keys must
+    // increase in push order.
+    void PairWith(CaptureQueue* sibling,
+                  std::function<uint64_t(const T&)> pair_key);
+
+    // Producer side. Returns false if the value was dropped or the queue was
+    // closed while blocking.
+    bool Push(T value);
+
+    // Consumer side.
+    bool TryPop(T& value);
+    bool WaitNotEmpty();
+
+    void Open();
+    void Close();
+    bool IsClosed() const;
+
+    size_t Size() const;
+    QueueStats GetStats() const;
+
+private:
+    bool EvictOldest();
+    void EvictPair();
+    void AddPairDrop(uint64_t key);
+    bool TakePairDrop(const T& value, bool popped);
+    void UpdateHighWaterMark();
+
+private:
+    QueueOptions options_;
+    SpmcRing<T> ring_;
+    CaptureQueue* sibling_;
+    std::function<uint64_t(const T&)> pair_key_;
+
+    Notifier ready_notifier_;
+    Notifier space_notifier_;
+    std::atomic_bool closed_;
+
+    // Keys of items whose partner the sibling evicted, in ascending order.
+    std::mutex pair_drops_mutex_;
+    std::deque<uint64_t> pair_drops_;
+    std::atomic<size_t> pending_pair_drops_;
+    std::atomic<size_t> high_water_mark_;
+    std::atomic<uint64_t> pushed_;
+    std::atomic<uint64_t> popped_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> blocked_;
+};
+
+template <typename T>
+CaptureQueue<T>::CaptureQueue(const QueueOptions& options)
+        : options_(options),
+          ring_(options.capacity),
+          sibling_(nullptr),
+          closed_(false),
+          pending_pair_drops_(0),
+          high_water_mark_(0),
+          pushed_(0),
+          popped_(0),
+          dropped_(0),
+          blocked_(0) {}
+
+template <typename T>
+void CaptureQueue<T>::Configure(const QueueOptions& options) {
+    options_ = options;
+    ring_.Reset(options.capacity);
+    pair_drops_.clear();
+    pending_pair_drops_ = 0;
+    high_water_mark_ = 0;
+    pushed_ = 0;
+    popped_ = 0;
+    dropped_ = 0;
+    blocked_ = 0;
+}
+
+template <typename T>
+void CaptureQueue<T>::PairWith(CaptureQueue* sibling,
+                               std::function<uint64_t(const T&)> pair_key) {
+    sibling_ = sibling;
+    pair_key_ = std::move(pair_key);
+}
+
+template <typename T>
+bool CaptureQueue<T>::Push(T value) {
+    if (TakePairDrop(value, false)) {
+        // The sibling has already evicted our partner.
+        ++dropped_;
+        return false;
+    }
+
+    while (!ring_.TryPush(std::move(value))) {
+        if (closed_) {
+            return false;
+        }
+        switch (options_.policy) {
+            case OverflowPolicy::kBlock:
+                ++blocked_;
+                space_notifier_.Wait(
+                        [this]() { return !ring_.Full() || closed_; });
+                break;
+            case OverflowPolicy::kDropOldest:
+                EvictOldest();
+                break;
+            case OverflowPolicy::kDropNewest:
+                ++dropped_;
+                return false;
+            case OverflowPolicy::kDropPair:
+                EvictPair();
+                break;
+        }
+    }
+
+    ++pushed_;
+    UpdateHighWaterMark();
+    ready_notifier_.Notify();
+    return true;
+}
+
+template <typename T>
+bool CaptureQueue<T>::TryPop(T& value) {
+    while (ring_.TryPop(value)) {
+        space_notifier_.Notify();
+        if (TakePairDrop(value, true)) {
+            // Queued before the sibling evicted its partner.
+            value = T();
+            ++dropped_;
+            continue;
+        }
+        ++popped_;
+        return true;
+    }
+    return false;
+}
+
+template <typename T>
+bool CaptureQueue<T>::WaitNotEmpty() {
+    ready_notifier_.Wait([this]() { return !ring_.Empty() || closed_; });
+    return !ring_.Empty();
+}
+
+template <typename T>
+void CaptureQueue<T>::Open() {
+    closed_ = false;
+}
+
+template <typename T>
+void CaptureQueue<T>::Close() {
+    closed_ = true;
+    ready_notifier_.Notify();
+    space_notifier_.Notify();
+}
+
+template <typename T>
+bool CaptureQueue<T>::IsClosed() const {
+    return closed_;
+}
+
+template <typename T>
+size_t CaptureQueue<T>::Size() const {
+    return ring_.Size();
+}
+
+template <typename T>
+QueueStats CaptureQueue<T>::GetStats() const {
+    QueueStats stats;
+    stats.size = ring_.Size();
+    stats.capacity = ring_.Capacity();
+    stats.high_water_mark = high_water_mark_;
+    stats.pushed = pushed_;
+    stats.popped = popped_;
+    stats.dropped = dropped_;
+    stats.blocked = blocked_;
+    return stats;
+}
+
+template <typename T>
+bool CaptureQueue<T>::EvictOldest() {
+    T evicted;
+    if (!ring_.TryPop(evicted)) {
+        return false;
+    }
+    ++dropped_;
+    return true;
+}
+
+template <typename T>
+void CaptureQueue<T>::EvictPair() {
+    T evicted;
+    if (!ring_.TryPop(evicted)) {
+        return;
+    }
+    ++dropped_;
+    // Nothing to tell the sibling if it evicted the partner first.
+    if (!TakePairDrop(evicted, true) && sibling_ && pair_key_) {
+        sibling_->AddPairDrop(pair_key_(evicted));
+    }
+}
+
+template <typename T>
+void CaptureQueue<T>::AddPairDrop(uint64_t key) {
+    std::lock_guard<std::mutex> lock(pair_drops_mutex_);
+    pair_drops_.push_back(key);
+    // Partners of a stalled camera never arrive to retire their keys.
+    while (pair_drops_.size() > options_.capacity) {
+        pair_drops_.pop_front();
+    }
+    pending_pair_drops_ = pair_drops_.size();
+}
+
+// Returns true, once, if the partner of `value` was evicted. Popping an item
+// also retires the smaller keys: their items have already gone by.
+template <typename T>
+bool CaptureQueue<T>::TakePairDrop(const T& value, bool popped) {
+    if (pending_pair_drops_.load() == 0 || !pair_key_) {
+        return false;
+    }
+    uint64_t key = pair_key_(value);
+    std::lock_guard<std::mutex> lock(pair_drops_mutex_);
+    bool found = false;
+    for (auto it = pair_drops_.begin(); it != pair_drops_.end();) {
+        if (*it == key) {
+            found = true;
+            it = pair_drops_.erase(it);
+        } else if (popped && *it < key) {
+            it = pair_drops_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    pending_pair_drops_ = pair_drops_.size();
+    return found;
+}
+
+template <typename T>
+void CaptureQueue<T>::UpdateHighWaterMark() {
+    size_t size = ring_.Size();
+    size_t high_water_mark = high_water_mark_.load();
+    while (size > high_water_mark &&
+           !high_water_mark_.compare_exchange_weak(high_water_mark, size)) {
+    }
+}
+
+#endif
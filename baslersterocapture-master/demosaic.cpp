@@ -0,0 +1,390 @@
+#include "demosaic.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+// One output row. `up` and `down` are the neighbouring rows, mirrored at the
+// top and bottom.
+struct RowArgs {
+    const uint8_t* up;
+    const uint8_t* row;
+    const uint8_t* down;
+    uint8_t* out;
+    int width;
+    // x parity of the green samples in this row, and whether the other
+    // samples are red or blue.
+    int green_parity;
+    bool red_row;
+};
+
+using RowKernel = void (*)(const RowArgs& args);
+
+// Rounds like _mm_avg_epu8, so all kernels give identical images.
+inline uint8_t Average(uint8_t a, uint8_t b) {
+    return static_cast<uint8_t>((a + b + 1) >> 1);
+}
+
+inline uint8_t AbsDiff(uint8_t a, uint8_t b) {
+    return a > b ? a - b : b - a;
+}
+
+// Mirroring keeps the Bayer phase of the missing neighbour.
+inline int Mirror(int i, int size) {
+    return i < 0 ? -i : (i >= size ? 2 * size - 2 - i : i);
+}
+
+template <bool kEdgeAware>
+void DemosaicPixel(const RowArgs& args, int x) {
+    int l = Mirror(x - 1, args.width);
+    int r = Mirror(x + 1, args.width);
+    uint8_t c = args.row[x];
+    uint8_t h2 = Average(args.row[l], args.row[r]);
+    uint8_t v2 = Average(args.up[x], args.down[x]);
+
+    // `same` is the colour of this row's non-green samples.
+    uint8_t green, same, other;
+    if ((x & 1) == args.green_parity) {
+        green = c;
+        same = h2;
+        other = v2;
+    } else {
+        uint8_t cross = Average(h2, v2);
+        green = cross;
+        if (kEdgeAware) {
+            uint8_t dh = AbsDiff(args.row[l], args.row[r]);
+            uint8_t dv = AbsDiff(args.up[x], args.down[x]);
+            green = dh < dv ? h2 : (dv < dh ? v2 : cross);
+        }
+        same = c;
+        other = Average(Average(args.up[l], args.up[r]),
+                        Average(args.down[l], args.down[r]));
+    }
+
+    uint8_t* out = args.out + x * 3;
+    out[0] = args.red_row ? other : same;
+    out[1] = green;
+    out[2] = args.red_row ? same : other;
+}
+
+template <bool kEdgeAware>
+void DemosaicRowScalar(const RowArgs& args) {
+    for (int x = 0; x < args.width; ++x) {
+        DemosaicPixel<kEdgeAware>(args, x);
+    }
+}
+
+#ifdef SIMD_X86
+// pshufb masks that interleave 16 B, G and R bytes into 48 BGR bytes,
+// indexed by output chunk and channel.
+struct InterleaveMasks {
+    alignas(16) uint8_t mask[3][3][16];
+
+    InterleaveMasks() {
+        for (int chunk = 0; chunk < 3; ++chunk) {
+            for (int channel = 0; channel < 3; ++channel) {
+                for (int i = 0; i < 16; ++i) {
+                    int byte = chunk * 16 + i;
+                    mask[chunk][channel][i] =
+                            byte % 3 == channel ? byte / 3 : 0x80;
+                }
+            }
+        }
+    }
+};
+
+const InterleaveMasks kInterleave;
+
+SIMD_TARGET("ssse3")
+inline __m128i Load128(const uint8_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+SIMD_TARGET("ssse3")
+inline void StoreBgr(uint8_t* out, __m128i b, __m128i g, __m128i r) {
+    for (int chunk = 0; chunk < 3; ++chunk) {
+        const auto& mask = kInterleave.mask[chunk];
+        __m128i bgr = _mm_or_si128(
+                _mm_or_si128(_mm_shuffle_epi8(b, Load128(mask[0])),
+                             _mm_shuffle_epi8(g, Load128(mask[1]))),
+                _mm_shuffle_epi8(r, Load128(mask[2])));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + chunk * 16), bgr);
+    }
+}
+
+// mask ? a : b, per byte.
+SIMD_TARGET("ssse3")
+inline __m128i Select128(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+template <bool kEdgeAware>
+SIMD_TARGET("ssse3")
+void DemosaicRowSsse3(const RowArgs& args) {
+    DemosaicPixel<kEdgeAware>(args, 0);
+
+    int x = 1;
+    // 0xff on green samples; the phase stays the same as x steps by 16.
+    __m128i green = ((x & 1) == args.green_parity)
+                            ? _mm_set1_epi16(0x00ff)
+                            : _mm_set1_epi16(static_cast<short>(0xff00));
+    __m128i zero = _mm_setzero_si128();
+    for (; x + 16 < args.width; x += 16) {
+        __m128i c = Load128(args.row + x);
+        __m128i l = Load128(args.row + x - 1);
+        __m128i r = Load128(args.row + x + 1);
+        __m128i u = Load128(args.up + x);
+        __m128i d = Load128(args.down + x);
+
+        __m128i h2 = _mm_avg_epu8(l, r);
+        __m128i v2 = _mm_avg_epu8(u, d);
+        __m128i cross = _mm_avg_epu8(h2, v2);
+        __m128i diagonal = _mm_avg_epu8(
+                _mm_avg_epu8(Load128(args.up + x - 1),
+                             Load128(args.up + x + 1)),
+                _mm_avg_epu8(Load128(args.down + x - 1),
+                             Load128(args.down + x + 1)));
+
+        __m128i interpolated_green = cross;
+        if (kEdgeAware) {
+            __m128i dh = _mm_or_si128(_mm_subs_epu8(l, r), _mm_subs_epu8(r, l));
+            __m128i dv = _mm_or_si128(_mm_subs_epu8(u, d), _mm_subs_epu8(d, u));
+            __m128i h_not_smoother =
+                    _mm_cmpeq_epi8(_mm_subs_epu8(dv, dh), zero);
+            __m128i v_not_smoother =
+                    _mm_cmpeq_epi8(_mm_subs_epu8(dh, dv), zero);
+            interpolated_green =
+                    Select128(h_not_smoother,
+                              Select128(v_not_smoother, cross, v2), h2);
+        }
+
+        __m128i g = Select128(green, c, interpolated_green);
+        __m128i same = Select128(green, h2, c);
+        __m128i other = Select128(green, v2, diagonal);
+        if (args.red_row) {
+            StoreBgr(args.out + x * 3, other, g, same);
+        } else {
+            StoreBgr(args.out + x * 3, same, g, other);
+        }
+    }
+
+    for (; x < args.width; ++x) {
+        DemosaicPixel<kEdgeAware>(args, x);
+    }
+}
+
+SIMD_TARGET("avx2")
+inline __m256i Load256(const uint8_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+SIMD_TARGET("avx2")
+inline __m256i Select256(__m256i mask, __m256i a, __m256i b) {
+    return _mm256_or_si256(_mm256_and_si256(mask, a),
+                           _mm256_andnot_si256(mask, b));
+}
+
+SIMD_TARGET("avx2")
+inline void StoreBgr256(uint8_t* out, __m256i b, __m256i g, __m256i r) {
+    StoreBgr(out, _mm256_castsi256_si128(b), _mm256_castsi256_si128(g),
+             _mm256_castsi256_si128(r));
+    StoreBgr(out + 48, _mm256_extracti128_si256(b, 1),
+             _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(r, 1));
+}
+
+template <bool kEdgeAware>
+SIMD_TARGET("avx2")
+void DemosaicRowAvx2(const RowArgs& args) {
+    DemosaicPixel<kEdgeAware>(args, 0);
+
+    int x = 1;
+    __m256i green = ((x & 1) == args.green_parity)
+                            ? _mm256_set1_epi16(0x00ff)
+                            : _mm256_set1_epi16(static_cast<short>(0xff00));
+    __m256i zero = _mm256_setzero_si256();
+    for (; x + 32 < args.width; x += 32) {
+        __m256i c = Load256(args.row + x);
+        __m256i l = Load256(args.row + x - 1);
+        __m256i r = Load256(args.row + x + 1);
+        __m256i u = Load256(args.up + x);
+        __m256i d = Load256(args.down + x);
+
+        __m256i h2 = _mm256_avg_epu8(l, r);
+        __m256i v2 = _mm256_avg_epu8(u, d);
+        __m256i cross = _mm256_avg_epu8(h2, v2);
+        __m256i diagonal = _mm256_avg_epu8(
+                _mm256_avg_epu8(Load256(args.up + x - 1),
+                                Load256(args.up + x + 1)),
+                _mm256_avg_epu8(Load256(args.down + x - 1),
+                                Load256(args.down + x + 1)));
+
+        __m256i interpolated_green = cross;
+        if (kEdgeAware) {
+            __m256i dh = _mm256_or_si256(_mm256_subs_epu8(l, r),
+                                         _mm256_subs_epu8(r, l));
+            __m256i dv = _mm256_or_si256(_mm256_subs_epu8(u, d),
+                                         _mm256_subs_epu8(d, u));
+            __m256i h_not_smoother =
+                    _mm256_cmpeq_epi8(_mm256_subs_epu8(dv, dh), zero);
+            __m256i v_not_smoother =
+                    _mm256_cmpeq_epi8(_mm256_subs_epu8(dh, dv), zero);
+            interpolated_green =
+                    Select256(h_not_smoother,
+                              Select256(v_not_smoother, cross, v2), h2);
+        }
+
+        __m256i g = Select256(green, c, interpolated_green);
+        __m256i same = Select256(green, h2, c);
+        __m256i other = Select256(green, v2, diagonal);
+        if (args.red_row) {
+            StoreBgr256(args.out + x * 3, other, g, same);
+        } else {
+            StoreBgr256(args.out + x * 3, same, g, other);
+        }
+    }
+
+    for (; x < args.width; ++x) {
+        DemosaicPixel<kEdgeAware>(args, x);
+    }
+}
+#endif
+
+RowKernel SelectKernel(DemosaicQuality quality, SimdLevel simd) {
+    bool edge_aware = quality == DemosaicQuality::kEdgeAware;
+#ifdef SIMD_X86
+    if (simd == SimdLevel::kAvx2) {
+        return edge_aware ? DemosaicRowAvx2<true> : DemosaicRowAvx2<false>;
+    }
+    if (simd == SimdLevel::kSsse3) {
+        return edge_aware ? DemosaicRowSsse3<true> : DemosaicRowSsse3<false>;
+    }
+#endif
+    return edge_aware ? DemosaicRowScalar<true> : DemosaicRowScalar<false>;
+}
+}  // namespace
+
+DemosaicQuality ParseDemosaicQuality(const std::string& name) {
+    if (name == "bilinear") {
+        return DemosaicQuality::kBilinear;
+    }
+    if (name == "edge_aware") {
+        return DemosaicQuality::kEdgeAware;
+    }
+    throw std::runtime_error("δ֪ȥ㷨: " + name);
+}
+
+std::string DemosaicQualityName(DemosaicQuality quality) {
+    return quality == DemosaicQuality::kBilinear ? "bilinear" : "edge_aware";
+}
+
+DemosaicOptions ParseDemosaicOptions(const nlohmann::json& config,
+                                     const DemosaicOptions& defaults) {
+    DemosaicOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    if (config.count("quality")) {
+        options.quality = ParseDemosaicQuality(config["quality"]);
+    }
+    options.enabled = config.value("enabled", options.enabled);
+    options.threads = config.value("threads", options.threads);
+    options.tile_rows = config.value("tile_rows", options.tile_rows);
+    if (config.count("simd")) {
+        options.simd = ParseSimdLevel(config["simd"]);
+    }
+    if (options.tile_rows <= 0) {
+        throw std::runtime_error("ȥ˷ֿ0");
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const DemosaicStats& stats) {
+    os << DemosaicQualityName(stats.quality) << " ("
+       << SimdLevelName(stats.simd) << ", " << stats.threads
+       << " workers), frames " << stats.frames << ", mean " << stats.mean_ms
+       << " ms, max " << stats.max_ms << " ms";
+    return os;
+}
+
+void DemosaicRows(const CameraFrame& frame, int begin, int end,
+                  DemosaicQuality quality, SimdLevel simd,
+                  uint8_t* destination, size_t destination_stride) {
+    RowKernel kernel = SelectKernel(quality, simd);
+    bool red_first = frame.pixel_format == PixelFormat::kBayerRG8;
+    for (int y = begin; y < end; ++y) {
+        RowArgs args;
+        args.up = frame.buffer + Mirror(y - 1, frame.height) * frame.stride;
+        args.row = frame.buffer + y * frame.stride;
+        args.down = frame.buffer + Mirror(y + 1, frame.height) * frame.stride;
+        args.out = destination + (y - begin) * destination_stride;
+        args.width = frame.width;
+        // Even rows hold the first colour of the pattern name.
+        args.green_parity = (y & 1) == 0 ? 1 : 0;
+        args.red_row = ((y & 1) == 0) == red_first;
+        kernel(args);
+    }
+}
+
+bool IsBayer(PixelFormat pixel_format) {
+    return pixel_format == PixelFormat::kBayerRG8 ||
+           pixel_format == PixelFormat::kBayerBG8;
+}
+
+Demosaicer::Demosaicer(const DemosaicOptions& options)
+        : options_(options), total_ms_(0.0) {
+    stats_.quality = options_.quality;
+    stats_.simd = options_.simd;
+}
+
+void Demosaicer::Configure(const DemosaicOptions& options) {
+    options_ = options;
+    workers_.Start(options_.threads);
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_ = DemosaicStats();
+    stats_.quality = options_.quality;
+    stats_.simd = options_.simd;
+    stats_.threads = workers_.Size();
+    total_ms_ = 0.0;
+}
+
+void Demosaicer::Process(const CameraFrame& frame, uint8_t* destination,
+                         size_t destination_stride) {
+    if (!IsBayer(frame.pixel_format)) {
+        throw std::runtime_error("ȥֻ֧Bayerʽ");
+    }
+    if (frame.width < 2 || frame.height < 2) {
+        throw std::runtime_error("ͼߴ̫С, ޷ȥ");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    int tile_rows = options_.tile_rows;
+    size_t tiles = (frame.height + tile_rows - 1) / tile_rows;
+    workers_.ParallelFor(tiles, [&](size_t tile) {
+        int begin = static_cast<int>(tile) * tile_rows;
+        int end = std::min(begin + tile_rows, frame.height);
+        DemosaicRows(frame, begin, end, options_.quality, options_.simd,
+                     destination + begin * destination_stride,
+                     destination_stride);
+    });
+
+    double elapsed_ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ++stats_.frames;
+    total_ms_ += elapsed_ms;
+    stats_.mean_ms = total_ms_ / stats_.frames;
+    stats_.max_ms = std::max(stats_.max_ms, elapsed_ms);
+}
+
+DemosaicStats Demosaicer::GetStats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
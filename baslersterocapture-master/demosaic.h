@@ -0,0 +1,93 @@
+#ifndef DEMOSAIC_H_
+#define DEMOSAIC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include "json.hpp"
+
+#include "camera_source.h"
+#include "simd.h"
+#include "worker_pool.h"
+
+enum class DemosaicQuality {
+    kBilinear,   // average of the nearest samples of each colour
+    kEdgeAware,  // green interpolated along the smoother direction
+};
+
+DemosaicQuality ParseDemosaicQuality(const std::string& name);
+std::string DemosaicQualityName(DemosaicQuality quality);
+
+struct DemosaicOptions {
+    // false leaves Bayer frames raw in StereoFrames; the recorder then
+    // converts them to YUV itself and the preview averages their cells.
+    bool enabled = true;
+    DemosaicQuality quality = DemosaicQuality::kBilinear;
+    // Workers shared by both cameras. 0 uses one per core.
+    size_t threads = 0;
+    // Rows per worker task.
+    int tile_rows = 64;
+    // Kernel instruction set; defaults to the best the CPU supports.
+    SimdLevel simd = DetectSimdLevel();
+};
+
+// Reads {"enabled": b, "quality": "bilinear"|"edge_aware", "threads": N,
+// "tile_rows": N, "simd": "auto"|"avx2"|"ssse3"|"scalar"}.
+DemosaicOptions ParseDemosaicOptions(
+        const nlohmann::json& config,
+        const DemosaicOptions& defaults = DemosaicOptions());
+
+struct DemosaicStats {
+    DemosaicQuality quality = DemosaicQuality::kBilinear;
+    SimdLevel simd = SimdLevel::kScalar;
+    size_t threads = 0;
+    uint64_t frames = 0;
+    double mean_ms = 0.0;
+    double max_ms = 0.0;
+};
+
+std::ostream& operator<<(std::ostream& os, const DemosaicStats& stats);
+
+bool IsBayer(PixelFormat pixel_format);
+
+// Demosaics rows [begin, end) of a Bayer `frame` into BGR8 rows starting at
+// `destination`, on the calling thread. For passes that consume the BGR
+// rows right away instead of storing a BGR frame.
+void DemosaicRows(const CameraFrame& frame, int begin, int end,
+                  DemosaicQuality quality, SimdLevel simd,
+                  uint8_t* destination, size_t destination_stride);
+
+// Converts BayerRG8/BayerBG8 frames to BGR8 on the host, so the cameras can
+// send a third of the data. Each frame is split into row tiles that run on
+// a worker pool. Safe to call from several threads.
+class Demosaicer {
+public:
+    explicit Demosaicer(const DemosaicOptions& options = DemosaicOptions());
+    ~Demosaicer() = default;
+
+    Demosaicer(const Demosaicer&) = delete;
+    Demosaicer& operator=(const Demosaicer&) = delete;
+
+public:
+    // Not while Process() runs.
+    void Configure(const DemosaicOptions& options);
+
+    // Writes `frame` as BGR8 rows of `destination_stride` bytes.
+    void Process(const CameraFrame& frame, uint8_t* destination,
+                 size_t destination_stride);
+
+    DemosaicStats GetStats() const;
+
+private:
+    DemosaicOptions options_;
+    WorkerPool workers_;
+
+    mutable std::mutex stats_mutex_;
+    DemosaicStats stats_;
+    double total_ms_;
+};
+
+#endif
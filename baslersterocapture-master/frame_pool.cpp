@@ -0,0 +1,210 @@
+#include "frame_pool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "aligned_buffer_pool.h"
+
+namespace {
+// Room for a shared_ptr control block holding a deleter and a SlotAllocator.
+const size_t kControlBlockSize = 128;
+}  // namespace
+
+struct FramePoolState {
+    struct Slot {
+        std::aligned_storage<kControlBlockSize>::type control_block;
+        uint8_t* buffer = nullptr;
+    };
+
+    AlignedBufferPool memory;
+    std::vector<Slot> slots;
+
+    std::mutex mutex;
+    std::condition_variable released;
+    std::vector<size_t> free_slots;
+    FramePoolStats stats;
+
+    void Release(size_t slot) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            free_slots.push_back(slot);
+            --stats.in_use;
+        }
+        released.notify_one();
+    }
+};
+
+namespace {
+// Places a handle's control block in its slot and returns the slot to the
+// pool once the control block is gone, which is after the last handle and
+// the last weak reference to it.
+template <typename T>
+struct SlotAllocator {
+    using value_type = T;
+
+    SlotAllocator(std::shared_ptr<FramePoolState> state, size_t slot)
+            : state(std::move(state)), slot(slot) {}
+    template <typename U>
+    SlotAllocator(const SlotAllocator<U>& other)
+            : state(other.state), slot(other.slot) {}
+
+    T* allocate(size_t n) {
+        static_assert(sizeof(T) <= kControlBlockSize,
+                      "control block does not fit its slot");
+        if (n != 1) {
+            throw std::bad_alloc();
+        }
+        return reinterpret_cast<T*>(&state->slots[slot].control_block);
+    }
+
+    void deallocate(T*, size_t) {
+        state->Release(slot);
+    }
+
+    std::shared_ptr<FramePoolState> state;
+    size_t slot;
+};
+
+template <typename T, typename U>
+bool operator==(const SlotAllocator<T>& a, const SlotAllocator<U>& b) {
+    return a.state == b.state && a.slot == b.slot;
+}
+
+template <typename T, typename U>
+bool operator!=(const SlotAllocator<T>& a, const SlotAllocator<U>& b) {
+    return !(a == b);
+}
+}  // namespace
+
+FramePoolOptions ParseFramePoolOptions(const nlohmann::json& config,
+                                       const FramePoolOptions& defaults) {
+    FramePoolOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    options.capacity = config.value("capacity", options.capacity);
+    options.alignment = config.value("alignment", options.alignment);
+    options.large_pages = config.value("large_pages", options.large_pages);
+    options.acquire_timeout_ms =
+            config.value("acquire_timeout_ms", options.acquire_timeout_ms);
+    if (options.capacity == 0) {
+        throw std::runtime_error("ͼ񻺳0");
+    }
+    if (options.alignment == 0 ||
+        (options.alignment & (options.alignment - 1)) != 0) {
+        throw std::runtime_error("2");
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const FramePoolStats& stats) {
+    os << "frames " << stats.capacity << " x " << stats.buffer_size
+       << " bytes" << (stats.large_pages ? " (large pages)" : "")
+       << ", in use " << stats.in_use << ", high water "
+       << stats.high_water_mark << ", starved " << stats.starved
+       << ", exhausted " << stats.exhausted;
+    return os;
+}
+
+FramePool::FramePool(const FramePoolOptions& options) : options_(options) {}
+
+void FramePool::Configure(const FramePoolOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    options_ = options;
+    state_.reset();
+}
+
+void FramePool::Reserve(size_t buffer_size) {
+    FramePoolOptions options;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        options = options_;
+    }
+
+    auto state = std::make_shared<FramePoolState>();
+    BufferPoolOptions memory_options;
+    memory_options.alignment = options.alignment;
+    memory_options.large_pages = options.large_pages;
+    state->memory.Reserve(buffer_size, options.capacity, memory_options);
+
+    state->slots.resize(options.capacity);
+    state->free_slots.reserve(options.capacity);
+    for (size_t i = 0; i < options.capacity; ++i) {
+        state->slots[i].buffer = state->memory.TryAcquire();
+        state->free_slots.push_back(options.capacity - 1 - i);
+    }
+
+    BufferPoolStats memory_stats = state->memory.GetStats();
+    state->stats.capacity = options.capacity;
+    state->stats.buffer_size = memory_stats.buffer_size;
+    state->stats.large_pages = memory_stats.large_pages;
+
+    // Handles to the old buffers keep the old state alive.
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = state;
+}
+
+size_t FramePool::BufferSize() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_ ? state_->stats.buffer_size : 0;
+}
+
+std::shared_ptr<uint8_t> FramePool::Acquire(
+        size_t size, std::chrono::milliseconds timeout) {
+    std::shared_ptr<FramePoolState> state;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        state = state_;
+    }
+    if (!state) {
+        return nullptr;
+    }
+
+    size_t slot;
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        if (size > state->stats.buffer_size) {
+            ++state->stats.exhausted;
+            return nullptr;
+        }
+        if (state->free_slots.empty()) {
+            ++state->stats.starved;
+            if (!state->released.wait_for(lock, timeout, [&state]() {
+                    return !state->free_slots.empty();
+                })) {
+                ++state->stats.exhausted;
+                return nullptr;
+            }
+        }
+        slot = state->free_slots.back();
+        state->free_slots.pop_back();
+        ++state->stats.in_use;
+        state->stats.high_water_mark =
+                std::max(state->stats.high_water_mark, state->stats.in_use);
+    }
+
+    // The deleter has nothing to do; the allocator returns the slot.
+    return std::shared_ptr<uint8_t>(state->slots[slot].buffer,
+                                    [](uint8_t*) {},
+                                    SlotAllocator<uint8_t>(state, slot));
+}
+
+FramePoolStats FramePool::GetStats() const {
+    std::shared_ptr<FramePoolState> state;
+    FramePoolStats stats;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        state = state_;
+        stats.capacity = options_.capacity;
+    }
+    if (!state) {
+        return stats;
+    }
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->stats;
+}
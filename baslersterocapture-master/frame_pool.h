@@ -0,0 +1,82 @@
+#ifndef FRAME_POOL_H_
+#define FRAME_POOL_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+
+#include "json.hpp"
+
+struct FramePoolOptions {
+    // Frames in flight between capture, recorder and preview.
+    size_t capacity = 24;
+    size_t alignment = 64;
+    bool large_pages = false;
+    // How long a consumer that needs a frame waits for one to be released.
+    unsigned int acquire_timeout_ms = 1000;
+};
+
+// Reads {"capacity": N, "alignment": N, "large_pages": b,
+// "acquire_timeout_ms": N}.
+FramePoolOptions ParseFramePoolOptions(
+        const nlohmann::json& config,
+        const FramePoolOptions& defaults = FramePoolOptions());
+
+struct FramePoolStats {
+    size_t capacity = 0;
+    size_t buffer_size = 0;
+    bool large_pages = false;
+    // Occupancy: frames currently held, and the most ever at once.
+    size_t in_use = 0;
+    size_t high_water_mark = 0;
+    // Acquire() calls that found no free frame, and those of them that gave
+    // up without one.
+    uint64_t starved = 0;
+    uint64_t exhausted = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, const FramePoolStats& stats);
+
+struct FramePoolState;
+
+// Fixed set of frame buffers handed out as reference-counted handles. A
+// buffer goes back to the pool when the last copy of its handle is
+// destroyed, whichever stage that is, and is never overwritten while
+// handles to it exist. Handles are std::shared_ptr whose control blocks
+// live in the pool too, so acquiring and releasing a frame does not touch
+// the heap. Thread-safe.
+class FramePool {
+public:
+    explicit FramePool(const FramePoolOptions& options = FramePoolOptions());
+    ~FramePool() = default;
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+public:
+    // Drops the buffers until the next Reserve(); handles to them stay
+    // valid until released.
+    void Configure(const FramePoolOptions& options);
+    // Allocates and pre-faults `capacity` buffers of `buffer_size` bytes.
+    // Handles to the previous buffers stay valid until released.
+    void Reserve(size_t buffer_size);
+
+    size_t BufferSize() const;
+
+    // Returns a buffer of at least `size` bytes, waiting up to `timeout` for
+    // one to be released, or nullptr.
+    std::shared_ptr<uint8_t> Acquire(size_t size,
+                                     std::chrono::milliseconds timeout);
+
+    FramePoolStats GetStats() const;
+
+private:
+    mutable std::mutex mutex_;
+    FramePoolOptions options_;
+    std::shared_ptr<FramePoolState> state_;
+};
+
+#endif
@@ -0,0 +1,280 @@
+#include "image_sequence_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <opencv2/opencv.hpp>
+#include <stdexcept>
+
+#include "utils.h"
+
+namespace {
+// Wraps BGR8 and Mono8 halves without a copy; imencode() only takes BGR or
+// grey images, so the other formats are converted.
+cv::Mat ToEncodableImage(const CameraFrame& half) {
+    int channels = static_cast<int>(BytesPerPixel(half.pixel_format));
+    cv::Mat image(half.height, half.width, CV_MAKETYPE(CV_8U, channels),
+                  half.buffer, half.stride);
+    cv::Mat converted;
+    switch (half.pixel_format) {
+        // OpenCV names Bayer patterns by the second row.
+        case PixelFormat::kBayerRG8:
+            cv::cvtColor(image, converted, cv::COLOR_BayerBG2BGR);
+            return converted;
+        case PixelFormat::kBayerBG8:
+            cv::cvtColor(image, converted, cv::COLOR_BayerRG2BGR);
+            return converted;
+        case PixelFormat::kYCbCr422_8:
+            cv::cvtColor(image, converted, cv::COLOR_YUV2BGR_YUYV);
+            return converted;
+        default:
+            return image;
+    }
+}
+
+void WriteFile(const std::string& path, const void* data, size_t size) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(static_cast<const char*>(data),
+               static_cast<std::streamsize>(size));
+    file.close();
+    if (!file) {
+        throw std::runtime_error("޷дļ: " + path);
+    }
+}
+}  // namespace
+
+ImageFileFormat ParseImageFileFormat(const std::string& name) {
+    if (name == "jpg") {
+        return ImageFileFormat::kJpeg;
+    }
+    if (name == "png") {
+        return ImageFileFormat::kPng;
+    }
+    if (name == "raw") {
+        return ImageFileFormat::kRaw;
+    }
+    throw std::runtime_error("δ֪ͼʽ: " + name);
+}
+
+std::string ImageFileFormatName(ImageFileFormat format) {
+    switch (format) {
+        case ImageFileFormat::kPng:
+            return "png";
+        case ImageFileFormat::kRaw:
+            return "raw";
+        default:
+            return "jpg";
+    }
+}
+
+std::string ImageFileExtension(ImageFileFormat format) {
+    return "." + ImageFileFormatName(format);
+}
+
+ImageSequenceOptions ParseImageSequenceOptions(
+        const nlohmann::json& config, const ImageSequenceOptions& defaults) {
+    ImageSequenceOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    options.enabled = config.value("enabled", options.enabled);
+    if (config.count("format")) {
+        options.format = ParseImageFileFormat(config["format"]);
+    }
+    options.jpeg_quality = config.value("jpeg_quality", options.jpeg_quality);
+    options.png_compression =
+            config.value("png_compression", options.png_compression);
+    options.threads = config.value("threads", options.threads);
+    options.queue_capacity =
+            config.value("queue_capacity", options.queue_capacity);
+    if (options.jpeg_quality < 0 || options.jpeg_quality > 100) {
+        throw std::runtime_error("JPEG0100֮");
+    }
+    if (options.png_compression < 0 || options.png_compression > 9) {
+        throw std::runtime_error("PNGѹ09֮");
+    }
+    if (options.queue_capacity == 0) {
+        throw std::runtime_error("ͼ0");
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const ImageSequenceStats& stats) {
+    os << ImageFileFormatName(stats.format) << ", " << stats.threads
+       << " threads, pairs " << stats.pairs << ", " << stats.bytes
+       << " bytes, mean " << stats.mean_ms << " ms, max " << stats.max_ms
+       << " ms, queue high water " << stats.queue_high_water_mark
+       << ", blocked " << stats.blocked;
+    return os;
+}
+
+ImageSequenceWriter::ImageSequenceWriter()
+        : closing_(false), total_ms_(0.0) {}
+
+ImageSequenceWriter::~ImageSequenceWriter() {
+    try {
+        Close();
+    } catch (...) {
+    }
+}
+
+void ImageSequenceWriter::Open(const std::string& directory,
+                               const ImageSequenceOptions& options) {
+    Close();
+    directory_ = directory;
+    options_ = options;
+    for (const char* sub : {"", "/left", "/right"}) {
+        if (!MakeDirectory(directory_ + sub)) {
+            throw std::runtime_error("޷Ŀ¼: " + directory_ + sub);
+        }
+    }
+
+    size_t threads = options_.threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.clear();
+        closing_ = false;
+        error_ = nullptr;
+        stats_ = ImageSequenceStats();
+        stats_.format = options_.format;
+        stats_.threads = threads;
+        total_ms_ = 0.0;
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back([this]() { Run(); });
+    }
+}
+
+void ImageSequenceWriter::Close() {
+    if (threads_.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    job_added_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error = error_;
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ImageSequenceWriter::Write(const StereoFrame& frame) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        if (jobs_.size() >= options_.queue_capacity) {
+            ++stats_.blocked;
+            job_taken_.wait(lock, [this]() {
+                return jobs_.size() < options_.queue_capacity;
+            });
+        }
+        jobs_.push_back(frame);
+        stats_.queue_high_water_mark =
+                std::max(stats_.queue_high_water_mark, jobs_.size());
+    }
+    job_added_.notify_one();
+}
+
+ImageSequenceStats ImageSequenceWriter::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void ImageSequenceWriter::Run() {
+    std::vector<unsigned char> buffer;
+    while (true) {
+        StereoFrame frame;
+        bool failed;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            job_added_.wait(lock,
+                            [this]() { return !jobs_.empty() || closing_; });
+            if (jobs_.empty()) {
+                return;
+            }
+            frame = std::move(jobs_.front());
+            jobs_.pop_front();
+            failed = error_ != nullptr;
+        }
+        job_taken_.notify_one();
+        // After an error the queue is still drained, so Write() does not
+        // block on it.
+        if (failed) {
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        try {
+            size_t bytes = WritePair(frame, buffer);
+            double elapsed_ms =
+                    std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++stats_.pairs;
+            stats_.bytes += bytes;
+            total_ms_ += elapsed_ms;
+            stats_.mean_ms = total_ms_ / stats_.pairs;
+            stats_.max_ms = std::max(stats_.max_ms, elapsed_ms);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+    }
+}
+
+size_t ImageSequenceWriter::WritePair(
+        const StereoFrame& frame, std::vector<unsigned char>& buffer) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%06llu",
+                  static_cast<unsigned long long>(frame.left.block_id));
+    std::string file_name = name + ImageFileExtension(options_.format);
+    return WriteHalf(frame.left, directory_ + "/left/" + file_name, buffer) +
+           WriteHalf(frame.right, directory_ + "/right/" + file_name, buffer);
+}
+
+size_t ImageSequenceWriter::WriteHalf(
+        const CameraFrame& half, const std::string& path,
+        std::vector<unsigned char>& buffer) const {
+    if (options_.format == ImageFileFormat::kRaw) {
+        size_t row_bytes = half.width * BytesPerPixel(half.pixel_format);
+        buffer.resize(row_bytes * half.height);
+        for (int y = 0; y < half.height; ++y) {
+            std::copy(half.buffer + y * half.stride,
+                      half.buffer + y * half.stride + row_bytes,
+                      buffer.begin() + y * row_bytes);
+        }
+    } else {
+        std::vector<int> params;
+        if (options_.format == ImageFileFormat::kJpeg) {
+            params = {cv::IMWRITE_JPEG_QUALITY, options_.jpeg_quality};
+        } else {
+            params = {cv::IMWRITE_PNG_COMPRESSION, options_.png_compression};
+        }
+        if (!cv::imencode(ImageFileExtension(options_.format),
+                          ToEncodableImage(half), buffer, params)) {
+            throw std::runtime_error("޷ͼ: " + path);
+        }
+    }
+    WriteFile(path, buffer.data(), buffer.size());
+    return buffer.size();
+}
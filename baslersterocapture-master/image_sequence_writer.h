@@ -0,0 +1,116 @@
+#ifndef IMAGE_SEQUENCE_WRITER_H_
+#define IMAGE_SEQUENCE_WRITER_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json.hpp"
+
+#include "stereo_frame.h"
+
+enum class ImageFileFormat {
+    kJpeg,
+    kPng,
+    // The half's pixels as they are, rows packed, in its own pixel format.
+    kRaw,
+};
+
+ImageFileFormat ParseImageFileFormat(const std::string& name);
+std::string ImageFileFormatName(ImageFileFormat format);
+// With the dot.
+std::string ImageFileExtension(ImageFileFormat format);
+
+struct ImageSequenceOptions {
+    // Records image sequences instead of a video file.
+    bool enabled = false;
+    ImageFileFormat format = ImageFileFormat::kJpeg;
+    int jpeg_quality = 95;
+    // 0-9; low levels trade file size for speed.
+    int png_compression = 1;
+    // Encoder threads; 0 uses one per core.
+    size_t threads = 0;
+    // Pairs waiting for an encoder. Write() blocks while it is full.
+    size_t queue_capacity = 32;
+};
+
+// Reads {"enabled": b, "format": "jpg"|"png"|"raw", "jpeg_quality": N,
+// "png_compression": N, "threads": N, "queue_capacity": N}.
+ImageSequenceOptions ParseImageSequenceOptions(
+        const nlohmann::json& config,
+        const ImageSequenceOptions& defaults = ImageSequenceOptions());
+
+struct ImageSequenceStats {
+    ImageFileFormat format = ImageFileFormat::kJpeg;
+    size_t threads = 0;
+    uint64_t pairs = 0;
+    uint64_t bytes = 0;
+    // Encode and write time per pair, on one encoder thread.
+    double mean_ms = 0.0;
+    double max_ms = 0.0;
+    size_t queue_high_water_mark = 0;
+    // Write() calls that waited for a free slot.
+    uint64_t blocked = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, const ImageSequenceStats& stats);
+
+// Writes every StereoFrame as two image files, <directory>/left/<id> and
+// <directory>/right/<id>, where <id> is the left camera's BlockID, zero
+// padded, for both halves so the two sequences stay aligned even when pairs
+// were matched by timestamp. Pairs wait in a bounded queue and are encoded
+// on a pool of threads, in any order.
+class ImageSequenceWriter {
+public:
+    ImageSequenceWriter();
+    ~ImageSequenceWriter();
+
+    ImageSequenceWriter(const ImageSequenceWriter&) = delete;
+    ImageSequenceWriter& operator=(const ImageSequenceWriter&) = delete;
+
+public:
+    // Creates the directories and starts the encoder threads. Throws on
+    // failure.
+    void Open(const std::string& directory,
+              const ImageSequenceOptions& options = ImageSequenceOptions());
+    // Writes the queued pairs. Rethrows the first error of an encoder
+    // thread.
+    void Close();
+
+    // The queued frame keeps its buffer alive until it is written. Rethrows
+    // the first error of an encoder thread.
+    void Write(const StereoFrame& frame);
+
+    ImageSequenceStats GetStats() const;
+
+private:
+    void Run();
+    // Returns the bytes written.
+    size_t WritePair(const StereoFrame& frame,
+                     std::vector<unsigned char>& buffer) const;
+    size_t WriteHalf(const CameraFrame& half, const std::string& path,
+                     std::vector<unsigned char>& buffer) const;
+
+private:
+    std::string directory_;
+    ImageSequenceOptions options_;
+    std::vector<std::thread> threads_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable job_added_;
+    std::condition_variable job_taken_;
+    std::deque<StereoFrame> jobs_;
+    bool closing_;
+    std::exception_ptr error_;
+    ImageSequenceStats stats_;
+    double total_ms_;
+};
+
+#endif
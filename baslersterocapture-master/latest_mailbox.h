@@ -0,0 +1,91 @@
+#ifndef LATEST_MAILBOX_H_
+#define LATEST_MAILBOX_H_
+
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+// Single slot that keeps only the newest value, for consumers that want the
+// latest state rather than every item. Post() never waits: a value nobody
+// took yet is replaced and counted as skipped.
+template <typename T>
+class LatestMailbox {
+public:
+    LatestMailbox();
+    ~LatestMailbox() = default;
+
+    LatestMailbox(const LatestMailbox&) = delete;
+    LatestMailbox& operator=(const LatestMailbox&) = delete;
+
+public:
+    void Post(T value);
+    // Returns false if nothing was posted since the last take.
+    bool TryTake(T& value);
+    // Drops the held value and zeroes the counters.
+    void Reset();
+
+    uint64_t Posted() const;
+    uint64_t Skipped() const;
+
+private:
+    mutable std::mutex mutex_;
+    T value_;
+    bool full_;
+    uint64_t posted_;
+    uint64_t skipped_;
+};
+
+template <typename T>
+LatestMailbox<T>::LatestMailbox() : full_(false), posted_(0), skipped_(0) {}
+
+template <typename T>
+void LatestMailbox<T>::Post(T value) {
+    // The replaced value is destroyed after the lock is released, as that
+    // may hand a buffer back to its pool.
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::swap(value_, value);
+    if (full_) {
+        ++skipped_;
+    }
+    full_ = true;
+    ++posted_;
+}
+
+template <typename T>
+bool LatestMailbox<T>::TryTake(T& value) {
+    T taken;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!full_) {
+            return false;
+        }
+        std::swap(taken, value_);
+        full_ = false;
+    }
+    value = std::move(taken);
+    return true;
+}
+
+template <typename T>
+void LatestMailbox<T>::Reset() {
+    T dropped;
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::swap(dropped, value_);
+    full_ = false;
+    posted_ = 0;
+    skipped_ = 0;
+}
+
+template <typename T>
+uint64_t LatestMailbox<T>::Posted() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return posted_;
+}
+
+template <typename T>
+uint64_t LatestMailbox<T>::Skipped() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return skipped_;
+}
+
+#endif
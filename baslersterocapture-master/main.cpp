@@ -16,68 +16,136 @@
 
 #include "json.hpp"
 
+#include "pair_matcher_test.h"
+#include "preview.h"
+#include "queue_benchmark.h"
 #include "rate.h"
 #include "stero_camera.h"
 #include "video_recorder.h"
+#include "yuv_benchmark.h"
 
 #include "utils.h"
 
 nlohmann::json GetVideoConfig(const std::string& config_file_name);
 
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-queue") {
+        RunQueueBenchmark();
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-yuv") {
+        RunYuvBenchmark();
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--test-pair-matcher") {
+        return RunPairMatcherTest() ? 0 : 1;
+    }
+
     Pylon::PylonInitialize();
 
     SteroCamera stero_camera;
 
-    cv::Mat left_image, right_image;
-    cv::Mat combine_image;
-
-    cv::namedWindow("Basler", cv::WINDOW_KEEPRATIO);
+    Previewer previewer;
 
     VideoRecorder video_recorder;
 
     std::string time_str = TimeStrLocal();
     std::replace(time_str.begin(), time_str.end(), ':', '-');
-    std::string file_name = "Basler" + time_str + ".avi";
-    std::cout << file_name << std::endl;
 
     try {
         stero_camera.Open("stero_config.json");
         stero_camera.Init("camera.pfs");
 
         auto video_cofig = GetVideoConfig("video_config.json");
+        auto encoder_options = ParseEncoderOptions(video_cofig["encoder"]);
+        auto image_options =
+                ParseImageSequenceOptions(video_cofig["image_sequence"]);
+        // Image sequences go to a directory of that name.
+        std::string file_name = "Basler" + time_str;
+        if (!image_options.enabled) {
+            file_name += encoder_options.container.empty()
+                                 ? std::string(".avi")
+                                 : ContainerExtension(
+                                           encoder_options.container);
+        }
+        std::cout << file_name << std::endl;
         video_recorder.Open(file_name, 3840, 1080, stero_camera.GetFrameRate(),
-                            video_cofig["bit_rate"]);
+                            video_cofig["bit_rate"],
+                            stero_camera.GetSyncMode(),
+                            stero_camera.GetTimestampTickNs(),
+                            ParseQueueOptions(video_cofig["image_queue"]),
+                            ParseYuvConverterOptions(
+                                    video_cofig["yuv_converter"]),
+                            encoder_options,
+                            ParseMuxerOptions(video_cofig["muxer"]),
+                            image_options,
+                            ParseSidecarOptions(video_cofig["metadata"]));
+
+        previewer.Start("Basler",
+                        ParsePreviewOptions(video_cofig["preview"]));
 
         stero_camera.OnException([&]() { video_recorder.Close(); });
         stero_camera.StartGrab();
 
         while (true) {
-            auto grab_results = stero_camera.Grab();
-
-            auto& left_result = grab_results.first;
-            auto& right_result = grab_results.second;
-
-            left_image =
-                    cv::Mat(left_result->GetHeight(), left_result->GetWidth(),
-                            CV_8UC3, left_result->GetBuffer());
-            right_image =
-                    cv::Mat(right_result->GetHeight(), right_result->GetWidth(),
-                            CV_8UC3, right_result->GetBuffer());
-
-            cv::hconcat(left_image, right_image, combine_image);
-
-            video_recorder.Write(combine_image);
-
-            cv::imshow("Basler", combine_image);
-            cv::resizeWindow("Basler", cv::Size(1280, 360));
+            auto stereo_frame = stero_camera.Grab();
 
-            auto c = cv::waitKey(1);
+            video_recorder.Write(stereo_frame);
+            previewer.Post(stereo_frame);
 
-            if (c == 27 || c == 'q' || c == 'Q') {
+            if (previewer.QuitRequested()) {
                 stero_camera.StopGrab();
                 std::cout << "ֹͣɼͼ" << std::endl;
+                previewer.Stop();
                 video_recorder.Close();
+                std::cout << ": " << stero_camera.GetRateStats()
+                          << std::endl;
+                std::cout << "ˮ: "
+                          << stero_camera.GetPipelineStats() << std::endl;
+                std::cout << "Ŀͼ񻺳: "
+                          << stero_camera.GetLeftBufferStats() << std::endl;
+                std::cout << "Ŀͼ񻺳: "
+                          << stero_camera.GetRightBufferStats() << std::endl;
+                std::cout << "Ŀɼ: "
+                          << stero_camera.GetLeftQueueStats() << std::endl;
+                std::cout << "Ŀɼ: "
+                          << stero_camera.GetRightQueueStats() << std::endl;
+                std::cout << "ͼ: "
+                          << stero_camera.GetPairMatcherStats() << std::endl;
+                std::cout << "˫Ŀƴ: "
+                          << stero_camera.GetStereoFrameStats() << std::endl;
+                std::cout << "ȥ: " << stero_camera.GetDemosaicStats()
+                          << std::endl;
+                std::cout << "ͬ: "
+                          << stero_camera.GetParameterSyncStats() << std::endl;
+                std::cout << "¼: " << video_recorder.GetQueueStats()
+                          << std::endl;
+                if (image_options.enabled) {
+                    std::cout << "ͼ: "
+                              << video_recorder.GetImageSequenceStats()
+                              << std::endl;
+                } else {
+                    std::cout << "ʽת: "
+                              << video_recorder.GetConverterStats()
+                              << std::endl;
+                    if (encoder_options.tracks == 2) {
+                        std::cout << "ĿƵ: "
+                                  << video_recorder.GetEncoderStats(0)
+                                  << std::endl;
+                        std::cout << "ĿƵ: "
+                                  << video_recorder.GetEncoderStats(1)
+                                  << std::endl;
+                    } else {
+                        std::cout << "Ƶ: "
+                                  << video_recorder.GetEncoderStats()
+                                  << std::endl;
+                    }
+                    std::cout << "װд: "
+                              << video_recorder.GetMuxerStats() << std::endl;
+                }
+                std::cout << "Ԫ: " << video_recorder.GetSidecarStats()
+                          << std::endl;
+                std::cout << "Ԥ: " << previewer.GetStats() << std::endl;
                 break;
             }
         }
@@ -87,12 +155,14 @@ int main() {
     } catch (const Pylon::GenericException& e) {
         std::cerr << "쳣: " << std::endl;
         std::cerr << e.GetDescription() << std::endl;
+        previewer.Stop();
         video_recorder.Close();
         std::cin.get();
         exit(-1);
     } catch (const std::runtime_error& e) {
         std::cerr << "쳣: " << std::endl;
         std::cerr << e.what() << std::endl;
+        previewer.Stop();
         video_recorder.Close();
         std::cin.get();
         exit(-1);
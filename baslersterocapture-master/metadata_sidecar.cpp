@@ -0,0 +1,200 @@
+#include "metadata_sidecar.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+const char kMagic[8] = {'B', 'S', 'C', 'M', 'E', 'T', 'A', '\0'};
+const uint32_t kVersion = 1;
+}  // namespace
+
+SidecarOptions ParseSidecarOptions(const nlohmann::json& config,
+                                   const SidecarOptions& defaults) {
+    SidecarOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    options.enabled = config.value("enabled", options.enabled);
+    options.max_pending = config.value("max_pending", options.max_pending);
+    if (options.max_pending == 0) {
+        throw std::runtime_error("Ԫݻ0");
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const SidecarStats& stats) {
+    os << "records " << stats.records << ", incomplete " << stats.incomplete
+       << ", overflows " << stats.overflows << ", pending high water "
+       << stats.pending_high_water_mark;
+    return os;
+}
+
+MetadataSidecar::MetadataSidecar()
+        : tracks_(0), added_(0), appended_(0), last_pts_(0) {}
+
+MetadataSidecar::~MetadataSidecar() {
+    try {
+        Close();
+    } catch (...) {
+    }
+}
+
+void MetadataSidecar::Open(const std::string& path, uint32_t tracks,
+                           double fps, int32_t time_base_num,
+                           int32_t time_base_den,
+                           const SidecarOptions& options) {
+    Close();
+    if (tracks > 2) {
+        throw std::runtime_error("Ԫ¼Ƶ");
+    }
+    path_ = path;
+    tracks_ = tracks;
+    ring_.assign(options.max_pending, Slot());
+
+    file_.open(path_, std::ios::binary | std::ios::trunc);
+    if (!file_) {
+        throw std::runtime_error("޷Ԫļ: " + path_);
+    }
+    SidecarHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.header_size = sizeof(SidecarHeader);
+    header.record_size = sizeof(FrameRecord);
+    header.tracks = tracks_;
+    header.fps = fps;
+    header.time_base_num = time_base_num;
+    header.time_base_den = time_base_den;
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file_.flush();
+    if (!file_) {
+        throw std::runtime_error("޷дԪļ: " + path_);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    added_ = 0;
+    appended_ = 0;
+    last_pts_ = 0;
+    stats_ = SidecarStats();
+}
+
+void MetadataSidecar::Close() {
+    if (!file_.is_open()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (; appended_ < added_; ++appended_) {
+            const Slot& slot = ring_[appended_ % ring_.size()];
+            if (slot.tracks_done < tracks_) {
+                ++stats_.incomplete;
+            }
+            Append(slot);
+        }
+    }
+    file_.close();
+    if (!file_) {
+        throw std::runtime_error("޷дԪļ: " + path_);
+    }
+}
+
+void MetadataSidecar::Add(const StereoFrame& frame, int64_t pts) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (added_ - appended_ >= ring_.size()) {
+        // Losing the offsets of one pair beats stalling the recording.
+        Append(ring_[appended_++ % ring_.size()]);
+        ++stats_.overflows;
+    }
+    // The packets carry the pts the encoders adjusted.
+    if (added_ > 0 && pts <= last_pts_) {
+        pts = last_pts_ + 1;
+    }
+    last_pts_ = pts;
+    Slot& slot = ring_[added_ % ring_.size()];
+    FrameRecord& record = slot.record;
+    record.block_id[0] = frame.left.block_id;
+    record.block_id[1] = frame.right.block_id;
+    record.timestamp[0] = frame.left.timestamp;
+    record.timestamp[1] = frame.right.timestamp;
+    record.trigger_time = frame.left.trigger_time;
+    record.pts = pts;
+    record.parameter_epoch = frame.left.parameter_epoch;
+    const CameraParameters& parameters = frame.left.parameters;
+    record.exposure_time = parameters.exposure_time;
+    record.gain = parameters.gain;
+    record.balance_red = parameters.balance_red;
+    record.balance_green = parameters.balance_green;
+    record.balance_blue = parameters.balance_blue;
+    for (size_t i = 0; i < 2; ++i) {
+        record.offset[i] = -1;
+        record.size[i] = 0;
+    }
+    slot.tracks_done = 0;
+    ++added_;
+    stats_.pending_high_water_mark =
+            std::max(stats_.pending_high_water_mark,
+                     static_cast<size_t>(added_ - appended_));
+    // Image sequences have no packets to wait for.
+    AppendComplete();
+}
+
+void MetadataSidecar::OnPacket(size_t track, int64_t pts, int64_t offset,
+                               int64_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Packets of pairs never added, or already written for a full ring,
+    // cannot be placed; the video is still fine, so they are not an error.
+    Slot* slot = track < tracks_ ? FindPending(pts) : nullptr;
+    if (slot == nullptr || slot->record.offset[track] >= 0) {
+        return;
+    }
+    slot->record.offset[track] = offset;
+    slot->record.size[track] = size;
+    ++slot->tracks_done;
+    AppendComplete();
+}
+
+SidecarStats MetadataSidecar::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+MetadataSidecar::Slot* MetadataSidecar::FindPending(int64_t pts) {
+    // Pending pts rise with the pair number; binary search over them.
+    uint64_t first = appended_;
+    uint64_t last = added_;
+    while (first < last) {
+        uint64_t middle = first + (last - first) / 2;
+        if (ring_[middle % ring_.size()].record.pts < pts) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    if (first == added_) {
+        return nullptr;
+    }
+    Slot& slot = ring_[first % ring_.size()];
+    return slot.record.pts == pts ? &slot : nullptr;
+}
+
+void MetadataSidecar::AppendComplete() {
+    uint64_t first = appended_;
+    for (; appended_ < added_; ++appended_) {
+        const Slot& slot = ring_[appended_ % ring_.size()];
+        if (slot.tracks_done < tracks_) {
+            break;
+        }
+        Append(slot);
+    }
+    // Readers mapping the file see a record as soon as it is complete.
+    if (appended_ != first) {
+        file_.flush();
+    }
+}
+
+void MetadataSidecar::Append(const Slot& slot) {
+    file_.write(reinterpret_cast<const char*>(&slot.record),
+                sizeof(FrameRecord));
+    ++stats_.records;
+}
@@ -0,0 +1,138 @@
+#ifndef METADATA_SIDECAR_H_
+#define METADATA_SIDECAR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#include "stereo_frame.h"
+
+// The sidecar is a SidecarHeader followed by one FrameRecord per pair, in
+// the order the pairs were recorded, all little endian. Record i starts at
+// header_size + i * record_size, so readers can map the file and index it
+// directly; the record count follows from the file size.
+struct SidecarHeader {
+    char magic[8];  // "BSCMETA" and a zero
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    // Video tracks with an offset and size in the records; 0 for image
+    // sequences.
+    uint32_t tracks;
+    double fps;
+    // Of FrameRecord::pts.
+    int32_t time_base_num;
+    int32_t time_base_den;
+    uint8_t reserved[24];
+};
+
+struct FrameRecord {
+    // Left, then right.
+    uint64_t block_id[2];
+    // Camera timestamp ticks.
+    uint64_t timestamp[2];
+    // Host steady_clock time of the trigger, in ns. 0 in free-run.
+    int64_t trigger_time;
+    // The frame's pts in the video, or for image sequences the one it would
+    // have had.
+    int64_t pts;
+    uint64_t parameter_epoch;
+    double exposure_time;  // us
+    double gain;           // dB
+    double balance_red;
+    double balance_green;
+    double balance_blue;
+    // Bytes the muxer wrote for the frame in each track, from this offset
+    // of the video file; -1 if it never reached the file.
+    int64_t offset[2];
+    int64_t size[2];
+};
+
+static_assert(sizeof(SidecarHeader) == 64, "sidecar header layout");
+static_assert(sizeof(FrameRecord) == 128, "sidecar record layout");
+
+struct SidecarOptions {
+    bool enabled = true;
+    // Pairs added whose packets are not written yet. Should cover what the
+    // encoders and the packet queue hold; when it is full, Add() writes the
+    // oldest record without the offsets still missing.
+    size_t max_pending = 1024;
+};
+
+// Reads {"enabled": b, "max_pending": N}.
+SidecarOptions ParseSidecarOptions(
+        const nlohmann::json& config,
+        const SidecarOptions& defaults = SidecarOptions());
+
+struct SidecarStats {
+    uint64_t records = 0;
+    // Records closed without the offsets of every track.
+    uint64_t incomplete = 0;
+    // Records written early, without all offsets, for a full ring.
+    uint64_t overflows = 0;
+    size_t pending_high_water_mark = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, const SidecarStats& stats);
+
+// Writes the per-pair metadata of a recording. The recording thread adds a
+// record per pair, the muxer's I/O thread fills in where each track's
+// packet landed, and records are appended once complete. Records wait in a
+// ring allocated by Open(), so nothing is allocated per frame.
+class MetadataSidecar {
+public:
+    MetadataSidecar();
+    ~MetadataSidecar();
+
+    MetadataSidecar(const MetadataSidecar&) = delete;
+    MetadataSidecar& operator=(const MetadataSidecar&) = delete;
+
+public:
+    // Creates `path` and writes the header. Throws on failure.
+    void Open(const std::string& path, uint32_t tracks, double fps,
+              int32_t time_base_num, int32_t time_base_den,
+              const SidecarOptions& options = SidecarOptions());
+    // Appends the pending records, with -1 for offsets never reported.
+    void Close();
+
+    // Recording thread, before the pair goes to the encoders. A pts not
+    // above the previous one is raised to it plus one, as the encoders do.
+    void Add(const StereoFrame& frame, int64_t pts);
+    // Muxer thread. Packets are matched to pairs by pts, so they may come
+    // in decode order.
+    void OnPacket(size_t track, int64_t pts, int64_t offset, int64_t size);
+
+    SidecarStats GetStats() const;
+
+private:
+    struct Slot {
+        FrameRecord record = {};
+        uint32_t tracks_done = 0;
+    };
+
+    // Called with mutex_ held.
+    Slot* FindPending(int64_t pts);
+    void AppendComplete();
+    void Append(const Slot& slot);
+
+private:
+    std::ofstream file_;
+    std::string path_;
+    uint32_t tracks_;
+    std::vector<Slot> ring_;
+
+    mutable std::mutex mutex_;
+    // Pair numbers: next to add and next to append.
+    uint64_t added_;
+    uint64_t appended_;
+    int64_t last_pts_;
+    SidecarStats stats_;
+};
+
+#endif
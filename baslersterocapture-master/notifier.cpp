@@ -0,0 +1,14 @@
+#include "notifier.h"
+
+Notifier::Notifier() : waiters_(0) {}
+
+void Notifier::Notify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load() == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+    }
+    condition_variable_.notify_all();
+}
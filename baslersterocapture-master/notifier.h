@@ -0,0 +1,60 @@
+#ifndef NOTIFIER_H_
+#define NOTIFIER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+// Wake-up primitive for lock-free queues. Notify() only touches the mutex
+// when a consumer is actually parked in Wait(), so producers stay lock-free
+// on the common path.
+class Notifier {
+public:
+    Notifier();
+    ~Notifier() = default;
+
+    Notifier(const Notifier&) = delete;
+    Notifier& operator=(const Notifier&) = delete;
+
+public:
+    void Notify();
+
+    template <typename Predicate>
+    void Wait(Predicate predicate);
+
+    template <typename Predicate>
+    bool WaitFor(std::chrono::nanoseconds timeout, Predicate predicate);
+
+private:
+    std::atomic_int waiters_;
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+};
+
+template <typename Predicate>
+void Notifier::Wait(Predicate predicate) {
+    if (predicate()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiters_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    condition_variable_.wait(lock, predicate);
+    waiters_.fetch_sub(1);
+}
+
+template <typename Predicate>
+bool Notifier::WaitFor(std::chrono::nanoseconds timeout, Predicate predicate) {
+    if (predicate()) {
+        return true;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiters_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool result = condition_variable_.wait_for(lock, timeout, predicate);
+    waiters_.fetch_sub(1);
+    return result;
+}
+
+#endif
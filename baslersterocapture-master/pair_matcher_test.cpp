@@ -0,0 +1,153 @@
+#include "pair_matcher_test.h"
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "stereo_pair_matcher.h"
+
+namespace {
+const int kExposures = 40;
+const int64_t kFramePeriodNs = 66666667;
+// Right camera clock minus left camera clock.
+const int64_t kClockOffsetNs = 5000000000;
+
+// One exposure as a camera reports it. `exposure` is what the pairs are
+// checked against; the matcher only sees BlockID and timestamp.
+struct SyntheticFrame {
+    int exposure = 0;
+    uint64_t block_id = 0;
+    uint64_t timestamp = 0;
+};
+
+using Stream = std::vector<SyntheticFrame>;
+
+// Every exposure, with the exposure index as BlockID.
+Stream MakeStream(int64_t clock_offset_ns) {
+    Stream stream;
+    for (int exposure = 0; exposure < kExposures; ++exposure) {
+        SyntheticFrame frame;
+        frame.exposure = exposure;
+        frame.block_id = exposure;
+        frame.timestamp = clock_offset_ns + exposure * kFramePeriodNs;
+        stream.push_back(frame);
+    }
+    return stream;
+}
+
+// Drops `exposure`. With `renumber` the later BlockIDs close up, as when the
+// camera ignored the trigger; otherwise they leave a gap, as when the frame
+// was lost in transfer.
+void Remove(Stream& stream, int exposure, bool renumber) {
+    for (auto it = stream.begin(); it != stream.end(); ++it) {
+        if (it->exposure != exposure) {
+            continue;
+        }
+        it = stream.erase(it);
+        for (; renumber && it != stream.end(); ++it) {
+            --it->block_id;
+        }
+        return;
+    }
+}
+
+struct Expected {
+    uint64_t pairs = 0;
+    uint64_t left_orphans = 0;
+    uint64_t right_orphans = 0;
+};
+
+bool RunCase(const std::string& name, const PairMatcherOptions& options,
+             const Stream& left, const Stream& right,
+             const Expected& expected) {
+    StereoPairMatcher<int> matcher(options);
+    uint64_t wrong = 0;
+    size_t l = 0;
+    size_t r = 0;
+    while (l < left.size() || r < right.size()) {
+        // In exposure order, as the grab threads deliver them.
+        if (r == right.size() ||
+            (l < left.size() && left[l].exposure <= right[r].exposure)) {
+            matcher.AddLeft(left[l].block_id, left[l].timestamp,
+                            left[l].exposure);
+            ++l;
+        } else {
+            matcher.AddRight(right[r].block_id, right[r].timestamp,
+                             right[r].exposure);
+            ++r;
+        }
+        int left_exposure = 0;
+        int right_exposure = 0;
+        while (matcher.PopPair(left_exposure, right_exposure)) {
+            if (left_exposure != right_exposure) {
+                ++wrong;
+            }
+        }
+    }
+
+    PairMatcherStats stats = matcher.GetStats();
+    bool passed = wrong == 0 && stats.pairs == expected.pairs &&
+                  stats.left_orphans == expected.left_orphans &&
+                  stats.right_orphans == expected.right_orphans;
+    std::cout << std::setw(20) << name
+              << (passed ? " | ok     | " : " | FAILED | ") << stats
+              << ", wrong pairs " << wrong << std::endl;
+    return passed;
+}
+}  // namespace
+
+bool RunPairMatcherTest() {
+    bool passed = true;
+
+    PairMatcherOptions by_block_id;
+    by_block_id.mode = PairMatchMode::kBlockId;
+
+    // The right frame of exposure 5 never arrives.
+    Stream left = MakeStream(0);
+    Stream right = MakeStream(0);
+    Remove(right, 5, false);
+    Expected expected;
+    expected.pairs = kExposures - 1;
+    expected.left_orphans = 1;
+    passed &= RunCase("missing partner", by_block_id, left, right, expected);
+
+    // The left camera loses exposures 10 to 12; its BlockIDs jump by 4.
+    left = MakeStream(0);
+    right = MakeStream(0);
+    for (int exposure = 10; exposure <= 12; ++exposure) {
+        Remove(left, exposure, false);
+    }
+    expected = Expected();
+    expected.pairs = kExposures - 3;
+    expected.right_orphans = 3;
+    passed &= RunCase("block id gap", by_block_id, left, right, expected);
+
+    // The right camera ignores trigger 7, so BlockIDs no longer line up, its
+    // clock is offset and both jitter within the tolerance. Exposure 20 of
+    // the right camera is stamped 5 ms late, beyond it.
+    PairMatcherOptions by_timestamp;
+    by_timestamp.mode = PairMatchMode::kTimestamp;
+    by_timestamp.timestamp_tolerance = 1000000;
+    left = MakeStream(0);
+    right = MakeStream(kClockOffsetNs);
+    for (auto& frame : left) {
+        frame.timestamp += (frame.exposure % 5) * 100000;
+    }
+    for (auto& frame : right) {
+        frame.timestamp -= (frame.exposure % 3) * 150000;
+        if (frame.exposure == 20) {
+            frame.timestamp += 5000000;
+        }
+    }
+    Remove(right, 7, true);
+    expected = Expected();
+    expected.pairs = kExposures - 2;
+    expected.left_orphans = 2;
+    expected.right_orphans = 1;
+    passed &= RunCase("timestamp tolerance", by_timestamp, left, right,
+                      expected);
+
+    return passed;
+}
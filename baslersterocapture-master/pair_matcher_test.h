@@ -0,0 +1,10 @@
+#ifndef PAIR_MATCHER_TEST_H_
+#define PAIR_MATCHER_TEST_H_
+
+// Feeds StereoPairMatcher synthetic left and right streams with a missing
+// partner, a BlockID gap and jittered timestamps, and checks each pair it
+// returns against the exposure both frames came from. No camera is needed.
+// Returns false if any case failed.
+bool RunPairMatcherTest();
+
+#endif
@@ -0,0 +1,156 @@
+#include "parameter_sync.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+ParameterSyncOptions ParseParameterSyncOptions(
+        const nlohmann::json& config, const ParameterSyncOptions& defaults) {
+    ParameterSyncOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    options.rate = config.value("rate", options.rate);
+    options.gain_threshold =
+            config.value("gain_threshold", options.gain_threshold);
+    options.exposure_time_threshold = config.value(
+            "exposure_time_threshold", options.exposure_time_threshold);
+    options.balance_ratio_threshold = config.value(
+            "balance_ratio_threshold", options.balance_ratio_threshold);
+    if (options.rate <= 0.0) {
+        throw std::runtime_error("ͬƵʱ0");
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const ParameterSyncStats& stats) {
+    os << "reads " << stats.reads << ", writes " << stats.writes
+       << ", epoch " << stats.epoch << ", gain " << stats.parameters.gain
+       << ", exposure " << stats.parameters.exposure_time << ", balance "
+       << stats.parameters.balance_red << "/" << stats.parameters.balance_green
+       << "/" << stats.parameters.balance_blue;
+    return os;
+}
+
+ParameterSync::ParameterSync()
+        : master_(nullptr), slave_(nullptr), stop_flag_(false), epoch_(0) {}
+
+ParameterSync::~ParameterSync() {
+    Stop();
+}
+
+void ParameterSync::Configure(const ParameterSyncOptions& options) {
+    if (thread_.joinable()) {
+        throw std::runtime_error("ͬ޷޸");
+    }
+    options_ = options;
+}
+
+void ParameterSync::Start(CameraSource* master, CameraSource* slave) {
+    if (thread_.joinable()) {
+        return;
+    }
+    master_ = master;
+    slave_ = slave;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.reads = 0;
+        stats_.writes = 0;
+    }
+    // Write once whatever the slave held before.
+    SyncOnce(true);
+
+    stop_flag_ = false;
+    thread_ = std::thread([this]() {
+        auto period = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::duration<double>(1.0 / options_.rate));
+        auto next = std::chrono::steady_clock::now() + period;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!condition_variable_.wait_until(
+                lock, next, [this]() { return stop_flag_; })) {
+            lock.unlock();
+            try {
+                SyncOnce(false);
+            } catch (const std::exception& e) {
+                // A missed sync only delays the slave; keep trying.
+                std::cerr << "ͬʧ: " << e.what() << std::endl;
+            }
+            lock.lock();
+            next += period;
+        }
+    });
+}
+
+void ParameterSync::Stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_flag_ = true;
+    }
+    condition_variable_.notify_all();
+    thread_.join();
+}
+
+uint64_t ParameterSync::Epoch() const {
+    return epoch_.load(std::memory_order_acquire);
+}
+
+bool ParameterSync::GetEpochParameters(uint64_t epoch,
+                                       CameraParameters& parameters) const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    const EpochParameters& entry = history_[epoch % kEpochHistory];
+    if (epoch == 0 || entry.epoch != epoch) {
+        return false;
+    }
+    parameters = entry.parameters;
+    return true;
+}
+
+ParameterSyncStats ParameterSync::GetStats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ParameterSyncStats stats = stats_;
+    stats.epoch = Epoch();
+    return stats;
+}
+
+void ParameterSync::SyncOnce(bool force) {
+    CameraParameters parameters = master_->GetParameters();
+    bool changed = force || Changed(parameters);
+    if (changed) {
+        slave_->SetParameters(parameters);
+        // Recorded before the epoch is published, so a frame that carries
+        // it can look it up. Only this thread starts epochs.
+        uint64_t epoch = Epoch() + 1;
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            EpochParameters& entry = history_[epoch % kEpochHistory];
+            entry.epoch = epoch;
+            entry.parameters = parameters;
+        }
+        epoch_.store(epoch, std::memory_order_release);
+    }
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ++stats_.reads;
+    if (changed) {
+        ++stats_.writes;
+        stats_.parameters = parameters;
+    }
+}
+
+bool ParameterSync::Changed(const CameraParameters& parameters) const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    const CameraParameters& last = stats_.parameters;
+    return std::abs(parameters.gain - last.gain) > options_.gain_threshold ||
+           std::abs(parameters.exposure_time - last.exposure_time) >
+                   options_.exposure_time_threshold ||
+           std::abs(parameters.balance_red - last.balance_red) >
+                   options_.balance_ratio_threshold ||
+           std::abs(parameters.balance_green - last.balance_green) >
+                   options_.balance_ratio_threshold ||
+           std::abs(parameters.balance_blue - last.balance_blue) >
+                   options_.balance_ratio_threshold;
+}
@@ -0,0 +1,98 @@
+#ifndef PARAMETER_SYNC_H_
+#define PARAMETER_SYNC_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+#include "json.hpp"
+
+#include "camera_source.h"
+
+struct ParameterSyncOptions {
+    // Master reads per second. Auto functions settle over many frames, so a
+    // few Hz is enough.
+    double rate = 4.0;
+    // The slave is only written when a value moved further than this from
+    // what it was last given.
+    double gain_threshold = 0.05;           // dB
+    double exposure_time_threshold = 20.0;  // us
+    double balance_ratio_threshold = 0.005;
+};
+
+// Reads {"rate": Hz, "gain_threshold": dB, "exposure_time_threshold": us,
+// "balance_ratio_threshold": r}.
+ParameterSyncOptions ParseParameterSyncOptions(
+        const nlohmann::json& config,
+        const ParameterSyncOptions& defaults = ParameterSyncOptions());
+
+struct ParameterSyncStats {
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t epoch = 0;
+    CameraParameters parameters;
+};
+
+std::ostream& operator<<(std::ostream& os, const ParameterSyncStats& stats);
+
+// Copies the master's auto gain, exposure and white balance to the slave on
+// its own low-rate thread, so the trigger loop never touches GenICam nodes.
+// Every write to the slave starts a new epoch; frames triggered after a
+// write completed carry its epoch.
+class ParameterSync {
+public:
+    ParameterSync();
+    ~ParameterSync();
+
+    ParameterSync(const ParameterSync&) = delete;
+    ParameterSync& operator=(const ParameterSync&) = delete;
+
+public:
+    void Configure(const ParameterSyncOptions& options);
+
+    // Syncs once before returning, so the first frames already match.
+    void Start(CameraSource* master, CameraSource* slave);
+    void Stop();
+
+    uint64_t Epoch() const;
+    // What was written to the slave in `epoch`, for the last kEpochHistory
+    // epochs. Returns false for older or unknown epochs.
+    bool GetEpochParameters(uint64_t epoch,
+                            CameraParameters& parameters) const;
+    ParameterSyncStats GetStats() const;
+
+private:
+    // Enough for the frames still in flight at a few syncs per second.
+    static const size_t kEpochHistory = 16;
+
+    struct EpochParameters {
+        uint64_t epoch = 0;
+        CameraParameters parameters;
+    };
+
+    void SyncOnce(bool force);
+    bool Changed(const CameraParameters& parameters) const;
+
+private:
+    ParameterSyncOptions options_;
+
+    CameraSource* master_;
+    CameraSource* slave_;
+
+    std::thread thread_;
+    bool stop_flag_;
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+
+    std::atomic<uint64_t> epoch_;
+    mutable std::mutex stats_mutex_;
+    ParameterSyncStats stats_;
+    // Indexed by epoch % kEpochHistory.
+    EpochParameters history_[kEpochHistory];
+};
+
+#endif
@@ -0,0 +1,28 @@
+#include "periodic_thread.h"
+
+PeriodicThread::PeriodicThread() : stop_flag_(false) {}
+
+PeriodicThread::~PeriodicThread() {
+    Stop();
+}
+
+void PeriodicThread::Start(double frequency, std::function<void(void)> tick) {
+    Stop();
+    rate_.SetRate(frequency);
+    stop_flag_ = false;
+    thread_ = std::thread([this, tick]() {
+        rate_.Init();
+        while (!stop_flag_) {
+            tick();
+            rate_.Sleep();
+        }
+    });
+}
+
+void PeriodicThread::Stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    stop_flag_ = true;
+    thread_.join();
+}
@@ -0,0 +1,30 @@
+#ifndef PERIODIC_THREAD_H_
+#define PERIODIC_THREAD_H_
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "rate.h"
+
+// Calls `tick` on its own thread at a fixed rate until stopped. Used by the
+// simulated cameras to run in free-run like a real master camera.
+class PeriodicThread {
+public:
+    PeriodicThread();
+    ~PeriodicThread();
+
+    PeriodicThread(const PeriodicThread&) = delete;
+    PeriodicThread& operator=(const PeriodicThread&) = delete;
+
+public:
+    void Start(double frequency, std::function<void(void)> tick);
+    void Stop();
+
+private:
+    Rate rate_;
+    std::thread thread_;
+    std::atomic_bool stop_flag_;
+};
+
+#endif
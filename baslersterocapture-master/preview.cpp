@@ -0,0 +1,147 @@
+#include "preview.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+PreviewOptions ParsePreviewOptions(const nlohmann::json& config,
+                                   const PreviewOptions& defaults) {
+    PreviewOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    options.fps = config.value("fps", options.fps);
+    options.window_width = config.value("window_width", options.window_width);
+    options.window_height =
+            config.value("window_height", options.window_height);
+    if (config.count("renderer")) {
+        options.renderer = ParsePreviewRendererOptions(config["renderer"],
+                                                       options.renderer);
+    }
+    if (options.fps <= 0.0) {
+        throw std::runtime_error("Ԥ֡ʱ0");
+    }
+    if (options.window_width <= 0 || options.window_height <= 0) {
+        throw std::runtime_error("Ԥڳߴ0");
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const PreviewStats& stats) {
+    os << "posted " << stats.posted << ", shown " << stats.shown
+       << ", skipped " << stats.skipped << ", mean " << stats.mean_ms
+       << " ms, max " << stats.max_ms << " ms; render " << stats.renderer;
+    return os;
+}
+
+Previewer::Previewer()
+        : running_(false), quit_requested_(false), total_ms_(0.0) {}
+
+Previewer::~Previewer() {
+    Stop();
+}
+
+void Previewer::Start(const std::string& window_name,
+                      const PreviewOptions& options) {
+    Stop();
+    window_name_ = window_name;
+    options_ = options;
+    renderer_.Configure(options_.renderer);
+    mailbox_.Reset();
+    quit_requested_ = false;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_ = PreviewStats();
+        total_ms_ = 0.0;
+    }
+    running_ = true;
+    thread_ = std::thread([this]() { Run(); });
+}
+
+void Previewer::Stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    running_ = false;
+    thread_.join();
+    StereoFrame dropped;
+    mailbox_.TryTake(dropped);
+}
+
+void Previewer::Post(const StereoFrame& frame) {
+    mailbox_.Post(frame);
+}
+
+bool Previewer::QuitRequested() const {
+    return quit_requested_;
+}
+
+PreviewStats Previewer::GetStats() const {
+    PreviewStats stats;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats = stats_;
+    }
+    stats.posted = mailbox_.Posted();
+    stats.skipped = mailbox_.Skipped();
+    stats.renderer = renderer_.GetStats();
+    return stats;
+}
+
+void Previewer::Run() {
+    // HighGUI windows belong to the thread that created them, which must
+    // also pump their events with waitKey().
+    cv::namedWindow(window_name_, cv::WINDOW_KEEPRATIO);
+    cv::resizeWindow(window_name_,
+                     cv::Size(options_.window_width, options_.window_height));
+
+    auto period =
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(1.0 / options_.fps));
+    auto deadline = std::chrono::steady_clock::now();
+    bool failed = false;
+    while (running_) {
+        StereoFrame frame;
+        if (mailbox_.TryTake(frame) && !failed) {
+            // The window stays open after an error, so Esc still quits.
+            try {
+                Show(frame);
+            } catch (const std::exception& e) {
+                std::cerr << "Ԥ: " << e.what() << std::endl;
+                failed = true;
+            }
+        }
+
+        // waitKey() is the wait until the next frame is due, so the window
+        // keeps handling events in between.
+        auto now = std::chrono::steady_clock::now();
+        deadline = std::max(deadline + period, now);
+        int wait_ms = static_cast<int>(std::ceil(
+                std::chrono::duration<double, std::milli>(deadline - now)
+                        .count()));
+        int key = cv::waitKey(std::max(wait_ms, 1));
+        if (key == 27 || key == 'q' || key == 'Q') {
+            quit_requested_ = true;
+        }
+    }
+    cv::destroyWindow(window_name_);
+}
+
+void Previewer::Show(const StereoFrame& frame) {
+    auto start = std::chrono::steady_clock::now();
+    image_.create(options_.window_height, options_.window_width, CV_8UC3);
+    renderer_.Render(frame, image_.cols, image_.rows, image_.data,
+                     image_.step);
+    cv::imshow(window_name_, image_);
+    double elapsed_ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ++stats_.shown;
+    total_ms_ += elapsed_ms;
+    stats_.mean_ms = total_ms_ / stats_.shown;
+    stats_.max_ms = std::max(stats_.max_ms, elapsed_ms);
+}
@@ -0,0 +1,92 @@
+#ifndef PREVIEW_H_
+#define PREVIEW_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <ostream>
+#include <string>
+#include <thread>
+
+#include "json.hpp"
+
+#include "latest_mailbox.h"
+#include "preview_renderer.h"
+#include "stereo_frame.h"
+
+struct PreviewOptions {
+    // Frames shown per second at most.
+    double fps = 15.0;
+    // Size frames are rendered at, and the window's initial size.
+    int window_width = 1280;
+    int window_height = 360;
+    PreviewRendererOptions renderer;
+};
+
+// Reads {"fps": x, "window_width": N, "window_height": N, "renderer": {...}}.
+PreviewOptions ParsePreviewOptions(
+        const nlohmann::json& config,
+        const PreviewOptions& defaults = PreviewOptions());
+
+struct PreviewStats {
+    uint64_t posted = 0;
+    uint64_t shown = 0;
+    // Frames replaced by a newer one before the preview got to them.
+    uint64_t skipped = 0;
+    // Rendering and imshow() time per shown frame.
+    double mean_ms = 0.0;
+    double max_ms = 0.0;
+    PreviewRendererStats renderer;
+};
+
+std::ostream& operator<<(std::ostream& os, const PreviewStats& stats);
+
+// Shows the latest posted frame in a HighGUI window on its own thread, at
+// most options.fps times a second, so a slow display only skips preview
+// frames and never holds up capture or recording. Frames are scaled down to
+// the window size by a PreviewRenderer before they reach HighGUI.
+class Previewer {
+public:
+    Previewer();
+    ~Previewer();
+
+    Previewer(const Previewer&) = delete;
+    Previewer& operator=(const Previewer&) = delete;
+
+public:
+    // Opens the window on the preview thread.
+    void Start(const std::string& window_name,
+               const PreviewOptions& options = PreviewOptions());
+    // Closes the window. The held frame is released.
+    void Stop();
+
+    // Never blocks.
+    void Post(const StereoFrame& frame);
+
+    // Set once Esc or Q was pressed in the window.
+    bool QuitRequested() const;
+
+    PreviewStats GetStats() const;
+
+private:
+    void Run();
+    void Show(const StereoFrame& frame);
+
+private:
+    std::string window_name_;
+    PreviewOptions options_;
+    LatestMailbox<StereoFrame> mailbox_;
+    PreviewRenderer renderer_;
+    cv::Mat image_;
+
+    std::thread thread_;
+    std::atomic_bool running_;
+    std::atomic_bool quit_requested_;
+
+    mutable std::mutex stats_mutex_;
+    PreviewStats stats_;
+    double total_ms_;
+};
+
+#endif
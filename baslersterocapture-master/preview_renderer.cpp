@@ -0,0 +1,616 @@
+#include "preview_renderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+// Samples that a 16-bit sum of 8-bit samples can hold.
+const int kMaxSummedSamples = 65535 / 255;
+
+// Source pixels that are averaged as a whole: a YCbCr422_8 pair shares its
+// chroma and a Bayer cell holds all three colours.
+struct Unit {
+    int width;
+    int height;
+    // Bytes of the unit in each of its rows.
+    int bytes;
+};
+
+Unit UnitOf(PixelFormat pixel_format) {
+    switch (pixel_format) {
+        case PixelFormat::kBgr8:
+            return {1, 1, 3};
+        case PixelFormat::kMono8:
+            return {1, 1, 1};
+        case PixelFormat::kYCbCr422_8:
+            return {2, 1, 4};
+        case PixelFormat::kBayerRG8:
+        case PixelFormat::kBayerBG8:
+            return {2, 2, 2};
+        default:
+            throw std::runtime_error("޷Ԥظʽ: " +
+                                     PixelFormatName(pixel_format));
+    }
+}
+
+// Adds a source row to the sums of a box, or starts them with it.
+using AccumulateKernel = void (*)(const uint8_t* row, int bytes, bool first,
+                                  uint16_t* sums);
+
+void AccumulateScalar(const uint8_t* row, int bytes, bool first,
+                      uint16_t* sums) {
+    if (first) {
+        std::copy(row, row + bytes, sums);
+        return;
+    }
+    for (int i = 0; i < bytes; ++i) {
+        sums[i] = static_cast<uint16_t>(sums[i] + row[i]);
+    }
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET("ssse3")
+void AccumulateSsse3(const uint8_t* row, int bytes, bool first,
+                     uint16_t* sums) {
+    __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i samples =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m128i* out = reinterpret_cast<__m128i*>(sums + i);
+        __m128i low = _mm_unpacklo_epi8(samples, zero);
+        __m128i high = _mm_unpackhi_epi8(samples, zero);
+        if (!first) {
+            low = _mm_add_epi16(low, _mm_loadu_si128(out));
+            high = _mm_add_epi16(high, _mm_loadu_si128(out + 1));
+        }
+        _mm_storeu_si128(out, low);
+        _mm_storeu_si128(out + 1, high);
+    }
+    AccumulateScalar(row + i, bytes - i, first, sums + i);
+}
+
+SIMD_TARGET("avx2")
+void AccumulateAvx2(const uint8_t* row, int bytes, bool first,
+                    uint16_t* sums) {
+    int i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        __m256i* out = reinterpret_cast<__m256i*>(sums + i);
+        __m256i low = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)));
+        __m256i high = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(row + i + 16)));
+        if (!first) {
+            low = _mm256_add_epi16(low, _mm256_loadu_si256(out));
+            high = _mm256_add_epi16(high, _mm256_loadu_si256(out + 1));
+        }
+        _mm256_storeu_si256(out, low);
+        _mm256_storeu_si256(out + 1, high);
+    }
+    AccumulateSsse3(row + i, bytes - i, first, sums + i);
+}
+#endif
+
+// out[j] = in[j] + in[j + step] + ... + in[j + (runs - 1) * step] for the
+// first `length` j: the sums of `runs` units of `step` samples starting at
+// every sample, so the reduce kernels pick one per box.
+using SumRunsKernel = void (*)(const uint16_t* in, int length, int step,
+                               int runs, uint16_t* out);
+
+void SumRunsScalar(const uint16_t* in, int length, int step, int runs,
+                   uint16_t* out) {
+    for (int j = 0; j < length; ++j) {
+        uint16_t sum = in[j];
+        for (int i = 1; i < runs; ++i) {
+            sum = static_cast<uint16_t>(sum + in[j + i * step]);
+        }
+        out[j] = sum;
+    }
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET("ssse3")
+void SumRunsSsse3(const uint16_t* in, int length, int step, int runs,
+                  uint16_t* out) {
+    int j = 0;
+    for (; j + 8 <= length; j += 8) {
+        const __m128i* p = reinterpret_cast<const __m128i*>(in + j);
+        __m128i sum = _mm_loadu_si128(p);
+        for (int i = 1; i < runs; ++i) {
+            sum = _mm_add_epi16(
+                    sum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+                                 in + j + i * step)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j), sum);
+    }
+    SumRunsScalar(in + j, length - j, step, runs, out + j);
+}
+
+SIMD_TARGET("avx2")
+void SumRunsAvx2(const uint16_t* in, int length, int step, int runs,
+                 uint16_t* out) {
+    int j = 0;
+    for (; j + 16 <= length; j += 16) {
+        const __m256i* p = reinterpret_cast<const __m256i*>(in + j);
+        __m256i sum = _mm256_loadu_si256(p);
+        for (int i = 1; i < runs; ++i) {
+            sum = _mm256_add_epi16(
+                    sum, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+                                 in + j + i * step)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j), sum);
+    }
+    SumRunsSsse3(in + j, length - j, step, runs, out + j);
+}
+#endif
+
+// out[j] = sums[j] / units, rounded, where reciprocal is 2^16 / units.
+using ScaleKernel = void (*)(const uint16_t* sums, int length,
+                             uint16_t reciprocal, uint8_t* out);
+
+void ScaleScalar(const uint16_t* sums, int length, uint16_t reciprocal,
+                 uint8_t* out) {
+    for (int j = 0; j < length; ++j) {
+        uint32_t scaled = (static_cast<uint32_t>(sums[j]) * reciprocal +
+                           0x8000) >>
+                          16;
+        out[j] = static_cast<uint8_t>(std::min(scaled, 255u));
+    }
+}
+
+#ifdef SIMD_X86
+// The high half of the product, rounded by the top bit of the low half.
+SIMD_TARGET("ssse3")
+inline __m128i Scale128(__m128i sums, __m128i reciprocal) {
+    return _mm_add_epi16(
+            _mm_mulhi_epu16(sums, reciprocal),
+            _mm_srli_epi16(_mm_mullo_epi16(sums, reciprocal), 15));
+}
+
+SIMD_TARGET("ssse3")
+void ScaleSsse3(const uint16_t* sums, int length, uint16_t reciprocal,
+                uint8_t* out) {
+    __m128i r = _mm_set1_epi16(static_cast<short>(reciprocal));
+    int j = 0;
+    for (; j + 16 <= length; j += 16) {
+        const __m128i* p = reinterpret_cast<const __m128i*>(sums + j);
+        __m128i scaled = _mm_packus_epi16(Scale128(_mm_loadu_si128(p), r),
+                                          Scale128(_mm_loadu_si128(p + 1), r));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j), scaled);
+    }
+    ScaleScalar(sums + j, length - j, reciprocal, out + j);
+}
+
+SIMD_TARGET("avx2")
+inline __m256i Scale256(__m256i sums, __m256i reciprocal) {
+    return _mm256_add_epi16(
+            _mm256_mulhi_epu16(sums, reciprocal),
+            _mm256_srli_epi16(_mm256_mullo_epi16(sums, reciprocal), 15));
+}
+
+SIMD_TARGET("avx2")
+void ScaleAvx2(const uint16_t* sums, int length, uint16_t reciprocal,
+               uint8_t* out) {
+    __m256i r = _mm256_set1_epi16(static_cast<short>(reciprocal));
+    int j = 0;
+    for (; j + 32 <= length; j += 32) {
+        const __m256i* p = reinterpret_cast<const __m256i*>(sums + j);
+        // packus works within lanes; the permute restores the order.
+        __m256i scaled = _mm256_packus_epi16(
+                Scale256(_mm256_loadu_si256(p), r),
+                Scale256(_mm256_loadu_si256(p + 1), r));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j),
+                            _mm256_permute4x64_epi64(scaled, 0xd8));
+    }
+    ScaleSsse3(sums + j, length - j, reciprocal, out + j);
+}
+#endif
+
+AccumulateKernel SelectAccumulateKernel(SimdLevel simd) {
+#ifdef SIMD_X86
+    if (simd == SimdLevel::kAvx2) {
+        return AccumulateAvx2;
+    }
+    if (simd == SimdLevel::kSsse3) {
+        return AccumulateSsse3;
+    }
+#endif
+    return AccumulateScalar;
+}
+
+SumRunsKernel SelectSumRunsKernel(SimdLevel simd) {
+#ifdef SIMD_X86
+    if (simd == SimdLevel::kAvx2) {
+        return SumRunsAvx2;
+    }
+    if (simd == SimdLevel::kSsse3) {
+        return SumRunsSsse3;
+    }
+#endif
+    return SumRunsScalar;
+}
+
+ScaleKernel SelectScaleKernel(SimdLevel simd) {
+#ifdef SIMD_X86
+    if (simd == SimdLevel::kAvx2) {
+        return ScaleAvx2;
+    }
+    if (simd == SimdLevel::kSsse3) {
+        return ScaleSsse3;
+    }
+#endif
+    return ScaleScalar;
+}
+
+// Picks every output pixel from a row of averages of all sample positions;
+// step is the bytes between boxes.
+using PickKernel = void (*)(const uint8_t* scaled, int step, int width,
+                            uint8_t* bgr);
+
+void PickBgr(const uint8_t* scaled, int step, int width, uint8_t* bgr) {
+    // Four bytes at a time; the fourth is overwritten by the next pixel.
+    int x = 0;
+    for (; x + 1 < width; ++x) {
+        std::memcpy(bgr + x * 3, scaled + x * step, 4);
+    }
+    std::memcpy(bgr + x * 3, scaled + x * step, 3);
+}
+
+void PickMono(const uint8_t* scaled, int step, int width, uint8_t* bgr) {
+    for (int x = 0; x < width; ++x) {
+        uint8_t* out = bgr + x * 3;
+        out[0] = out[1] = out[2] = scaled[x * step];
+    }
+}
+
+// The summed source rows of one output row and where it goes. runs[i] + k
+// holds the sums of the `summed` units from sample k of sums[i]; a box adds
+// the units beyond those from sums[i]. Index 1 is for the odd rows of Bayer
+// cells.
+struct ReduceArgs {
+    const uint16_t* sums[2];
+    const uint16_t* runs[2];
+    int summed;
+    const AreaBox* columns;
+    const uint32_t* reciprocals;
+    int width;
+    uint8_t* bgr;
+};
+
+using ReduceKernel = void (*)(const ReduceArgs& args);
+
+// sum / samples, where reciprocal is 2^22 / units and samples is units
+// times 2^(shift - 22).
+inline uint8_t Average(uint32_t sum, uint32_t reciprocal, int shift) {
+    uint32_t scaled = (sum * reciprocal + (1u << (shift - 1))) >> shift;
+    return static_cast<uint8_t>(std::min(scaled, 255u));
+}
+
+inline uint8_t Clamp8(int value) {
+    return static_cast<uint8_t>(std::min(std::max(value, 0), 255));
+}
+
+void ReduceBgr(const ReduceArgs& args) {
+    for (int x = 0; x < args.width; ++x) {
+        const AreaBox& box = args.columns[x];
+        const uint16_t* run = args.runs[0] + box.begin * 3;
+        uint32_t b = run[0];
+        uint32_t g = run[1];
+        uint32_t r = run[2];
+        const uint16_t* s = args.sums[0] + (box.begin + args.summed) * 3;
+        for (int i = args.summed; i < box.count; ++i, s += 3) {
+            b += s[0];
+            g += s[1];
+            r += s[2];
+        }
+        uint8_t* out = args.bgr + x * 3;
+        out[0] = Average(b, args.reciprocals[x], 22);
+        out[1] = Average(g, args.reciprocals[x], 22);
+        out[2] = Average(r, args.reciprocals[x], 22);
+    }
+}
+
+void ReduceMono(const ReduceArgs& args) {
+    for (int x = 0; x < args.width; ++x) {
+        const AreaBox& box = args.columns[x];
+        uint32_t sum = args.runs[0][box.begin];
+        const uint16_t* s = args.sums[0] + box.begin;
+        for (int i = args.summed; i < box.count; ++i) {
+            sum += s[i];
+        }
+        uint8_t* out = args.bgr + x * 3;
+        out[0] = out[1] = out[2] = Average(sum, args.reciprocals[x], 22);
+    }
+}
+
+// BT.601 limited range back to BGR, in 8-bit fixed point.
+void ReduceYuyv(const ReduceArgs& args) {
+    for (int x = 0; x < args.width; ++x) {
+        const AreaBox& box = args.columns[x];
+        const uint16_t* run = args.runs[0] + box.begin * 4;
+        uint32_t y = run[0] + run[2];
+        uint32_t u = run[1];
+        uint32_t v = run[3];
+        const uint16_t* s = args.sums[0] + (box.begin + args.summed) * 4;
+        for (int i = args.summed; i < box.count; ++i, s += 4) {
+            y += s[0] + s[2];
+            u += s[1];
+            v += s[3];
+        }
+        int c = 298 * (Average(y, args.reciprocals[x], 23) - 16) + 128;
+        int d = Average(u, args.reciprocals[x], 22) - 128;
+        int e = Average(v, args.reciprocals[x], 22) - 128;
+        uint8_t* out = args.bgr + x * 3;
+        out[0] = Clamp8((c + 516 * d) >> 8);
+        out[1] = Clamp8((c - 100 * d - 208 * e) >> 8);
+        out[2] = Clamp8((c + 409 * e) >> 8);
+    }
+}
+
+// Even rows hold the first colour of the pattern name, odd rows the last.
+template <bool kRedFirst>
+void ReduceBayer(const ReduceArgs& args) {
+    for (int x = 0; x < args.width; ++x) {
+        const AreaBox& box = args.columns[x];
+        const uint16_t* even = args.runs[0] + box.begin * 2;
+        const uint16_t* odd = args.runs[1] + box.begin * 2;
+        uint32_t first = even[0];
+        uint32_t g = even[1] + odd[0];
+        uint32_t last = odd[1];
+        even = args.sums[0] + box.begin * 2;
+        odd = args.sums[1] + box.begin * 2;
+        for (int i = args.summed * 2; i < box.count * 2; i += 2) {
+            first += even[i];
+            g += even[i + 1] + odd[i];
+            last += odd[i + 1];
+        }
+        uint8_t* out = args.bgr + x * 3;
+        out[kRedFirst ? 2 : 0] = Average(first, args.reciprocals[x], 22);
+        out[1] = Average(g, args.reciprocals[x], 23);
+        out[kRedFirst ? 0 : 2] = Average(last, args.reciprocals[x], 22);
+    }
+}
+
+ReduceKernel SelectReduceKernel(PixelFormat pixel_format) {
+    switch (pixel_format) {
+        case PixelFormat::kBgr8:
+            return ReduceBgr;
+        case PixelFormat::kMono8:
+            return ReduceMono;
+        case PixelFormat::kYCbCr422_8:
+            return ReduceYuyv;
+        case PixelFormat::kBayerRG8:
+            return ReduceBayer<true>;
+        case PixelFormat::kBayerBG8:
+            return ReduceBayer<false>;
+        default:
+            throw std::runtime_error("޷Ԥظʽ: " +
+                                     PixelFormatName(pixel_format));
+    }
+}
+
+// Splits `units` into `boxes` runs of nearly equal length. When enlarging,
+// boxes repeat the nearest unit.
+std::vector<AreaBox> SplitAxis(int units, int boxes) {
+    std::vector<AreaBox> split(boxes);
+    for (int i = 0; i < boxes; ++i) {
+        int begin = static_cast<int>(static_cast<int64_t>(i) * units / boxes);
+        int end = static_cast<int>(static_cast<int64_t>(i + 1) * units /
+                                   boxes);
+        split[i].begin = begin;
+        split[i].count = std::max(end - begin, 1);
+    }
+    return split;
+}
+}  // namespace
+
+PreviewRendererOptions ParsePreviewRendererOptions(
+        const nlohmann::json& config, const PreviewRendererOptions& defaults) {
+    PreviewRendererOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    options.threads = config.value("threads", options.threads);
+    options.stripe_rows = config.value("stripe_rows", options.stripe_rows);
+    if (config.count("simd")) {
+        options.simd = ParseSimdLevel(config["simd"]);
+    }
+    if (options.stripe_rows <= 0) {
+        throw std::runtime_error("Ԥ0");
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os,
+                         const PreviewRendererStats& stats) {
+    os << SimdLevelName(stats.simd) << ", " << stats.threads
+       << " workers, frames " << stats.frames << ", mean " << stats.mean_ms
+       << " ms, max " << stats.max_ms << " ms";
+    return os;
+}
+
+PreviewRenderer::PreviewRenderer(const PreviewRendererOptions& options)
+        : options_(options), total_ms_(0.0) {
+    stats_.simd = options_.simd;
+}
+
+void PreviewRenderer::Configure(const PreviewRendererOptions& options) {
+    options_ = options;
+    workers_.Start(options_.threads);
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_ = PreviewRendererStats();
+    stats_.simd = options_.simd;
+    stats_.threads = workers_.Size();
+    total_ms_ = 0.0;
+}
+
+void PreviewRenderer::Render(const StereoFrame& frame, int width, int height,
+                             uint8_t* bgr, size_t stride) {
+    if (width < 2 || height < 1) {
+        throw std::runtime_error("ԤͼߴЧ");
+    }
+    const CameraFrame* halves[2] = {&frame.left, &frame.right};
+    int widths[2] = {width / 2, width - width / 2};
+    for (int side = 0; side < 2; ++side) {
+        Plan(*halves[side], widths[side], height, plans_[side]);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    int stripe_rows = options_.stripe_rows;
+    size_t stripes = (height + stripe_rows - 1) / stripe_rows;
+    workers_.ParallelFor(stripes * 2, [&](size_t task) {
+        int side = static_cast<int>(task % 2);
+        int begin = static_cast<int>(task / 2) * stripe_rows;
+        int end = std::min(begin + stripe_rows, height);
+        RenderRows(*halves[side], plans_[side], begin, end,
+                   bgr + side * widths[0] * 3, stride);
+    });
+
+    double elapsed_ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ++stats_.frames;
+    total_ms_ += elapsed_ms;
+    stats_.mean_ms = total_ms_ / stats_.frames;
+    stats_.max_ms = std::max(stats_.max_ms, elapsed_ms);
+}
+
+PreviewRendererStats PreviewRenderer::GetStats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+void PreviewRenderer::Plan(const CameraFrame& half, int width, int height,
+                           HalfPlan& plan) {
+    if (plan.pixel_format == half.pixel_format &&
+        plan.source_width == half.width &&
+        plan.source_height == half.height && plan.width == width &&
+        plan.height == height) {
+        return;
+    }
+    plan.pixel_format = PixelFormat::kUnknown;
+
+    Unit unit = UnitOf(half.pixel_format);
+    if (half.width % unit.width != 0 || half.height % unit.height != 0) {
+        throw std::runtime_error("ͼ߱ΪżԤ");
+    }
+    plan.columns = SplitAxis(half.width / unit.width, width);
+    plan.rows = SplitAxis(half.height / unit.height, height);
+
+    int max_rows = 0;
+    plan.min_rows = plan.rows[0].count;
+    for (const AreaBox& box : plan.rows) {
+        plan.min_rows = std::min(plan.min_rows, box.count);
+        max_rows = std::max(max_rows, box.count);
+    }
+    if (max_rows > kMaxSummedSamples) {
+        throw std::runtime_error("Ԥͼ߶ȹС");
+    }
+    int min_columns = plan.columns[0].count;
+    int max_columns = 0;
+    for (const AreaBox& box : plan.columns) {
+        min_columns = std::min(min_columns, box.count);
+        max_columns = std::max(max_columns, box.count);
+    }
+    plan.summed =
+            std::max(1, std::min(min_columns, kMaxSummedSamples / max_rows));
+
+    plan.uniform = (half.pixel_format == PixelFormat::kBgr8 ||
+                    half.pixel_format == PixelFormat::kMono8) &&
+                   max_columns == plan.summed &&
+                   plan.summed * plan.min_rows > 1;
+    for (int i = 0; i < 2; ++i) {
+        uint32_t units = plan.summed * (plan.min_rows + i);
+        plan.uniform_reciprocals[i] =
+                static_cast<uint16_t>(((1u << 16) + units / 2) / units);
+    }
+    for (int i = 0; i < 2; ++i) {
+        plan.reciprocals[i].resize(width);
+        for (int x = 0; x < width; ++x) {
+            uint32_t units = plan.columns[x].count * (plan.min_rows + i);
+            plan.reciprocals[i][x] = ((1u << 22) + units / 2) / units;
+        }
+    }
+
+    plan.pixel_format = half.pixel_format;
+    plan.source_width = half.width;
+    plan.source_height = half.height;
+    plan.width = width;
+    plan.height = height;
+}
+
+void PreviewRenderer::RenderRows(const CameraFrame& half, const HalfPlan& plan,
+                                 int begin, int end, uint8_t* bgr,
+                                 size_t stride) const {
+    Unit unit = UnitOf(half.pixel_format);
+    AccumulateKernel accumulate = SelectAccumulateKernel(options_.simd);
+    SumRunsKernel sum_runs = SelectSumRunsKernel(options_.simd);
+    ScaleKernel scale = SelectScaleKernel(options_.simd);
+    ReduceKernel reduce = SelectReduceKernel(half.pixel_format);
+    PickKernel pick =
+            half.pixel_format == PixelFormat::kBgr8 ? PickBgr : PickMono;
+
+    // One row of sums per row of a unit, reused by every output row. Each
+    // worker keeps its buffers across stripes and frames.
+    int row_bytes = half.width / unit.width * unit.bytes;
+    int length = row_bytes - (plan.summed - 1) * unit.bytes;
+    size_t sums_size = static_cast<size_t>(row_bytes) * unit.height;
+    static thread_local std::vector<uint16_t> sums;
+    static thread_local std::vector<uint16_t> runs;
+    static thread_local std::vector<uint8_t> scaled;
+    if (sums.size() < sums_size) {
+        sums.resize(sums_size);
+    }
+    if (plan.summed > 1 && runs.size() < sums_size) {
+        runs.resize(sums_size);
+    }
+    if (plan.uniform && scaled.size() < static_cast<size_t>(length)) {
+        scaled.resize(length);
+    }
+
+    ReduceArgs args;
+    for (int i = 0; i < 2; ++i) {
+        size_t offset = i < unit.height ? i * row_bytes : 0;
+        args.sums[i] = sums.data() + offset;
+        args.runs[i] = plan.summed > 1 ? runs.data() + offset : args.sums[i];
+    }
+    args.summed = plan.summed;
+    args.columns = plan.columns.data();
+    args.width = plan.width;
+    for (int y = begin; y < end; ++y) {
+        const AreaBox& box = plan.rows[y];
+        for (int i = 0; i < box.count * unit.height; ++i) {
+            const uint8_t* row =
+                    half.buffer +
+                    (box.begin * unit.height + i) * half.stride;
+            accumulate(row, row_bytes, i < unit.height,
+                       sums.data() + (i % unit.height) * row_bytes);
+        }
+        if (plan.summed > 1) {
+            for (int i = 0; i < unit.height; ++i) {
+                sum_runs(args.sums[i], length, unit.bytes, plan.summed,
+                         runs.data() + i * row_bytes);
+            }
+        }
+        int row_class = box.count - plan.min_rows;
+        if (plan.uniform) {
+            scale(args.runs[0], length, plan.uniform_reciprocals[row_class],
+                  scaled.data());
+            pick(scaled.data(), plan.summed * unit.bytes, plan.width,
+                 bgr + y * stride);
+            continue;
+        }
+        args.reciprocals = plan.reciprocals[row_class].data();
+        args.bgr = bgr + y * stride;
+        reduce(args);
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef PREVIEW_RENDERER_H_
+#define PREVIEW_RENDERER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "json.hpp"
+
+#include "camera_source.h"
+#include "simd.h"
+#include "stereo_frame.h"
+#include "worker_pool.h"
+
+struct PreviewRendererOptions {
+    // Workers besides the preview thread; 0 uses one per core.
+    size_t threads = 1;
+    // Output rows per worker task.
+    int stripe_rows = 32;
+    SimdLevel simd = DetectSimdLevel();
+};
+
+// Reads {"threads": N, "stripe_rows": N, "simd": "auto"|"avx2"|"ssse3"|
+// "scalar"}.
+PreviewRendererOptions ParsePreviewRendererOptions(
+        const nlohmann::json& config,
+        const PreviewRendererOptions& defaults = PreviewRendererOptions());
+
+struct PreviewRendererStats {
+    SimdLevel simd = SimdLevel::kScalar;
+    size_t threads = 0;
+    uint64_t frames = 0;
+    double mean_ms = 0.0;
+    double max_ms = 0.0;
+};
+
+std::ostream& operator<<(std::ostream& os,
+                         const PreviewRendererStats& stats);
+
+// Source units averaged into one output pixel along an axis.
+struct AreaBox {
+    int begin = 0;
+    int count = 0;
+};
+
+// Scales StereoFrames down to a BGR8 preview image in one pass over the
+// camera halves: every output pixel is the average of the source box it
+// covers, each half fills its own side of the image, and no full-size BGR
+// copy is made for Bayer, Mono8 or YCbCr422_8 frames. Source rows are summed
+// with SIMD into a row of 16-bit sums that stays in cache, which is then
+// reduced to the output row; stripes of output rows run on a worker pool.
+class PreviewRenderer {
+public:
+    explicit PreviewRenderer(
+            const PreviewRendererOptions& options = PreviewRendererOptions());
+    ~PreviewRenderer() = default;
+
+    PreviewRenderer(const PreviewRenderer&) = delete;
+    PreviewRenderer& operator=(const PreviewRenderer&) = delete;
+
+public:
+    // Not while Render() runs.
+    void Configure(const PreviewRendererOptions& options);
+
+    // Writes a width x height image to `bgr`, the left half of the frame to
+    // the left width / 2 columns. Bayer and YCbCr422_8 halves must have even
+    // widths, Bayer halves even heights. Calls must not overlap.
+    void Render(const StereoFrame& frame, int width, int height, uint8_t* bgr,
+                size_t stride);
+
+    PreviewRendererStats GetStats() const;
+
+private:
+    // How one half maps onto its side of the image. Rebuilt only when the
+    // sizes or the format change.
+    struct HalfPlan {
+        PixelFormat pixel_format = PixelFormat::kUnknown;
+        int source_width = 0;
+        int source_height = 0;
+        int width = 0;
+        int height = 0;
+        std::vector<AreaBox> columns;
+        std::vector<AreaBox> rows;
+        // Row boxes hold min_rows or min_rows + 1 units; reciprocals[i][x]
+        // is 2^22 over the units in column x times min_rows + i.
+        int min_rows = 0;
+        std::vector<uint32_t> reciprocals[2];
+        // Units of every box that are summed with SIMD before the reduce.
+        int summed = 1;
+        // BGR8 and Mono8 boxes that all hold `summed` columns are averaged
+        // with SIMD too, by the 2^16 / units reciprocals of the row classes.
+        bool uniform = false;
+        uint16_t uniform_reciprocals[2] = {0, 0};
+    };
+
+    static void Plan(const CameraFrame& half, int width, int height,
+                     HalfPlan& plan);
+    void RenderRows(const CameraFrame& half, const HalfPlan& plan, int begin,
+                    int end, uint8_t* bgr, size_t stride) const;
+
+private:
+    PreviewRendererOptions options_;
+    WorkerPool workers_;
+    HalfPlan plans_[2];
+
+    mutable std::mutex stats_mutex_;
+    PreviewRendererStats stats_;
+    double total_ms_;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "queue_benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "notifier.h"
+#include "rate.h"
+#include "spmc_ring.h"
+
+namespace {
+const double kPairRates[] = {15.0, 60.0, 200.0};
+const double kSecondsPerRun = 4.0;
+const size_t kRingCapacity = 32;
+
+using Clock = std::chrono::steady_clock;
+
+// Stands in for a CGrabResultPtr: ref-counted and cheap to copy.
+struct Item {
+    uint64_t block_id = 0;
+    Clock::time_point push_time;
+    std::shared_ptr<int> payload;
+};
+
+struct Samples {
+    std::vector<int64_t> push_ns;
+    std::vector<int64_t> latency_ns;
+};
+
+struct Summary {
+    double mean_us = 0.0;
+    double p99_us = 0.0;
+    double max_us = 0.0;
+};
+
+Summary Summarize(std::vector<int64_t> values) {
+    Summary summary;
+    if (values.empty()) {
+        return summary;
+    }
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (auto value : values) {
+        sum += static_cast<double>(value);
+    }
+    summary.mean_us = sum / values.size() / 1000.0;
+    summary.p99_us = values[values.size() * 99 / 100] / 1000.0;
+    summary.max_us = values.back() / 1000.0;
+    return summary;
+}
+
+class DequeMutexPath {
+public:
+    void Push(int side, const Item& item) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queues_[side].push_back(item);
+        }
+        condition_variable_.notify_all();
+    }
+
+    std::pair<Item, Item> Pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_variable_.wait(lock, [this]() {
+            return !(queues_[0].empty() || queues_[1].empty());
+        });
+        auto result = std::make_pair(queues_[0].front(), queues_[1].front());
+        queues_[0].pop_front();
+        queues_[1].pop_front();
+        return result;
+    }
+
+private:
+    std::deque<Item> queues_[2];
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+};
+
+class RingPath {
+public:
+    RingPath() : left_(kRingCapacity), right_(kRingCapacity) {}
+
+    void Push(int side, const Item& item) {
+        auto& ring = side == 0 ? left_ : right_;
+        while (!ring.TryPush(item)) {
+            space_notifier_.Wait([&]() { return !ring.Full(); });
+        }
+        ready_notifier_.Notify();
+    }
+
+    std::pair<Item, Item> Pop() {
+        ready_notifier_.Wait(
+                [this]() { return !(left_.Empty() || right_.Empty()); });
+        std::pair<Item, Item> result;
+        left_.TryPop(result.first);
+        right_.TryPop(result.second);
+        space_notifier_.Notify();
+        return result;
+    }
+
+private:
+    SpmcRing<Item> left_;
+    SpmcRing<Item> right_;
+    Notifier ready_notifier_;
+    Notifier space_notifier_;
+};
+
+template <typename Path>
+Samples RunPath(double pair_rate) {
+    Path path;
+    Samples samples;
+    const size_t pair_count = static_cast<size_t>(pair_rate * kSecondsPerRun);
+    std::vector<int64_t> push_ns[2];
+
+    auto producer = [&](int side) {
+        Rate rate(pair_rate);
+        rate.Init();
+        auto payload = std::make_shared<int>(side);
+        push_ns[side].reserve(pair_count);
+        for (size_t i = 0; i < pair_count; ++i) {
+            Item item;
+            item.block_id = i;
+            item.payload = payload;
+            item.push_time = Clock::now();
+            path.Push(side, item);
+            push_ns[side].push_back(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            Clock::now() - item.push_time)
+                            .count());
+            rate.Sleep();
+        }
+    };
+
+    std::thread left_thread(producer, 0);
+    std::thread right_thread(producer, 1);
+
+    samples.latency_ns.reserve(pair_count);
+    for (size_t i = 0; i < pair_count; ++i) {
+        auto pair = path.Pop();
+        auto ready_time = std::max(pair.first.push_time, pair.second.push_time);
+        samples.latency_ns.push_back(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - ready_time)
+                        .count());
+    }
+
+    left_thread.join();
+    right_thread.join();
+
+    samples.push_ns = push_ns[0];
+    samples.push_ns.insert(samples.push_ns.end(), push_ns[1].begin(),
+                           push_ns[1].end());
+    return samples;
+}
+
+void PrintRow(const std::string& name, const Samples& samples) {
+    auto push = Summarize(samples.push_ns);
+    auto latency = Summarize(samples.latency_ns);
+    std::cout << std::setw(14) << name << std::fixed << std::setprecision(2)
+              << " | push mean " << std::setw(8) << push.mean_us
+              << " us, p99 " << std::setw(8) << push.p99_us << " us, max "
+              << std::setw(9) << push.max_us << " us | pair latency mean "
+              << std::setw(8) << latency.mean_us << " us, p99 "
+              << std::setw(8) << latency.p99_us << " us, max " << std::setw(9)
+              << latency.max_us << " us" << std::endl;
+}
+}  // namespace
+
+void RunQueueBenchmark() {
+    for (double pair_rate : kPairRates) {
+        std::cout << "== " << static_cast<int>(pair_rate) << " pairs/s, "
+                  << static_cast<size_t>(pair_rate * kSecondsPerRun)
+                  << " pairs ==" << std::endl;
+        PrintRow("deque+mutex", RunPath<DequeMutexPath>(pair_rate));
+        PrintRow("spmc ring", RunPath<RingPath>(pair_rate));
+    }
+}
@@ -0,0 +1,8 @@
+#ifndef QUEUE_BENCHMARK_H_
+#define QUEUE_BENCHMARK_H_
+
+// Compares the former deque+mutex grab result hand-off with the lock-free
+// rings used by SteroCamera, at 15, 60 and 200 pairs/s. No camera is needed.
+void RunQueueBenchmark();
+
+#endif
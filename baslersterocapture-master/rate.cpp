@@ -1,9 +1,51 @@
 #include "rate.h"
 
-#include <iostream>
-#include <thread>
+#include <algorithm>
+#include <stdexcept>
 
-Rate::Rate(double frequency) {
+#include "utils.h"
+
+OverrunPolicy ParseOverrunPolicy(const std::string& name) {
+    if (name == "skip") {
+        return OverrunPolicy::kSkip;
+    }
+    if (name == "catch_up") {
+        return OverrunPolicy::kCatchUp;
+    }
+    throw std::runtime_error("δ֪ĳʱ: " + name);
+}
+
+std::string OverrunPolicyName(OverrunPolicy policy) {
+    return policy == OverrunPolicy::kSkip ? "skip" : "catch_up";
+}
+
+RateOptions ParseRateOptions(const nlohmann::json& config,
+                             const RateOptions& defaults) {
+    RateOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    options.spin_us = config.value("spin_us", options.spin_us);
+    if (config.count("overrun_policy")) {
+        options.overrun_policy = ParseOverrunPolicy(config["overrun_policy"]);
+    }
+    options.max_catch_up = config.value("max_catch_up", options.max_catch_up);
+    if (options.max_catch_up < 0) {
+        throw std::runtime_error("󲹳Ϊ");
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const RateStats& stats) {
+    os << "periods " << stats.periods << ", achieved " << stats.achieved_rate
+       << " Hz, overruns " << stats.overruns << " (max "
+       << stats.max_overrun_us << " us), skipped " << stats.skipped
+       << ", jitter mean " << stats.mean_jitter_us << " us, max "
+       << stats.max_jitter_us << " us";
+    return os;
+}
+
+Rate::Rate(double frequency) : total_jitter_us_(0.0) {
     SetRate(frequency);
 }
 
@@ -17,21 +59,64 @@ void Rate::SetRate(double frequency) {
             static_cast<int64_t>(1000000000.0 / frequency));
 }
 
+void Rate::Configure(const RateOptions& options) {
+    options_ = options;
+}
+
 void Rate::Init() {
-    last_sleep_time_ = std::chrono::high_resolution_clock::now();
+    start_time_ = Clock::now();
+    deadline_ = start_time_;
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_ = RateStats();
+    total_jitter_us_ = 0.0;
 }
 
 void Rate::Sleep() {
-    auto now = std::chrono::high_resolution_clock::now();
-    auto diff = now - last_sleep_time_;
+    deadline_ += duration_;
+
+    auto now = Clock::now();
+    uint64_t skipped = 0;
+    int64_t late_ns = 0;
+    bool overrun = now > deadline_;
+    if (overrun) {
+        late_ns = (now - deadline_).count();
+        // Whole periods missed besides this one.
+        int64_t missed = late_ns / duration_.count();
+        if (options_.overrun_policy == OverrunPolicy::kSkip) {
+            skipped = missed + 1;
+        } else if (missed > options_.max_catch_up) {
+            skipped = missed - options_.max_catch_up;
+        }
+        deadline_ += duration_ * skipped;
+    }
+
+    if (now < deadline_) {
+        SleepUntil(deadline_, std::chrono::microseconds(options_.spin_us));
+        now = Clock::now();
+    }
 
-    auto sleep_ns = duration_.count() - diff.count();
+    double jitter_us =
+            std::chrono::duration<double, std::micro>(now - deadline_).count();
+    double elapsed_s = std::chrono::duration<double>(now - start_time_).count();
 
-    if (sleep_ns > 0) {
-        std::this_thread::sleep_for(std::chrono::nanoseconds(sleep_ns));
-    } else {
-        std::cout << "Rate Timeout : " << -sleep_ns << " ns" << std::endl;
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ++stats_.periods;
+    if (overrun) {
+        ++stats_.overruns;
+        stats_.max_overrun_us =
+                std::max(stats_.max_overrun_us, late_ns / 1000.0);
     }
+    stats_.skipped += skipped;
+    total_jitter_us_ += jitter_us;
+    stats_.mean_jitter_us = total_jitter_us_ / stats_.periods;
+    stats_.max_jitter_us = std::max(stats_.max_jitter_us, jitter_us);
+    if (elapsed_s > 0.0) {
+        stats_.achieved_rate = stats_.periods / elapsed_s;
+    }
+}
 
-    last_sleep_time_ = std::chrono::high_resolution_clock::now();
-}
\ No newline at end of file
+RateStats Rate::GetStats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
@@ -2,7 +2,54 @@
 #define RATE_H_
 
 #include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
 
+#include "json.hpp"
+
+// What Sleep() does when the caller is already past the period deadline.
+enum class OverrunPolicy {
+    kSkip,     // drop the missed periods and wait for the next deadline
+    kCatchUp,  // return at once until the schedule is met again, for at
+               // most max_catch_up missed periods
+};
+
+OverrunPolicy ParseOverrunPolicy(const std::string& name);
+std::string OverrunPolicyName(OverrunPolicy policy);
+
+struct RateOptions {
+    // The spin passed to SleepUntil() for every wait.
+    int64_t spin_us = 0;
+    OverrunPolicy overrun_policy = OverrunPolicy::kSkip;
+    // Missed periods kCatchUp makes up after a stall; older ones are
+    // skipped, so a long stall does not end in a burst of triggers.
+    int64_t max_catch_up = 2;
+};
+
+// Reads {"spin_us": N, "overrun_policy": "skip"|"catch_up",
+// "max_catch_up": N}.
+RateOptions ParseRateOptions(const nlohmann::json& config,
+                             const RateOptions& defaults = RateOptions());
+
+// Wake-up lateness is measured against the deadline, per period.
+struct RateStats {
+    uint64_t periods = 0;
+    uint64_t overruns = 0;
+    uint64_t skipped = 0;
+    double max_overrun_us = 0.0;
+    double achieved_rate = 0.0;
+    double mean_jitter_us = 0.0;
+    double max_jitter_us = 0.0;
+};
+
+std::ostream& operator<<(std::ostream& os, const RateStats& stats);
+
+// Periodic scheduler on absolute steady_clock deadlines. Period k ends at
+// Init() + k * period whatever Sleep() overshot before, so the long-run
+// rate stays locked to the nominal one. Sleep() is called from one thread;
+// GetStats() may be called from any.
 class Rate {
 public:
     Rate(double frequency = 10.0);
@@ -11,14 +58,27 @@ public:
     double GetRate() const;
     void SetRate(double frequency);
 
+    void Configure(const RateOptions& options);
+
     void Init();
     void Sleep();
 
+    RateStats GetStats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
 private:
     double frequency_;
     std::chrono::nanoseconds duration_;
-    std::chrono::time_point<std::chrono::high_resolution_clock>
-            last_sleep_time_;
+    RateOptions options_;
+
+    Clock::time_point start_time_;
+    Clock::time_point deadline_;
+
+    mutable std::mutex stats_mutex_;
+    RateStats stats_;
+    double total_jitter_us_;
 };
 
-#endif RATE_H_
\ No newline at end of file
+#endif RATE_H_
@@ -0,0 +1,543 @@
+#include "replay_camera_source.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+
+#include "periodic_thread.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+#pragma comment(lib, "avformat.lib")
+#pragma comment(lib, "avutil.lib")
+#pragma comment(lib, "avcodec.lib")
+#pragma comment(lib, "swscale.lib")
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+const int kLeft = 0;
+const int kRight = 1;
+const AVRational kNanoseconds = {1, 1000000000};
+
+// One video stream of the file and its decoder.
+struct Track {
+    int stream_index = -1;
+    AVCodecContext* codec_context = nullptr;
+    SwsContext* sws_context = nullptr;
+    // Read while decoding the other track.
+    std::deque<AVPacket*> packets;
+};
+
+// A decoded image as delivered, before it is split side by side.
+struct Image {
+    std::shared_ptr<AVFrame> holder;
+    uint8_t* data = nullptr;
+    size_t stride = 0;
+    int width = 0;
+    int height = 0;
+    PixelFormat pixel_format = PixelFormat::kUnknown;
+};
+
+class ReplayRig {
+public:
+    explicit ReplayRig(const ReplayOptions& options)
+            : options_(options),
+              format_context_(nullptr),
+              track_count_(0),
+              gray_(false),
+              gray_format_(PixelFormat::kMono8),
+              packet_(nullptr),
+              decoded_(nullptr),
+              frame_index_(0),
+              loop_offset_ns_(0),
+              last_timestamp_ns_(0),
+              frame_duration_ns_(0),
+              free_run_rate_(0.0) {
+        for (int camera = kLeft; camera <= kRight; ++camera) {
+            grabbing_[camera] = false;
+            triggers_[camera] = 0;
+        }
+        try {
+            Init();
+        } catch (...) {
+            Release();
+            throw;
+        }
+    }
+
+    ~ReplayRig() {
+        free_run_.Stop();
+        Release();
+    }
+
+    // Gray recordings hold Mono8 frames or a raw Bayer mosaic, which the
+    // file does not tell apart; the configured pixel format decides.
+    void SetPixelFormat(PixelFormat pixel_format) {
+        if (pixel_format == PixelFormat::kUnknown) {
+            return;
+        }
+        if (!gray_) {
+            if (pixel_format != PixelFormat::kBgr8) {
+                throw std::runtime_error("ɫطļֻBGR8ʽط");
+            }
+            return;
+        }
+        if (pixel_format != PixelFormat::kMono8 &&
+            pixel_format != PixelFormat::kBayerRG8 &&
+            pixel_format != PixelFormat::kBayerBG8) {
+            throw std::runtime_error(
+                    "ҶȻطļֻMono8Bayerʽط");
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        gray_format_ = pixel_format;
+    }
+
+    void SetFreeRun(double frame_rate) {
+        free_run_rate_ = frame_rate;
+    }
+
+    void StartGrabbing(int camera) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            grabbing_[camera] = true;
+            triggers_[camera] = 0;
+        }
+        if (camera == kLeft && free_run_rate_ > 0.0) {
+            free_run_.Start(free_run_rate_, [this]() { Fire(); });
+        }
+    }
+
+    void StopGrabbing(int camera) {
+        if (camera == kLeft) {
+            free_run_.Stop();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            grabbing_[camera] = false;
+            ready_[camera].clear();
+        }
+        condition_variable_.notify_all();
+    }
+
+    Clock::time_point Fire() {
+        auto now = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (int camera = kLeft; camera <= kRight; ++camera) {
+                if (grabbing_[camera]) {
+                    ++triggers_[camera];
+                }
+            }
+        }
+        condition_variable_.notify_all();
+        return now;
+    }
+
+    CameraFrame Retrieve(int camera, unsigned int timeout_ms) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        bool triggered = condition_variable_.wait_for(
+                lock, std::chrono::milliseconds(timeout_ms), [&]() {
+                    return triggers_[camera] > 0 || !grabbing_[camera];
+                });
+        if (!grabbing_[camera]) {
+            throw std::runtime_error("طδʼɼ");
+        }
+        if (!triggered) {
+            throw std::runtime_error("طȡͼʱ");
+        }
+        --triggers_[camera];
+        if (ready_[camera].empty()) {
+            DecodeNext();
+        }
+        CameraFrame frame = ready_[camera].front();
+        ready_[camera].pop_front();
+        return frame;
+    }
+
+private:
+    void Init() {
+        int ret = avformat_open_input(&format_context_,
+                                      options_.file_name.c_str(), nullptr,
+                                      nullptr);
+        if (ret < 0) {
+            throw std::runtime_error("޷򿪻طļ: " + options_.file_name);
+        }
+        if (avformat_find_stream_info(format_context_, nullptr) < 0) {
+            throw std::runtime_error("޷ȡطļϢ");
+        }
+
+        // VideoRecorder writes either one side-by-side stream or the left
+        // and the right view as two streams, in that order.
+        for (unsigned int i = 0; i < format_context_->nb_streams; ++i) {
+            if (format_context_->streams[i]->codecpar->codec_type !=
+                AVMEDIA_TYPE_VIDEO) {
+                continue;
+            }
+            if (track_count_ == 2) {
+                throw std::runtime_error("طļеƵ·");
+            }
+            OpenTrack(tracks_[track_count_++], static_cast<int>(i));
+        }
+        if (track_count_ == 0) {
+            throw std::runtime_error("طļûƵ");
+        }
+
+        const AVCodecContext* left = tracks_[kLeft].codec_context;
+        gray_ = left->pix_fmt == AV_PIX_FMT_GRAY8;
+        if (track_count_ == 1) {
+            if (left->width % 2 != 0) {
+                throw std::runtime_error("طļƴӵ˫ĿƵ");
+            }
+        } else {
+            const AVCodecContext* right = tracks_[kRight].codec_context;
+            if (right->width != left->width ||
+                right->height != left->height ||
+                (right->pix_fmt == AV_PIX_FMT_GRAY8) != gray_) {
+                throw std::runtime_error(
+                        "طļ·Ƶĳߴʽһ");
+            }
+        }
+
+        AVStream* stream =
+                format_context_->streams[tracks_[kLeft].stream_index];
+        AVRational frame_rate = av_guess_frame_rate(format_context_, stream,
+                                                    nullptr);
+        if (frame_rate.num > 0 && frame_rate.den > 0) {
+            frame_duration_ns_ =
+                    av_rescale_q(1, av_inv_q(frame_rate), kNanoseconds);
+        }
+
+        packet_ = av_packet_alloc();
+        decoded_ = av_frame_alloc();
+        if (!packet_ || !decoded_) {
+            throw std::runtime_error("޷ʼƵ֡");
+        }
+    }
+
+    void OpenTrack(Track& track, int stream_index) {
+        track.stream_index = stream_index;
+        AVStream* stream = format_context_->streams[stream_index];
+        AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+        if (!codec) {
+            throw std::runtime_error("޷ҵطļĽ");
+        }
+
+        track.codec_context = avcodec_alloc_context3(codec);
+        if (!track.codec_context) {
+            throw std::runtime_error("޷ʼ");
+        }
+        avcodec_parameters_to_context(track.codec_context, stream->codecpar);
+        if (avcodec_open2(track.codec_context, codec, nullptr) < 0) {
+            throw std::runtime_error("޷򿪽");
+        }
+
+        // Gray frames are delivered as decoded. Everything else is converted
+        // to BGR; gbrp takes swscale's exact unscaled path.
+        if (track.codec_context->pix_fmt == AV_PIX_FMT_GRAY8) {
+            return;
+        }
+        track.sws_context = sws_getContext(
+                track.codec_context->width, track.codec_context->height,
+                track.codec_context->pix_fmt, track.codec_context->width,
+                track.codec_context->height, AV_PIX_FMT_BGR24, SWS_BILINEAR,
+                nullptr, nullptr, nullptr);
+        if (!track.sws_context) {
+            throw std::runtime_error("޷ʼ֡ʽת");
+        }
+    }
+
+    void Release() {
+        av_frame_free(&decoded_);
+        av_packet_free(&packet_);
+        for (Track& track : tracks_) {
+            ClearPackets(track);
+            sws_freeContext(track.sws_context);
+            track.sws_context = nullptr;
+            avcodec_free_context(&track.codec_context);
+        }
+        avformat_close_input(&format_context_);
+    }
+
+    static void ClearPackets(Track& track) {
+        for (AVPacket* packet : track.packets) {
+            av_packet_free(&packet);
+        }
+        track.packets.clear();
+    }
+
+    // The next packet of `track`, or nullptr at the end of the file. Packets
+    // of the other track are queued for it.
+    AVPacket* NextPacket(Track& track) {
+        if (!track.packets.empty()) {
+            AVPacket* packet = track.packets.front();
+            track.packets.pop_front();
+            return packet;
+        }
+        while (av_read_frame(format_context_, packet_) >= 0) {
+            for (int i = 0; i < track_count_; ++i) {
+                if (packet_->stream_index != tracks_[i].stream_index) {
+                    continue;
+                }
+                AVPacket* packet = av_packet_alloc();
+                if (!packet) {
+                    av_packet_unref(packet_);
+                    throw std::runtime_error("޷ʼƵ֡");
+                }
+                av_packet_move_ref(packet, packet_);
+                if (&tracks_[i] == &track) {
+                    return packet;
+                }
+                tracks_[i].packets.push_back(packet);
+            }
+            av_packet_unref(packet_);
+        }
+        return nullptr;
+    }
+
+    // Reads packets until the decoder of `track` returns a frame. Returns
+    // false at the end of the file.
+    bool ReceiveFrame(Track& track) {
+        while (true) {
+            int ret = avcodec_receive_frame(track.codec_context, decoded_);
+            if (ret == 0) {
+                return true;
+            }
+            if (ret == AVERROR_EOF) {
+                return false;
+            }
+            if (ret != AVERROR(EAGAIN)) {
+                throw std::runtime_error("طƵ֡");
+            }
+
+            AVPacket* packet = NextPacket(track);
+            avcodec_send_packet(track.codec_context, packet);
+            av_packet_free(&packet);
+        }
+    }
+
+    // Called with mutex_ held. Turns decoded_ into an Image and unrefs it.
+    Image TakeImage(const Track& track) {
+        Image image;
+        image.width = decoded_->width;
+        image.height = decoded_->height;
+        if (!track.sws_context) {
+            AVFrame* gray = av_frame_clone(decoded_);
+            av_frame_unref(decoded_);
+            if (!gray) {
+                throw std::runtime_error("޷ʼƵ֡");
+            }
+            image.holder.reset(gray, [](AVFrame* f) { av_frame_free(&f); });
+            image.pixel_format = gray_format_;
+        } else {
+            AVFrame* bgr = av_frame_alloc();
+            if (!bgr) {
+                throw std::runtime_error("޷ʼƵ֡");
+            }
+            image.holder.reset(bgr, [](AVFrame* f) { av_frame_free(&f); });
+            bgr->format = AV_PIX_FMT_BGR24;
+            bgr->width = decoded_->width;
+            bgr->height = decoded_->height;
+            if (av_frame_get_buffer(bgr, 32) < 0) {
+                throw std::runtime_error("޷Ƶ֡ռ");
+            }
+            sws_scale(track.sws_context, decoded_->data, decoded_->linesize,
+                      0, decoded_->height, bgr->data, bgr->linesize);
+            av_frame_unref(decoded_);
+            image.pixel_format = PixelFormat::kBgr8;
+        }
+        image.data = image.holder->data[0];
+        image.stride = image.holder->linesize[0];
+        return image;
+    }
+
+    // Decodes the next image of every track; the left one's pts becomes the
+    // timestamp. Returns false at the end of the file.
+    bool DecodeImages(Image images[2], int64_t& pts) {
+        for (int i = 0; i < track_count_; ++i) {
+            if (!ReceiveFrame(tracks_[i])) {
+                return false;
+            }
+            if (i == kLeft) {
+                pts = decoded_->best_effort_timestamp;
+            }
+            images[i] = TakeImage(tracks_[i]);
+        }
+        return true;
+    }
+
+    void Rewind() {
+        av_seek_frame(format_context_, tracks_[kLeft].stream_index, 0,
+                      AVSEEK_FLAG_BACKWARD);
+        for (int i = 0; i < track_count_; ++i) {
+            ClearPackets(tracks_[i]);
+            avcodec_flush_buffers(tracks_[i].codec_context);
+        }
+        loop_offset_ns_ = last_timestamp_ns_ + frame_duration_ns_;
+    }
+
+    // Called with mutex_ held.
+    void DecodeNext() {
+        Image images[2];
+        int64_t pts = AV_NOPTS_VALUE;
+        if (!DecodeImages(images, pts)) {
+            if (!options_.loop) {
+                throw std::runtime_error("طļѽ");
+            }
+            Rewind();
+            if (!DecodeImages(images, pts)) {
+                throw std::runtime_error("طļûƵ֡");
+            }
+        }
+
+        AVStream* stream =
+                format_context_->streams[tracks_[kLeft].stream_index];
+        int64_t timestamp_ns =
+                pts == AV_NOPTS_VALUE
+                        ? static_cast<int64_t>(frame_index_) *
+                                  frame_duration_ns_
+                        : av_rescale_q(pts, stream->time_base, kNanoseconds);
+        timestamp_ns += loop_offset_ns_;
+        last_timestamp_ns_ = timestamp_ns;
+
+        for (int camera = kLeft; camera <= kRight; ++camera) {
+            // Side by side, both views are strided halves of one image.
+            const Image& image = track_count_ == 2 ? images[camera]
+                                                   : images[kLeft];
+            int width = track_count_ == 2 ? image.width : image.width / 2;
+            CameraFrame frame;
+            frame.block_id = frame_index_;
+            frame.timestamp = static_cast<uint64_t>(timestamp_ns);
+            frame.width = width;
+            frame.height = image.height;
+            frame.pixel_format = image.pixel_format;
+            frame.stride = image.stride;
+            frame.buffer = image.data;
+            if (track_count_ == 1 && camera == kRight) {
+                frame.buffer += width * BytesPerPixel(image.pixel_format);
+            }
+            frame.holder = image.holder;
+            if (grabbing_[camera]) {
+                ready_[camera].push_back(frame);
+            }
+        }
+        ++frame_index_;
+    }
+
+private:
+    ReplayOptions options_;
+
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+    bool grabbing_[2];
+    uint64_t triggers_[2];
+    std::deque<CameraFrame> ready_[2];
+
+    AVFormatContext* format_context_;
+    // One side-by-side track, or a left and a right track.
+    Track tracks_[2];
+    int track_count_;
+    bool gray_;
+    PixelFormat gray_format_;
+    AVPacket* packet_;
+    AVFrame* decoded_;
+
+    uint64_t frame_index_;
+    int64_t loop_offset_ns_;
+    int64_t last_timestamp_ns_;
+    int64_t frame_duration_ns_;
+
+    double free_run_rate_;
+    PeriodicThread free_run_;
+};
+
+class ReplayCameraSource : public CameraSource {
+public:
+    ReplayCameraSource(std::shared_ptr<ReplayRig> rig, int camera)
+            : rig_(rig), camera_(camera) {}
+
+    std::string Name() const override {
+        return camera_ == kLeft ? "replay-left" : "replay-right";
+    }
+
+    void LoadFeatures(const std::string& /*feature_file*/) override {}
+    void SetPixelFormat(PixelFormat pixel_format) override {
+        rig_->SetPixelFormat(pixel_format);
+    }
+    void Configure(CameraRole role, SyncMode sync_mode,
+                   double frame_rate) override {
+        if (role == CameraRole::kMaster && sync_mode == SyncMode::kFreeRun) {
+            rig_->SetFreeRun(frame_rate);
+        }
+    }
+
+    void StartGrabbing() override {
+        rig_->StartGrabbing(camera_);
+    }
+
+    void StopGrabbing() override {
+        rig_->StopGrabbing(camera_);
+    }
+
+    void WaitForFrameTriggerReady(unsigned int /*timeout_ms*/) override {}
+
+    std::chrono::steady_clock::time_point Trigger() override {
+        return rig_->Fire();
+    }
+
+    CameraFrame RetrieveFrame(unsigned int timeout_ms) override {
+        return rig_->Retrieve(camera_, timeout_ms);
+    }
+
+    // The recording's timestamps are converted to ns.
+    double TimestampTickNs() override {
+        return 1.0;
+    }
+
+    // Frames live in AVFrames allocated per decoded image.
+    BufferPoolStats GetBufferStats() const override {
+        return BufferPoolStats();
+    }
+
+    // The recording already has the parameters baked in.
+    CameraParameters GetParameters() override {
+        return parameters_;
+    }
+
+    void SetParameters(const CameraParameters& parameters) override {
+        parameters_ = parameters;
+    }
+
+private:
+    std::shared_ptr<ReplayRig> rig_;
+    int camera_;
+    CameraParameters parameters_;
+};
+}  // namespace
+
+ReplayOptions ParseReplayOptions(const nlohmann::json& config,
+                                 const ReplayOptions& defaults) {
+    ReplayOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    options.file_name = config.value("file", options.file_name);
+    options.loop = config.value("loop", options.loop);
+    return options;
+}
+
+std::pair<std::unique_ptr<CameraSource>, std::unique_ptr<CameraSource>>
+OpenReplayCameras(const ReplayOptions& options) {
+    auto rig = std::make_shared<ReplayRig>(options);
+    std::unique_ptr<CameraSource> left_camera(
+            new ReplayCameraSource(rig, kLeft));
+    std::unique_ptr<CameraSource> right_camera(
+            new ReplayCameraSource(rig, kRight));
+    return std::make_pair(std::move(left_camera), std::move(right_camera));
+}
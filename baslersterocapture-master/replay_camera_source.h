@@ -0,0 +1,32 @@
+#ifndef REPLAY_CAMERA_SOURCE_H_
+#define REPLAY_CAMERA_SOURCE_H_
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "json.hpp"
+
+#include "camera_source.h"
+
+struct ReplayOptions {
+    // A stereo recording as written by VideoRecorder, side by side or as
+    // two tracks.
+    std::string file_name;
+    // Start over at the end of the file instead of failing the grab.
+    bool loop = true;
+};
+
+ReplayOptions ParseReplayOptions(
+        const nlohmann::json& config,
+        const ReplayOptions& defaults = ReplayOptions());
+
+// Feeds a previously recorded stereo file back through SteroCamera. Every
+// left trigger decodes the next frame: the halves of a side-by-side image,
+// or one image of each track, with the frame index as BlockID and the left
+// stream time in ns as timestamp. Color recordings are delivered as BGR8,
+// gray ones as decoded in the configured Mono8 or Bayer format.
+std::pair<std::unique_ptr<CameraSource>, std::unique_ptr<CameraSource>>
+OpenReplayCameras(const ReplayOptions& options);
+
+#endif
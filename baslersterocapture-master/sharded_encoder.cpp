@@ -0,0 +1,404 @@
+#include "sharded_encoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+#include "utils.h"
+
+namespace {
+// Frames waiting per shard while it encodes another.
+const int64_t kFramesPerShard = 2;
+
+// Whether the encoder may hold frames back before their packets come out.
+// The mpegvideo encoders flag a delay only for their B frames.
+bool DelaysOutput(const AVCodec* codec, int max_b_frames) {
+    if (!(codec->capabilities & AV_CODEC_CAP_DELAY)) {
+        return false;
+    }
+    switch (codec->id) {
+        case AV_CODEC_ID_MPEG1VIDEO:
+        case AV_CODEC_ID_MPEG2VIDEO:
+        case AV_CODEC_ID_MPEG4:
+            return max_b_frames > 0;
+        default:
+            return true;
+    }
+}
+}  // namespace
+
+void ShardedEncoder::PacketDeleter::operator()(AVPacket* packet) const {
+    av_packet_free(&packet);
+}
+
+ShardedEncoder::ShardedEncoder()
+        : converter_(nullptr),
+          view_(StereoView::kSideBySide),
+          layout_(YuvLayout::k420),
+          window_(0),
+          closing_(false),
+          next_sequence_(0),
+          unsent_(0),
+          next_write_(0),
+          last_pts_(0),
+          total_ms_(0.0) {}
+
+ShardedEncoder::~ShardedEncoder() {
+    try {
+        Close();
+    } catch (...) {
+    }
+}
+
+void ShardedEncoder::Open(const AVCodec* codec, int width, int height,
+                          double fps, int64_t bit_rate, bool global_header,
+                          const EncoderOptions& options, StereoView view,
+                          YuvConverter* converter, PacketWriter write) {
+    Close();
+    write_ = std::move(write);
+    converter_ = converter;
+    view_ = view;
+    layout_ = YuvLayoutOf(options.pixel_format);
+    affinity_ = options.affinity;
+
+    // Shards are written in turn, one packet each, so a codec that holds
+    // frames back would stall the other shards until its flush.
+    if (options.shards > 1 && DelaysOutput(codec, options.max_b_frames)) {
+        throw std::runtime_error(std::string(" ") + codec->name +
+                                 " ӳ, ܷƬб");
+    }
+    try {
+        for (int i = 0; i < options.shards; ++i) {
+            std::unique_ptr<Shard> shard(new Shard());
+            shard->index = i;
+            shard->context = OpenEncoder(codec, width, height, fps, bit_rate,
+                                         global_header, options);
+            shards_.push_back(std::move(shard));
+            Shard* opened = shards_.back().get();
+            // Shards only work if every frame can be decoded on its own.
+            if (options.shards > 1 && (opened->context->gop_size > 1 ||
+                                       opened->context->max_b_frames > 0)) {
+                throw std::runtime_error("ֻȫ֡ڱܷƬб");
+            }
+
+            opened->frame = av_frame_alloc();
+            opened->packet = av_packet_alloc();
+            if (!opened->frame || !opened->packet) {
+                throw std::runtime_error("޷ʼƵ֡");
+            }
+            opened->frame->format = opened->context->pix_fmt;
+            opened->frame->width = width;
+            opened->frame->height = height;
+            if (av_frame_get_buffer(opened->frame, 32) < 0) {
+                throw std::runtime_error("޷Ƶ֡ռ");
+            }
+        }
+    } catch (...) {
+        Free();
+        throw;
+    }
+
+    // Only frames not yet sent are bounded: encoders release a frame's
+    // packet after a delay of their own (frame threads, lookahead, B
+    // frames), which must never depend on the next Submit().
+    const AVCodecContext* context = shards_.front()->context;
+    window_ = options.shards * kFramesPerShard;
+
+    closing_ = false;
+    error_ = nullptr;
+    next_sequence_ = 0;
+    unsent_ = 0;
+    next_write_ = 0;
+    pts_.clear();
+    last_pts_ = 0;
+    stats_ = EncoderStats();
+    stats_.profile = options.profile;
+    stats_.codec = codec->name;
+    stats_.pixel_format = context->pix_fmt;
+    stats_.shards = options.shards;
+    stats_.threads = context->thread_count;
+    stats_.thread_type = context->active_thread_type;
+    total_ms_ = 0.0;
+
+    for (auto& shard : shards_) {
+        Shard* running = shard.get();
+        running->thread = std::thread([this, running]() { Run(running); });
+    }
+}
+
+void ShardedEncoder::Close() {
+    if (shards_.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    for (auto& shard : shards_) {
+        shard->job_added.notify_all();
+    }
+    for (auto& shard : shards_) {
+        shard->thread.join();
+    }
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        std::lock_guard<std::mutex> state_lock(mutex_);
+        error = error_;
+        // Only left over if an encoder dropped a frame; keep their order.
+        if (!error) {
+            for (auto& entry : reorder_) {
+                SetOutputTimestamps(entry.second.get());
+                write_(entry.second.get());
+            }
+        }
+        reorder_.clear();
+        pts_.clear();
+    }
+    Free();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ShardedEncoder::Submit(const StereoFrame& frame, int64_t pts) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!error_ && unsent_ >= window_) {
+        ++stats_.window_waits;
+        window_space_.wait(lock,
+                           [this]() { return error_ || unsent_ < window_; });
+    }
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+
+    if (next_sequence_ > 0 && pts <= last_pts_) {
+        pts = last_pts_ + 1;
+        ++stats_.pts_adjusted;
+    }
+    last_pts_ = pts;
+    pts_[next_sequence_] = pts;
+
+    Shard* shard = shards_[next_sequence_ % shards_.size()].get();
+    Job job;
+    job.frame = frame;
+    job.sequence = next_sequence_++;
+    ++unsent_;
+    shard->jobs.push_back(std::move(job));
+    shard->job_added.notify_one();
+}
+
+const AVCodecContext* ShardedEncoder::GetContext() const {
+    return shards_.empty() ? nullptr : shards_.front()->context;
+}
+
+EncoderStats ShardedEncoder::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void ShardedEncoder::Run(Shard* shard) {
+    if (!affinity_.empty() && !SetCurrentThreadAffinity(affinity_)) {
+        std::cerr << "޷ñ̵߳CPU׺" << std::endl;
+    }
+    try {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                shard->job_added.wait(lock, [this, shard]() {
+                    return closing_ || error_ || !shard->jobs.empty();
+                });
+                if (error_) {
+                    return;
+                }
+                if (shard->jobs.empty()) {
+                    break;
+                }
+                job = std::move(shard->jobs.front());
+                shard->jobs.pop_front();
+            }
+            EncodeJob(shard, &job);
+        }
+        EncodeJob(shard, nullptr);
+    } catch (...) {
+        Fail(std::current_exception());
+    }
+}
+
+void ShardedEncoder::EncodeJob(Shard* shard, const Job* job) {
+    AVFrame* frame = nullptr;
+    if (job) {
+        if (av_frame_make_writable(shard->frame) < 0) {
+            throw std::runtime_error("׼дƵ֡");
+        }
+        const StereoFrame& stereo = job->frame;
+        const CameraFrame& half =
+                view_ == StereoView::kRight ? stereo.right : stereo.left;
+        int width = view_ == StereoView::kSideBySide ? stereo.width
+                                                      : half.width;
+        if (width != shard->frame->width ||
+            stereo.height != shard->frame->height) {
+            throw std::runtime_error("ͼߴƵߴ粻һ");
+        }
+        if (view_ == StereoView::kSideBySide) {
+            converter_->Convert(stereo, layout_, shard->frame->data,
+                                shard->frame->linesize);
+        } else {
+            converter_->Convert(half, layout_, shard->frame->data,
+                                shard->frame->linesize);
+        }
+        shard->frame->pts = job->sequence;
+        frame = shard->frame;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int ret = avcodec_send_frame(shard->context, frame);
+    if (ret < 0) {
+        throw std::runtime_error("Ƶ֡");
+    }
+    if (job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --unsent_;
+        }
+        window_space_.notify_all();
+    }
+    std::vector<PacketPtr> packets;
+    while (true) {
+        ret = avcodec_receive_packet(shard->context, shard->packet);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            break;
+        } else if (ret < 0) {
+            throw std::runtime_error("Ƶ֡");
+        }
+        PacketPtr packet(av_packet_alloc());
+        if (!packet) {
+            throw std::runtime_error("޷ʼƵݰ");
+        }
+        av_packet_move_ref(packet.get(), shard->packet);
+        packets.push_back(std::move(packet));
+    }
+    double elapsed_ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+
+    if (job) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.frames;
+        total_ms_ += elapsed_ms;
+        stats_.mean_ms = total_ms_ / stats_.frames;
+        stats_.max_ms = std::max(stats_.max_ms, elapsed_ms);
+    }
+    for (auto& packet : packets) {
+        Deliver(shard, std::move(packet));
+    }
+}
+
+void ShardedEncoder::Deliver(Shard* shard, PacketPtr packet) {
+    // Each shard's packets come in its decode order, which with several
+    // shards is one per frame and with one may differ from the frame order.
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t position = static_cast<int64_t>(shard->index) +
+                           shard->packets++ * shards_.size();
+        reorder_[position] = std::move(packet);
+        stats_.reorder_high_water_mark =
+                std::max(stats_.reorder_high_water_mark, reorder_.size());
+    }
+
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    std::vector<PacketPtr> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = reorder_.find(next_write_); it != reorder_.end();
+             it = reorder_.find(next_write_)) {
+            stats_.bytes += it->second->size;
+            SetOutputTimestamps(it->second.get());
+            ready.push_back(std::move(it->second));
+            reorder_.erase(it);
+            ++next_write_;
+        }
+    }
+    for (auto& ready_packet : ready) {
+        write_(ready_packet.get());
+    }
+}
+
+void ShardedEncoder::SetOutputTimestamps(AVPacket* packet) {
+    // Encoders with a delay start dts before the first frame; those stay
+    // below the first pts, one tick per frame.
+    auto first = pts_.begin();
+    auto output_pts = [this, first](int64_t sequence) {
+        auto it = pts_.find(sequence);
+        return it != pts_.end() ? it->second
+                                : first->second - (first->first - sequence);
+    };
+    int64_t dts = packet->dts == AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    packet->pts = output_pts(packet->pts);
+    packet->dts = output_pts(dts);
+    // Counted in frames, which the writer's time base need not be.
+    packet->duration = 0;
+    // Later packets have dts no older than this one.
+    pts_.erase(pts_.begin(), pts_.lower_bound(dts));
+}
+
+void ShardedEncoder::Fail(std::exception_ptr error) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) {
+            error_ = error;
+        }
+    }
+    for (auto& shard : shards_) {
+        shard->job_added.notify_all();
+    }
+    window_space_.notify_all();
+}
+
+void ShardedEncoder::Free() {
+    for (auto& shard : shards_) {
+        avcodec_free_context(&shard->context);
+        av_frame_free(&shard->frame);
+        av_packet_free(&shard->packet);
+    }
+    shards_.clear();
+}
+
+EncoderRate MeasureShardedEncoderRate(const AVCodec* codec, int width,
+                                      int height, double fps,
+                                      int64_t bit_rate,
+                                      const EncoderOptions& options,
+                                      int frames) {
+    std::vector<EncoderRate> rates(options.shards);
+    std::vector<std::exception_ptr> errors(options.shards);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < options.shards; ++i) {
+        threads.emplace_back([&, i]() {
+            try {
+                rates[i] = MeasureEncoderRate(codec, width, height, fps,
+                                              bit_rate, options, frames);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    EncoderRate total;
+    for (const EncoderRate& rate : rates) {
+        total.fps += rate.fps;
+        total.bytes_per_frame += rate.bytes_per_frame / rates.size();
+    }
+    return total;
+}
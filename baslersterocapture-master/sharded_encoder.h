@@ -0,0 +1,136 @@
+#ifndef SHARDED_ENCODER_H_
+#define SHARDED_ENCODER_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "stereo_frame.h"
+#include "video_encoder.h"
+#include "yuv_converter.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Encodes an all-intra stream on several independent encoders at once.
+// Frame i goes to shard i % N, which converts it to YUV and encodes it on
+// its own thread, and the packets are put back in frame order before they
+// are written. Only a fixed number of frames wait for a shard; what the
+// encoders hold back themselves is theirs to release, so codecs that delay
+// their output only run on a single shard. The encoders number the frames;
+// the packets leave with the pts given to Submit(), and dts mapped the
+// same way.
+class ShardedEncoder {
+public:
+    using PacketWriter = std::function<void(AVPacket* packet)>;
+
+    ShardedEncoder();
+    ~ShardedEncoder();
+
+    ShardedEncoder(const ShardedEncoder&) = delete;
+    ShardedEncoder& operator=(const ShardedEncoder&) = delete;
+
+public:
+    // Opens options.shards encoders like OpenEncoder() for the `view` of the
+    // submitted frames. `write` gets the packets in frame order, one at a
+    // time, on the shard threads. `converter` must outlive Close().
+    void Open(const AVCodec* codec, int width, int height, double fps,
+              int64_t bit_rate, bool global_header,
+              const EncoderOptions& options, StereoView view,
+              YuvConverter* converter, PacketWriter write);
+    // Flushes the encoders and writes the packets still held back.
+    // Rethrows the first error of a shard.
+    void Close();
+
+    // `pts` is what the frame's packets carry, in the time base `write`
+    // expects, e.g. the frame count; one that does not increase is moved
+    // just past the last one. Blocks while the shards have enough frames
+    // waiting. Rethrows the first error of a shard.
+    void Submit(const StereoFrame& frame, int64_t pts);
+
+    // Shard 0's context, for the stream parameters; all shards match.
+    const AVCodecContext* GetContext() const;
+
+    EncoderStats GetStats() const;
+
+private:
+    struct Job {
+        StereoFrame frame;
+        int64_t sequence = 0;
+    };
+
+    struct Shard {
+        size_t index = 0;
+        // Packets this shard has delivered.
+        int64_t packets = 0;
+        AVCodecContext* context = nullptr;
+        AVFrame* frame = nullptr;
+        AVPacket* packet = nullptr;
+        std::deque<Job> jobs;
+        std::condition_variable job_added;
+        std::thread thread;
+    };
+
+    struct PacketDeleter {
+        void operator()(AVPacket* packet) const;
+    };
+    using PacketPtr = std::unique_ptr<AVPacket, PacketDeleter>;
+
+    void Run(Shard* shard);
+    // nullptr flushes the shard.
+    void EncodeJob(Shard* shard, const Job* job);
+    void Deliver(Shard* shard, PacketPtr packet);
+    // Replaces the frame numbers in the packet's pts and dts with the pts
+    // they were submitted with. Called with mutex_ held, in write order.
+    void SetOutputTimestamps(AVPacket* packet);
+    void Fail(std::exception_ptr error);
+    void Free();
+
+private:
+    PacketWriter write_;
+    YuvConverter* converter_;
+    StereoView view_;
+    YuvLayout layout_;
+    std::vector<int> affinity_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    // Frames submitted but not yet sent to an encoder.
+    int64_t window_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable window_space_;
+    bool closing_;
+    std::exception_ptr error_;
+    int64_t next_sequence_;
+    int64_t unsent_;
+    // Packets by write order: shard s's packet k is the (s + k * N)th.
+    int64_t next_write_;
+    std::map<int64_t, PacketPtr> reorder_;
+    // Submitted pts by frame number, from the oldest dts still to come.
+    std::map<int64_t, int64_t> pts_;
+    int64_t last_pts_;
+    EncoderStats stats_;
+    double total_ms_;
+
+    // Held while packets are taken out of reorder_ and written, so they
+    // reach `write_` in order.
+    std::mutex write_mutex_;
+};
+
+// Runs MeasureEncoderRate() on options.shards threads at once and returns
+// the frames/s of all shards together.
+EncoderRate MeasureShardedEncoderRate(const AVCodec* codec, int width,
+                                      int height, double fps,
+                                      int64_t bit_rate,
+                                      const EncoderOptions& options,
+                                      int frames);
+
+#endif
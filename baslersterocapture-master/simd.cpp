@@ -0,0 +1,98 @@
+#include "simd.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef SIMD_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+#ifdef SIMD_X86
+void Cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+    int values[4];
+    __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; ++i) {
+        regs[i] = static_cast<unsigned int>(values[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state the OS saves on context switches.
+uint64_t EnabledXsaveFeatures() {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+SimdLevel Detect() {
+    unsigned int regs[4];
+    Cpuid(0, 0, regs);
+    unsigned int max_leaf = regs[0];
+
+    Cpuid(1, 0, regs);
+    bool ssse3 = (regs[2] & (1u << 9)) != 0;
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    bool avx = (regs[2] & (1u << 28)) != 0;
+    if (!ssse3) {
+        return SimdLevel::kScalar;
+    }
+    // AVX registers must be saved by the OS (XMM and YMM state).
+    if (!osxsave || !avx || (EnabledXsaveFeatures() & 0x6) != 0x6 ||
+        max_leaf < 7) {
+        return SimdLevel::kSsse3;
+    }
+    Cpuid(7, 0, regs);
+    bool avx2 = (regs[1] & (1u << 5)) != 0;
+    return avx2 ? SimdLevel::kAvx2 : SimdLevel::kSsse3;
+}
+#else
+SimdLevel Detect() {
+    return SimdLevel::kScalar;
+}
+#endif
+}  // namespace
+
+SimdLevel DetectSimdLevel() {
+    static const SimdLevel level = Detect();
+    return level;
+}
+
+SimdLevel ParseSimdLevel(const std::string& name) {
+    SimdLevel level;
+    if (name == "auto") {
+        return DetectSimdLevel();
+    } else if (name == "avx2") {
+        level = SimdLevel::kAvx2;
+    } else if (name == "ssse3") {
+        level = SimdLevel::kSsse3;
+    } else if (name == "scalar") {
+        level = SimdLevel::kScalar;
+    } else {
+        throw std::runtime_error("δ֪SIMDָ: " + name);
+    }
+    return std::min(level, DetectSimdLevel());
+}
+
+std::string SimdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::kAvx2:
+            return "avx2";
+        case SimdLevel::kSsse3:
+            return "ssse3";
+        default:
+            return "scalar";
+    }
+}
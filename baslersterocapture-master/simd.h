@@ -0,0 +1,30 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include <string>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || \
+        defined(__i386__)
+#define SIMD_X86 1
+#endif
+
+// Lets one translation unit hold kernels for several instruction sets;
+// callers pick one at run time with DetectSimdLevel(). MSVC compiles the
+// intrinsics without per-function targets.
+#if defined(__GNUC__)
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_TARGET(isa)
+#endif
+
+enum class SimdLevel { kScalar, kSsse3, kAvx2 };
+
+// Best level the CPU and the OS support.
+SimdLevel DetectSimdLevel();
+
+// "auto" (the detected level), "avx2", "ssse3" or "scalar". Never returns a
+// level above the detected one.
+SimdLevel ParseSimdLevel(const std::string& name);
+std::string SimdLevelName(SimdLevel level);
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef SPMC_RING_H_
+#define SPMC_RING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// Fixed-capacity ring with a single producer and any number of consumers.
+// TryPush must only ever run on one thread at a time; TryPop may run on
+// several at once. CaptureQueue relies on this: its producer evicts the
+// oldest entry with TryPop while the consumer thread is popping.
+//
+// A pop claims the head with a CAS and owns the slot until it bumps the
+// slot's sequence number. A push that reaches a claimed but unreleased slot
+// fails as if the ring were full. The producer keeps a private copy of the
+// head and only reloads it when the ring looks full; consumers find the
+// filled slots from the sequence numbers instead of the tail. Size() and
+// friends are snapshots and may be stale by the time they return.
+template <typename T>
+class SpmcRing {
+public:
+    explicit SpmcRing(size_t capacity = 16);
+    ~SpmcRing() = default;
+
+    SpmcRing(const SpmcRing&) = delete;
+    SpmcRing& operator=(const SpmcRing&) = delete;
+
+public:
+    // Producer side.
+    bool TryPush(const T& value);
+    bool TryPush(T&& value);
+
+    // Any thread, the producer included. The slot is reset to T() so that
+    // ref-counted payloads (e.g. grab results) are released as soon as they
+    // leave the ring.
+    bool TryPop(T& value);
+
+    // Clears the ring and changes its capacity. Only valid while neither
+    // side is running.
+    void Reset(size_t capacity);
+    void Reset();
+
+    bool Empty() const;
+    bool Full() const;
+    size_t Size() const;
+    size_t Capacity() const;
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static const size_t kCacheLineSize = 64;
+
+    alignas(kCacheLineSize) std::atomic<size_t> head_;
+    alignas(kCacheLineSize) std::atomic<size_t> tail_;
+    size_t cached_head_;
+
+    alignas(kCacheLineSize) size_t capacity_;
+    size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+};
+
+namespace internal {
+inline size_t RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+}  // namespace internal
+
+template <typename T>
+SpmcRing<T>::SpmcRing(size_t capacity)
+        : head_(0), tail_(0), cached_head_(0), capacity_(0), mask_(0) {
+    Reset(capacity);
+}
+
+template <typename T>
+bool SpmcRing<T>::TryPush(const T& value) {
+    T copy(value);
+    return TryPush(std::move(copy));
+}
+
+template <typename T>
+bool SpmcRing<T>::TryPush(T&& value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ >= capacity_) {
+        cached_head_ = head_.load(std::memory_order_acquire);
+        if (tail - cached_head_ >= capacity_) {
+            return false;
+        }
+    }
+    Slot& slot = slots_[tail & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) != tail) {
+        // A pop has claimed the head but not yet released the slot.
+        return false;
+    }
+    slot.value = std::move(value);
+    slot.sequence.store(tail + 1, std::memory_order_release);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+bool SpmcRing<T>::TryPop(T& value) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots_[head & mask_];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<ptrdiff_t>(sequence - (head + 1));
+        if (diff < 0) {
+            return false;
+        }
+        if (diff == 0 && head_.compare_exchange_weak(
+                                 head, head + 1, std::memory_order_acq_rel,
+                                 std::memory_order_relaxed)) {
+            break;
+        }
+        if (diff > 0) {
+            head = head_.load(std::memory_order_relaxed);
+        }
+    }
+    value = std::move(slot->value);
+    slot->value = T();
+    slot->sequence.store(head + mask_ + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+void SpmcRing<T>::Reset(size_t capacity) {
+    capacity_ = capacity < 1 ? 1 : capacity;
+    mask_ = internal::RoundUpToPowerOfTwo(capacity_) - 1;
+    slots_.reset(new Slot[mask_ + 1]);
+    Reset();
+}
+
+template <typename T>
+void SpmcRing<T>::Reset() {
+    for (size_t i = 0; i <= mask_; ++i) {
+        slots_[i].sequence.store(i);
+        slots_[i].value = T();
+    }
+    head_.store(0);
+    tail_.store(0);
+    cached_head_ = 0;
+}
+
+template <typename T>
+bool SpmcRing<T>::Empty() const {
+    return Size() == 0;
+}
+
+template <typename T>
+bool SpmcRing<T>::Full() const {
+    return Size() >= capacity_;
+}
+
+template <typename T>
+size_t SpmcRing<T>::Size() const {
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    return tail - head;
+}
+
+template <typename T>
+size_t SpmcRing<T>::Capacity() const {
+    return capacity_;
+}
+
+#endif
@@ -0,0 +1,212 @@
+#include "stereo_frame.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+const int kLeft = 0;
+const int kRight = 1;
+// Half-filled frames kept while waiting for the other camera.
+const size_t kMaxPending = 4;
+const size_t kRowAlignment = 64;
+}  // namespace
+
+bool StereoFrame::IsValid() const {
+    return buffer != nullptr;
+}
+
+std::ostream& operator<<(std::ostream& os, const StereoFrameStats& stats) {
+    os << "in place " << stats.in_place << ", copied " << stats.copied
+       << ", " << stats.pool;
+    return os;
+}
+
+StereoFrameAssembler::StereoFrameAssembler(const FramePoolOptions& options)
+        : options_(options),
+          pool_(options),
+          demosaic_(true),
+          pending_(kMaxPending),
+          sequence_(0) {}
+
+void StereoFrameAssembler::Configure(const FramePoolOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    options_ = options;
+    pool_.Configure(options);
+    pending_.assign(kMaxPending, Composite());
+}
+
+void StereoFrameAssembler::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.assign(kMaxPending, Composite());
+}
+
+CameraFrame StereoFrameAssembler::PlaceLeft(const CameraFrame& frame,
+                                            uint64_t key) {
+    return Place(frame, key, kLeft);
+}
+
+CameraFrame StereoFrameAssembler::PlaceRight(const CameraFrame& frame,
+                                             uint64_t key) {
+    return Place(frame, key, kRight);
+}
+
+CameraFrame StereoFrameAssembler::Place(const CameraFrame& frame, uint64_t key,
+                                        int side) {
+    if (!frame.IsValid()) {
+        return frame;
+    }
+
+    Composite composite;
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = std::find_if(pending_.begin(), pending_.end(),
+                               [key](const Composite& pending) {
+                                   return pending.used && pending.key == key;
+                               });
+        if (it != pending_.end()) {
+            if (it->placed[side] || it->half_width != frame.width ||
+                it->height != frame.height ||
+                it->pixel_format != frame.pixel_format) {
+                return frame;
+            }
+            // The other half is in; this buffer is complete after the copy.
+            composite = std::move(*it);
+            *it = Composite();
+            break;
+        }
+        if (composite.buffer) {
+            // Keep the newest pending frames.
+            auto slot = std::min_element(
+                    pending_.begin(), pending_.end(),
+                    [](const Composite& a, const Composite& b) {
+                        return a.used == b.used ? a.sequence < b.sequence
+                                                : !a.used;
+                    });
+            composite.used = true;
+            composite.key = key;
+            composite.sequence = ++sequence_;
+            composite.placed[side] = true;
+            *slot = composite;
+            break;
+        }
+        lock.unlock();
+
+        // A grab thread must not wait; Compose() copies the pair instead.
+        composite = NewComposite(frame, std::chrono::milliseconds(0));
+        if (!composite.buffer) {
+            return frame;
+        }
+    }
+    return CopyInto(frame, composite, side);
+}
+
+StereoFrame StereoFrameAssembler::Compose(const CameraFrame& left,
+                                          const CameraFrame& right) {
+    size_t half_bytes = left.width * BytesPerPixel(left.pixel_format);
+
+    StereoFrame stereo_frame;
+    if (left.holder && left.holder == right.holder &&
+        left.stride == right.stride &&
+        left.buffer + half_bytes == right.buffer) {
+        stereo_frame.left = left;
+        stereo_frame.right = right;
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.in_place;
+    } else {
+        if (left.width != right.width || left.height != right.height ||
+            OutputFormat(left.pixel_format) !=
+                    OutputFormat(right.pixel_format)) {
+            throw std::runtime_error("ͼߴʽһ");
+        }
+        std::chrono::milliseconds timeout;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            timeout = std::chrono::milliseconds(options_.acquire_timeout_ms);
+        }
+        auto composite = NewComposite(left, timeout);
+        if (!composite.buffer) {
+            return stereo_frame;
+        }
+        stereo_frame.left = CopyInto(left, composite, kLeft);
+        stereo_frame.right = CopyInto(right, composite, kRight);
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.copied;
+    }
+
+    stereo_frame.width = left.width * 2;
+    stereo_frame.height = left.height;
+    stereo_frame.pixel_format = stereo_frame.left.pixel_format;
+    stereo_frame.stride = stereo_frame.left.stride;
+    stereo_frame.buffer = stereo_frame.left.buffer;
+    stereo_frame.holder = stereo_frame.left.holder;
+    return stereo_frame;
+}
+
+void StereoFrameAssembler::ConfigureDemosaic(const DemosaicOptions& options) {
+    demosaicer_.Configure(options);
+    demosaic_ = options.enabled;
+}
+
+DemosaicStats StereoFrameAssembler::GetDemosaicStats() const {
+    return demosaicer_.GetStats();
+}
+
+StereoFrameStats StereoFrameAssembler::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    StereoFrameStats stats = stats_;
+    stats.pool = pool_.GetStats();
+    return stats;
+}
+
+StereoFrameAssembler::Composite StereoFrameAssembler::NewComposite(
+        const CameraFrame& frame, std::chrono::milliseconds timeout) {
+    size_t bytes_per_pixel = BytesPerPixel(OutputFormat(frame.pixel_format));
+    size_t stride = (frame.width * 2 * bytes_per_pixel + kRowAlignment - 1) /
+                    kRowAlignment * kRowAlignment;
+    size_t size = stride * frame.height;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pool_.BufferSize() < size) {
+            pool_.Reserve(size);
+        }
+    }
+
+    Composite composite;
+    composite.buffer = pool_.Acquire(size, timeout);
+    composite.stride = stride;
+    composite.half_width = frame.width;
+    composite.height = frame.height;
+    composite.pixel_format = frame.pixel_format;
+    return composite;
+}
+
+PixelFormat StereoFrameAssembler::OutputFormat(
+        PixelFormat pixel_format) const {
+    return demosaic_ && IsBayer(pixel_format) ? PixelFormat::kBgr8
+                                              : pixel_format;
+}
+
+CameraFrame StereoFrameAssembler::CopyInto(const CameraFrame& frame,
+                                           const Composite& composite,
+                                           int side) {
+    PixelFormat pixel_format = OutputFormat(frame.pixel_format);
+    size_t row_bytes = frame.width * BytesPerPixel(pixel_format);
+    uint8_t* destination = composite.buffer.get() + side * row_bytes;
+    if (pixel_format != frame.pixel_format) {
+        demosaicer_.Process(frame, destination, composite.stride);
+    } else {
+        for (int y = 0; y < frame.height; ++y) {
+            std::memcpy(destination + y * composite.stride,
+                        frame.buffer + y * frame.stride, row_bytes);
+        }
+    }
+
+    CameraFrame placed = frame;
+    placed.pixel_format = pixel_format;
+    placed.buffer = destination;
+    placed.stride = composite.stride;
+    placed.holder = composite.buffer;
+    return placed;
+}
@@ -0,0 +1,119 @@
+#ifndef STEREO_FRAME_H_
+#define STEREO_FRAME_H_
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "camera_source.h"
+#include "demosaic.h"
+#include "frame_pool.h"
+
+// A side-by-side stereo image: every row holds the left image followed by
+// the right one. `left` and `right` are strided views into `buffer`, and all
+// three keep `holder`, a FramePool handle, alive.
+struct StereoFrame {
+    CameraFrame left;
+    CameraFrame right;
+    int width = 0;
+    int height = 0;
+    PixelFormat pixel_format = PixelFormat::kUnknown;
+    size_t stride = 0;
+    uint8_t* buffer = nullptr;
+    std::shared_ptr<void> holder;
+
+    bool IsValid() const;
+};
+
+// The part of a StereoFrame that a consumer, such as a video track, takes.
+enum class StereoView {
+    kSideBySide,
+    kLeft,
+    kRight,
+};
+
+struct StereoFrameStats {
+    // Pairs whose halves the grab threads had already placed side by side.
+    uint64_t in_place = 0;
+    // Pairs the consumer had to copy together.
+    uint64_t copied = 0;
+    FramePoolStats pool;
+};
+
+std::ostream& operator<<(std::ostream& os, const StereoFrameStats& stats);
+
+// Builds StereoFrames without a copy on the consumer thread. Each grab
+// thread copies its frame once, with a strided copy, into its half of a
+// side-by-side FramePool buffer chosen by BlockID, and releases the camera
+// buffer right away. Compose() then only wraps the two halves. Pairs that
+// were not placed together (timestamp matching, mismatched sizes, no free
+// frame on the grab thread) are copied by Compose() instead. Unless
+// disabled, Bayer frames are demosaiced into their half instead of copied.
+class StereoFrameAssembler {
+public:
+    explicit StereoFrameAssembler(
+            const FramePoolOptions& options = FramePoolOptions());
+    ~StereoFrameAssembler() = default;
+
+    StereoFrameAssembler(const StereoFrameAssembler&) = delete;
+    StereoFrameAssembler& operator=(const StereoFrameAssembler&) = delete;
+
+public:
+    // The pool is sized by the first pair.
+    void Configure(const FramePoolOptions& options);
+    // Not while frames are placed or composed.
+    void ConfigureDemosaic(const DemosaicOptions& options);
+    // Forgets half-filled buffers.
+    void Reset();
+
+    // Grab threads. Returns the frame as a view into its half of the buffer
+    // for `key`, or `frame` itself if it cannot be placed.
+    CameraFrame PlaceLeft(const CameraFrame& frame, uint64_t key);
+    CameraFrame PlaceRight(const CameraFrame& frame, uint64_t key);
+
+    // Consumer thread. If it has to copy, waits for a free frame and returns
+    // an invalid StereoFrame when none is released in time.
+    StereoFrame Compose(const CameraFrame& left, const CameraFrame& right);
+
+    StereoFrameStats GetStats() const;
+    DemosaicStats GetDemosaicStats() const;
+
+private:
+    // A side-by-side frame waiting for the other camera's half.
+    struct Composite {
+        bool used = false;
+        uint64_t key = 0;
+        uint64_t sequence = 0;
+        std::shared_ptr<uint8_t> buffer;
+        size_t stride = 0;
+        int half_width = 0;
+        int height = 0;
+        PixelFormat pixel_format = PixelFormat::kUnknown;
+        bool placed[2] = {false, false};
+    };
+
+    CameraFrame Place(const CameraFrame& frame, uint64_t key, int side);
+    Composite NewComposite(const CameraFrame& frame,
+                           std::chrono::milliseconds timeout);
+    // Format of a camera frame once placed in a StereoFrame.
+    PixelFormat OutputFormat(PixelFormat pixel_format) const;
+    CameraFrame CopyInto(const CameraFrame& frame, const Composite& composite,
+                         int side);
+
+private:
+    FramePoolOptions options_;
+    FramePool pool_;
+    Demosaicer demosaicer_;
+    bool demosaic_;
+
+    mutable std::mutex mutex_;
+    // Fixed slots, so placing a frame does not allocate.
+    std::vector<Composite> pending_;
+    uint64_t sequence_;
+    StereoFrameStats stats_;
+};
+
+#endif
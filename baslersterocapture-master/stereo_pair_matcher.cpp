@@ -0,0 +1,45 @@
+#include "stereo_pair_matcher.h"
+
+#include <stdexcept>
+
+PairMatchMode ParsePairMatchMode(const std::string& name) {
+    if (name == "block_id") {
+        return PairMatchMode::kBlockId;
+    }
+    if (name == "timestamp") {
+        return PairMatchMode::kTimestamp;
+    }
+    throw std::runtime_error("δ֪ͼԷʽ: " + name);
+}
+
+PairMatcherOptions ParsePairMatcherOptions(
+        const nlohmann::json& config, const PairMatcherOptions& defaults) {
+    PairMatcherOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    if (config.count("mode")) {
+        options.mode = ParsePairMatchMode(config["mode"]);
+    }
+    if (config.count("window")) {
+        options.window = config["window"];
+    }
+    if (config.count("timestamp_tolerance")) {
+        options.timestamp_tolerance = config["timestamp_tolerance"];
+    }
+    if (config.count("timestamp_offset")) {
+        const auto& offset = config["timestamp_offset"];
+        options.auto_offset = offset.is_string() && offset == "auto";
+        if (!options.auto_offset) {
+            options.timestamp_offset = offset;
+        }
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const PairMatcherStats& stats) {
+    os << "pairs " << stats.pairs << ", left orphans " << stats.left_orphans
+       << ", right orphans " << stats.right_orphans << ", reordered "
+       << stats.reordered << ", timestamp offset " << stats.timestamp_offset;
+    return os;
+}
@@ -0,0 +1,291 @@
+#ifndef STEREO_PAIR_MATCHER_H_
+#define STEREO_PAIR_MATCHER_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "json.hpp"
+
+enum class PairMatchMode {
+    kBlockId,    // frames pair when their BlockIDs are equal
+    kTimestamp,  // frames pair when their camera timestamps are close enough
+};
+
+PairMatchMode ParsePairMatchMode(const std::string& name);
+
+struct PairMatcherOptions {
+    PairMatchMode mode = PairMatchMode::kBlockId;
+    // Frames kept per camera while waiting for a partner.
+    size_t window = 8;
+    // Largest |left - (right - offset)| accepted in kTimestamp mode, in
+    // camera timestamp ticks.
+    int64_t timestamp_tolerance = 1000000;
+    // Right minus left clock offset. With auto_offset the first frames seen
+    // seed it and every matched pair refines it, which also follows slow
+    // drift between two free-running camera clocks.
+    int64_t timestamp_offset = 0;
+    bool auto_offset = true;
+};
+
+// Reads {"mode": "block_id"|"timestamp", "window": N,
+// "timestamp_tolerance": T, "timestamp_offset": O|"auto"}.
+PairMatcherOptions ParsePairMatcherOptions(
+        const nlohmann::json& config,
+        const PairMatcherOptions& defaults = PairMatcherOptions());
+
+struct PairMatcherStats {
+    uint64_t pairs = 0;
+    uint64_t left_orphans = 0;
+    uint64_t right_orphans = 0;
+    uint64_t reordered = 0;
+    int64_t timestamp_offset = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, const PairMatcherStats& stats);
+
+// Pairs two per-camera frame streams. Each camera keeps a small window
+// sorted by key; the heads of both windows are compared like a merge, so a
+// frame either pairs with the other head or is provably unmatched and is
+// discarded as an orphan. Amortised cost is O(1) per frame and no memory is
+// allocated after construction. Not thread-safe: feed and drain it from
+// one thread.
+template <typename Frame>
+class StereoPairMatcher {
+public:
+    explicit StereoPairMatcher(
+            const PairMatcherOptions& options = PairMatcherOptions());
+    ~StereoPairMatcher() = default;
+
+public:
+    void Configure(const PairMatcherOptions& options);
+    void Reset();
+
+    void AddLeft(uint64_t block_id, uint64_t timestamp, Frame frame);
+    void AddRight(uint64_t block_id, uint64_t timestamp, Frame frame);
+
+    // Returns the oldest matched pair, if any.
+    bool PopPair(Frame& left, Frame& right);
+
+    size_t LeftPending() const;
+    size_t RightPending() const;
+
+    PairMatcherStats GetStats() const;
+
+private:
+    struct Entry {
+        int64_t key = 0;
+        Frame frame;
+    };
+
+    class Window {
+    public:
+        void Reset(size_t capacity);
+        bool Empty() const;
+        bool Full() const;
+        size_t Size() const;
+        Entry& Front();
+        void PopFront();
+        // Returns true if the entry had to be inserted before the back.
+        bool Insert(int64_t key, Frame frame);
+
+    private:
+        Entry& At(size_t index);
+
+        std::vector<Entry> entries_;
+        size_t head_ = 0;
+        size_t size_ = 0;
+    };
+
+    void Add(Window& window, uint64_t& orphans, uint64_t block_id,
+             uint64_t timestamp, Frame frame);
+    void Match();
+
+private:
+    PairMatcherOptions options_;
+    PairMatcherStats stats_;
+    bool offset_seeded_;
+
+    Window left_;
+    Window right_;
+    Window pairs_left_;
+    Window pairs_right_;
+};
+
+template <typename Frame>
+StereoPairMatcher<Frame>::StereoPairMatcher(const PairMatcherOptions& options) {
+    Configure(options);
+}
+
+template <typename Frame>
+void StereoPairMatcher<Frame>::Configure(const PairMatcherOptions& options) {
+    options_ = options;
+    if (options_.window < 1) {
+        options_.window = 1;
+    }
+    Reset();
+}
+
+template <typename Frame>
+void StereoPairMatcher<Frame>::Reset() {
+    stats_ = PairMatcherStats();
+    stats_.timestamp_offset = options_.timestamp_offset;
+    offset_seeded_ = !options_.auto_offset;
+    left_.Reset(options_.window);
+    right_.Reset(options_.window);
+    pairs_left_.Reset(options_.window);
+    pairs_right_.Reset(options_.window);
+}
+
+template <typename Frame>
+void StereoPairMatcher<Frame>::AddLeft(uint64_t block_id, uint64_t timestamp,
+                                       Frame frame) {
+    Add(left_, stats_.left_orphans, block_id, timestamp, std::move(frame));
+}
+
+template <typename Frame>
+void StereoPairMatcher<Frame>::AddRight(uint64_t block_id, uint64_t timestamp,
+                                        Frame frame) {
+    Add(right_, stats_.right_orphans, block_id, timestamp, std::move(frame));
+}
+
+template <typename Frame>
+bool StereoPairMatcher<Frame>::PopPair(Frame& left, Frame& right) {
+    if (pairs_left_.Empty()) {
+        return false;
+    }
+    left = std::move(pairs_left_.Front().frame);
+    right = std::move(pairs_right_.Front().frame);
+    pairs_left_.PopFront();
+    pairs_right_.PopFront();
+    return true;
+}
+
+template <typename Frame>
+size_t StereoPairMatcher<Frame>::LeftPending() const {
+    return left_.Size();
+}
+
+template <typename Frame>
+size_t StereoPairMatcher<Frame>::RightPending() const {
+    return right_.Size();
+}
+
+template <typename Frame>
+PairMatcherStats StereoPairMatcher<Frame>::GetStats() const {
+    return stats_;
+}
+
+template <typename Frame>
+void StereoPairMatcher<Frame>::Add(Window& window, uint64_t& orphans,
+                                   uint64_t block_id, uint64_t timestamp,
+                                   Frame frame) {
+    int64_t key = static_cast<int64_t>(
+            options_.mode == PairMatchMode::kBlockId ? block_id : timestamp);
+    if (window.Full()) {
+        // The other camera has fallen a whole window behind.
+        window.PopFront();
+        ++orphans;
+    }
+    if (window.Insert(key, std::move(frame))) {
+        ++stats_.reordered;
+    }
+    Match();
+}
+
+template <typename Frame>
+void StereoPairMatcher<Frame>::Match() {
+    const bool by_timestamp = options_.mode == PairMatchMode::kTimestamp;
+    const int64_t tolerance = by_timestamp ? options_.timestamp_tolerance : 0;
+
+    while (!left_.Empty() && !right_.Empty()) {
+        Entry& left = left_.Front();
+        Entry& right = right_.Front();
+        if (by_timestamp && !offset_seeded_) {
+            stats_.timestamp_offset = right.key - left.key;
+            offset_seeded_ = true;
+        }
+        int64_t offset = by_timestamp ? stats_.timestamp_offset : 0;
+        int64_t diff = left.key - (right.key - offset);
+
+        if (diff < -tolerance) {
+            left_.PopFront();
+            ++stats_.left_orphans;
+        } else if (diff > tolerance) {
+            right_.PopFront();
+            ++stats_.right_orphans;
+        } else {
+            if (by_timestamp && options_.auto_offset) {
+                stats_.timestamp_offset -= diff / 16;
+            }
+            if (pairs_left_.Full()) {
+                // Nobody drained the output; keep the newest pairs.
+                pairs_left_.PopFront();
+                pairs_right_.PopFront();
+            }
+            pairs_left_.Insert(0, std::move(left.frame));
+            pairs_right_.Insert(0, std::move(right.frame));
+            left_.PopFront();
+            right_.PopFront();
+            ++stats_.pairs;
+        }
+    }
+}
+
+template <typename Frame>
+void StereoPairMatcher<Frame>::Window::Reset(size_t capacity) {
+    entries_.assign(capacity, Entry());
+    head_ = 0;
+    size_ = 0;
+}
+
+template <typename Frame>
+bool StereoPairMatcher<Frame>::Window::Empty() const {
+    return size_ == 0;
+}
+
+template <typename Frame>
+bool StereoPairMatcher<Frame>::Window::Full() const {
+    return size_ == entries_.size();
+}
+
+template <typename Frame>
+size_t StereoPairMatcher<Frame>::Window::Size() const {
+    return size_;
+}
+
+template <typename Frame>
+typename StereoPairMatcher<Frame>::Entry&
+StereoPairMatcher<Frame>::Window::Front() {
+    return entries_[head_];
+}
+
+template <typename Frame>
+void StereoPairMatcher<Frame>::Window::PopFront() {
+    entries_[head_] = Entry();
+    head_ = (head_ + 1) % entries_.size();
+    --size_;
+}
+
+template <typename Frame>
+bool StereoPairMatcher<Frame>::Window::Insert(int64_t key, Frame frame) {
+    size_t index = size_;
+    while (index > 0 && At(index - 1).key > key) {
+        At(index) = std::move(At(index - 1));
+        --index;
+    }
+    At(index).key = key;
+    At(index).frame = std::move(frame);
+    ++size_;
+    return index != size_ - 1;
+}
+
+template <typename Frame>
+typename StereoPairMatcher<Frame>::Entry&
+StereoPairMatcher<Frame>::Window::At(size_t index) {
+    return entries_[(head_ + index) % entries_.size()];
+}
+
+#endif
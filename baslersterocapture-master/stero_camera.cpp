@@ -7,37 +7,80 @@
 
 #include "json.hpp"
 
+#include "basler_camera_source.h"
+#include "replay_camera_source.h"
 #include "stopwatch.h"
+#include "synthetic_camera_source.h"
 #include "utils.h"
 
-using namespace Pylon;
-using namespace Basler_UniversalCameraParams;
 using namespace nlohmann;
 
 namespace {
-const bool kIoLow = true;
-const bool kIoHigh = false;
+const unsigned int kTriggerReadyTimeoutMs = 1000;
+const unsigned int kRetrieveTimeoutMs = 5000;
 }  // namespace
 
-void PrintDeviceInfo(const CDeviceInfo& device);
-std::pair<size_t, size_t> FindCameras(const std::string& left_camera_sn,
-                                      const std::string& right_camera_sn,
-                                      const DeviceInfoList_t& devices);
-void TriggerPulse(CBaslerUniversalInstantCamera& camera);
-
 void SteroCamera::Open(const std::string& stero_config_file_name) {
     std::ifstream stero_config_file(stero_config_file_name);
     json stero_config_json;
     stero_config_file >> stero_config_json;
     stero_config_file.close();
-    Open(stero_config_json["left_camera"], stero_config_json["right_camera"],
-         stero_config_json["frame_rate"]);
+
+    SetSyncMode(ParseSyncMode(
+            stero_config_json.value("sync_mode", "software_trigger")));
+    SetPipelineOptions(
+            ParsePipelineOptions(stero_config_json["trigger_pipeline"]));
+    if (stero_config_json.count("pixel_format")) {
+        SetPixelFormat(ParsePixelFormat(stero_config_json["pixel_format"]));
+    }
+
+    std::string source = stero_config_json.value("source", "basler");
+    if (source == "basler") {
+        auto cameras = OpenBaslerCameras(
+                stero_config_json["left_camera"],
+                stero_config_json["right_camera"],
+                ParseTriggerOptions(stero_config_json["trigger"]),
+                ParseBufferPoolOptions(stero_config_json["buffer_pool"]));
+        Open(std::move(cameras.first), std::move(cameras.second),
+             stero_config_json["frame_rate"]);
+    } else if (source == "synthetic") {
+        auto cameras = OpenSyntheticCameras(
+                ParseSyntheticOptions(stero_config_json["synthetic"]));
+        Open(std::move(cameras.first), std::move(cameras.second),
+             stero_config_json["frame_rate"]);
+    } else if (source == "replay") {
+        auto cameras = OpenReplayCameras(
+                ParseReplayOptions(stero_config_json["replay"]));
+        Open(std::move(cameras.first), std::move(cameras.second),
+             stero_config_json["frame_rate"]);
+    } else {
+        throw std::runtime_error("δ֪Դ: " + source);
+    }
+
+    SetRateOptions(ParseRateOptions(stero_config_json["trigger_rate"]));
+    SetGrabQueueOptions(ParseQueueOptions(stero_config_json["grab_queue"]));
+    SetPairMatcherOptions(
+            ParsePairMatcherOptions(stero_config_json["pair_matcher"]));
+    SetFramePoolOptions(
+            ParseFramePoolOptions(stero_config_json["frame_pool"]));
+    SetDemosaicOptions(ParseDemosaicOptions(stero_config_json["demosaic"]));
+    SetParameterSyncOptions(
+            ParseParameterSyncOptions(stero_config_json["parameter_sync"]));
 }
 
 SteroCamera::SteroCamera()
-        : grabbing_(false),
+        : sync_mode_(SyncMode::kSoftwareTrigger),
+          pixel_format_(PixelFormat::kUnknown),
+          grabbing_(false),
+          place_by_block_id_(true),
+          left_timestamp_tick_ns_(1.0),
+          trigger_thread_stop_flag_(false),
           left_grab_thread_stop_flag_(false),
-          right_grab_thread_stop_flag_(false) {}
+          right_grab_thread_stop_flag_(false) {
+    auto block_id = [](const CameraFrame& frame) { return frame.block_id; };
+    left_grab_result_queue_.PairWith(&right_grab_result_queue_, block_id);
+    right_grab_result_queue_.PairWith(&left_grab_result_queue_, block_id);
+}
 
 SteroCamera::~SteroCamera() {
     StopGrab();
@@ -45,49 +88,36 @@ SteroCamera::~SteroCamera() {
 
 void SteroCamera::Open(const std::string& left_camera_sn,
                        const std::string& right_camera_sn, double frame_rate) {
-    CTlFactory& tl_factory = CTlFactory::GetInstance();
-    DeviceInfoList_t devices;
-    if (tl_factory.EnumerateDevices(devices) == 0) {
-        throw std::runtime_error("δ.");
-    }
-
-    for (size_t i = 0; i < devices.size(); ++i) {
-        std::cout << " " << i << " Ϣ: " << std::endl;
-        PrintDeviceInfo(devices[i]);
-        std::cout << std::endl;
-    }
-
-    auto camera_index = FindCameras(left_camera_sn, right_camera_sn, devices);
+    auto cameras = OpenBaslerCameras(left_camera_sn, right_camera_sn);
+    Open(std::move(cameras.first), std::move(cameras.second), frame_rate);
+}
 
-    left_camera_.Attach(tl_factory.CreateDevice(devices[camera_index.first]));
-    right_camera_.Attach(tl_factory.CreateDevice(devices[camera_index.second]));
+void SteroCamera::Open(std::unique_ptr<CameraSource> left_camera,
+                       std::unique_ptr<CameraSource> right_camera,
+                       double frame_rate) {
+    left_camera_ = std::move(left_camera);
+    right_camera_ = std::move(right_camera);
 
-    left_camera_.Open();
-    right_camera_.Open();
+    std::cout << ": " << left_camera_->Name()
+              << " : " << right_camera_->Name() << std::endl;
 
     rate_.SetRate(frame_rate);
 }
 
 void SteroCamera::Init(const std::string& pylon_feature_stream_file) {
-    CFeaturePersistence::Load(pylon_feature_stream_file.c_str(),
-                              &left_camera_.GetNodeMap(), true);
-    CFeaturePersistence::Load(pylon_feature_stream_file.c_str(),
-                              &right_camera_.GetNodeMap(), true);
-
-    left_camera_.GainAuto.SetValue(GainAuto_Continuous);
-    right_camera_.GainAuto.SetValue(GainAuto_Off);
-
-    left_camera_.ExposureAuto.SetValue(ExposureAuto_Continuous);
-    right_camera_.ExposureAuto.SetValue(ExposureAuto_Off);
+    left_camera_->LoadFeatures(pylon_feature_stream_file);
+    right_camera_->LoadFeatures(pylon_feature_stream_file);
 
-    left_camera_.BalanceWhiteAuto.SetValue(BalanceWhiteAuto_Continuous);
-    right_camera_.BalanceWhiteAuto.SetValue(BalanceWhiteAuto_Off);
+    left_camera_->SetPixelFormat(pixel_format_);
+    right_camera_->SetPixelFormat(pixel_format_);
 
-    left_camera_.UserOutputSelector.SetValue(UserOutputSelector_UserOutput3);
-    left_camera_.UserOutputValue.SetValue(kIoLow);
+    left_camera_->Configure(CameraRole::kMaster, sync_mode_,
+                            rate_.GetRate());
+    right_camera_->Configure(CameraRole::kSlave, sync_mode_,
+                             rate_.GetRate());
 
-    left_camera_.StartGrabbing();
-    right_camera_.StartGrabbing();
+    left_camera_->StartGrabbing();
+    right_camera_->StartGrabbing();
 }
 
 void SteroCamera::StartGrab() {
@@ -98,8 +128,20 @@ void SteroCamera::StartGrab() {
 
     grabbing_ = true;
 
+    left_grab_result_queue_.Open();
+    right_grab_result_queue_.Open();
+    pair_matcher_.Reset();
+    stereo_frame_assembler_.Reset();
+
+    parameter_sync_.Start(left_camera_.get(), right_camera_.get());
+    trigger_pipeline_.Reset();
+    left_timestamp_tick_ns_ = left_camera_->TimestampTickNs();
+
     StartLeftGrabThread();
     StartRightGrabThread();
+    if (sync_mode_ == SyncMode::kSoftwareTrigger) {
+        StartTriggerThread();
+    }
 }
 
 void SteroCamera::StopGrab() {
@@ -109,128 +151,303 @@ void SteroCamera::StopGrab() {
         return;
     }
 
-    right_grab_thread_stop_flag_ = true;
-    right_grab_thread_.join();
+    left_grab_result_queue_.Close();
+    right_grab_result_queue_.Close();
 
+    // The grab threads only return once another frame arrives, so stop
+    // them while the master is still being triggered.
+    right_grab_thread_stop_flag_ = true;
     left_grab_thread_stop_flag_ = true;
+    right_grab_thread_.join();
     left_grab_thread_.join();
 
+    if (trigger_thread_.joinable()) {
+        trigger_thread_stop_flag_ = true;
+        trigger_pipeline_.Close();
+        trigger_thread_.join();
+    }
+
+    parameter_sync_.Stop();
+
     grabbing_ = false;
 }
 
-std::pair<CGrabResultPtr, CGrabResultPtr> SteroCamera::Grab() {
+StereoFrame SteroCamera::Grab() {
     std::unique_lock<std::mutex> grabbing_lock(grabbing_mutex_);
 
     if (!grabbing_) {
         throw std::runtime_error("δʼɼ");
     }
 
-    CGrabResultPtr left_grab_result;
-    CGrabResultPtr right_grab_result;
-
-    std::unique_lock<std::mutex> lock(grab_result_queue_mutex_);
-    if (left_grab_result_queue_.empty() || right_grab_result_queue_.empty()) {
-        grab_result_queue_condition_variable_.wait(lock, [this]() {
-            return !(left_grab_result_queue_.empty() ||
-                     right_grab_result_queue_.empty());
-        });
+    StereoFrame stereo_frame;
+    while (!stereo_frame.IsValid()) {
+        CameraFrame left_frame;
+        CameraFrame right_frame;
+        PopPair(left_frame, right_frame);
+
+        // Both exposures come from the same left trigger.
+        right_frame.parameter_epoch = left_frame.parameter_epoch;
+        right_frame.trigger_time = left_frame.trigger_time;
+        parameter_sync_.GetEpochParameters(left_frame.parameter_epoch,
+                                           left_frame.parameters);
+        right_frame.parameters = left_frame.parameters;
+
+        stereo_frame =
+                stereo_frame_assembler_.Compose(left_frame, right_frame);
+        if (!stereo_frame.IsValid()) {
+            std::cerr << "ͼ񻺳Ѻľ, ͼ: "
+                      << left_frame.block_id << std::endl;
+        }
     }
-    left_grab_result = left_grab_result_queue_.front();
-    right_grab_result = right_grab_result_queue_.front();
-    left_grab_result_queue_.pop_front();
-    right_grab_result_queue_.pop_front();
 
-    std::cout << TimeStr() << "ȡĿͼ: " << left_grab_result->GetBlockID()
-              << " ȡĿͼ: " << right_grab_result->GetBlockID() << std::endl;
+    std::cout << TimeStr() << "ȡĿͼ: "
+              << stereo_frame.left.block_id
+              << " ȡĿͼ: " << stereo_frame.right.block_id
+              << std::endl;
+
+    return stereo_frame;
+}
+
+// Called with grabbing_mutex_ held.
+void SteroCamera::PopPair(CameraFrame& left_frame, CameraFrame& right_frame) {
+    while (!pair_matcher_.PopPair(left_frame, right_frame)) {
+        CameraFrame frame;
+        bool received = false;
+        while (left_grab_result_queue_.TryPop(frame)) {
+            pair_matcher_.AddLeft(frame.block_id, frame.timestamp, frame);
+            received = true;
+        }
+        while (right_grab_result_queue_.TryPop(frame)) {
+            pair_matcher_.AddRight(frame.block_id, frame.timestamp, frame);
+            received = true;
+        }
+        if (received) {
+            continue;
+        }
 
-    if (left_grab_result->GetBlockID() != right_grab_result->GetBlockID()) {
-        throw std::runtime_error("һȡͼıŲһ");
+        // A pair needs a frame from the camera with fewer frames pending.
+        auto& lagging_queue =
+                pair_matcher_.LeftPending() <= pair_matcher_.RightPending()
+                        ? left_grab_result_queue_
+                        : right_grab_result_queue_;
+        if (!lagging_queue.WaitNotEmpty()) {
+            throw std::runtime_error("ɼֹͣ");
+        }
+    }
+}
+
+void SteroCamera::SetSyncMode(SyncMode sync_mode) {
+    std::unique_lock<std::mutex> grabbing_lock(grabbing_mutex_);
+    if (grabbing_) {
+        throw std::runtime_error("ɼ޷޸ͬʽ");
     }
+    sync_mode_ = sync_mode;
+}
 
-    return std::make_pair(left_grab_result, right_grab_result);
+SyncMode SteroCamera::GetSyncMode() const {
+    return sync_mode_;
+}
+
+double SteroCamera::GetTimestampTickNs() const {
+    return left_camera_->TimestampTickNs();
+}
+
+void SteroCamera::SetPixelFormat(PixelFormat pixel_format) {
+    std::unique_lock<std::mutex> grabbing_lock(grabbing_mutex_);
+    if (grabbing_) {
+        throw std::runtime_error("ɼ޷޸ظʽ");
+    }
+    pixel_format_ = pixel_format;
 }
 
 double SteroCamera::GetFrameRate() const {
     return rate_.GetRate();
 }
 
-void SteroCamera::OnException(std::function<void(void)> callback) {
-    exception_callback_ = callback;
+void SteroCamera::SetPipelineOptions(const PipelineOptions& options) {
+    std::unique_lock<std::mutex> grabbing_lock(grabbing_mutex_);
+    if (grabbing_) {
+        throw std::runtime_error("ɼ޷޸Ĵˮ");
+    }
+    trigger_pipeline_.Configure(options);
 }
 
-void SteroCamera::SyncGain() {
-    double gain = left_camera_.Gain.GetValue(false, true);
-    right_camera_.Gain.SetValue(gain);
+PipelineStats SteroCamera::GetPipelineStats() const {
+    return trigger_pipeline_.GetStats();
 }
 
-void SteroCamera::SyncExposureTime() {
-    double exposure_time = left_camera_.ExposureTime.GetValue(false, true);
-    right_camera_.ExposureTime.SetValue(exposure_time);
+void SteroCamera::SetRateOptions(const RateOptions& options) {
+    std::unique_lock<std::mutex> grabbing_lock(grabbing_mutex_);
+    if (grabbing_) {
+        throw std::runtime_error("ɼ޷޸Ĵ");
+    }
+    rate_.Configure(options);
 }
 
-void SteroCamera::SyncWhiteBalance() {
-    left_camera_.BalanceRatioSelector.SetValue(BalanceRatioSelector_Red);
-    double red_ratio = left_camera_.BalanceRatio.GetValue(false, true);
+RateStats SteroCamera::GetRateStats() const {
+    return rate_.GetStats();
+}
 
-    left_camera_.BalanceRatioSelector.SetValue(BalanceRatioSelector_Green);
-    double green_ratio = left_camera_.BalanceRatio.GetValue(false, true);
+void SteroCamera::SetGrabQueueOptions(const QueueOptions& options) {
+    std::unique_lock<std::mutex> grabbing_lock(grabbing_mutex_);
+    if (grabbing_) {
+        throw std::runtime_error("ɼ޷޸Ķ");
+    }
+    left_grab_result_queue_.Configure(options);
+    right_grab_result_queue_.Configure(options);
+}
 
-    left_camera_.BalanceRatioSelector.SetValue(BalanceRatioSelector_Blue);
-    double blue_ratio = left_camera_.BalanceRatio.GetValue(false, true);
+void SteroCamera::SetPairMatcherOptions(const PairMatcherOptions& options) {
+    std::unique_lock<std::mutex> grabbing_lock(grabbing_mutex_);
+    if (grabbing_) {
+        throw std::runtime_error("ɼ޷޸");
+    }
+    pair_matcher_.Configure(options);
+    place_by_block_id_ = options.mode == PairMatchMode::kBlockId;
+}
 
-    right_camera_.BalanceRatioSelector.SetValue(BalanceRatioSelector_Red);
-    right_camera_.BalanceRatio.SetValue(red_ratio);
+PairMatcherStats SteroCamera::GetPairMatcherStats() const {
+    return pair_matcher_.GetStats();
+}
 
-    right_camera_.BalanceRatioSelector.SetValue(BalanceRatioSelector_Green);
-    right_camera_.BalanceRatio.SetValue(green_ratio);
+void SteroCamera::SetFramePoolOptions(const FramePoolOptions& options) {
+    std::unique_lock<std::mutex> grabbing_lock(grabbing_mutex_);
+    if (grabbing_) {
+        throw std::runtime_error("ɼ޷޸ͼ񻺳");
+    }
+    stereo_frame_assembler_.Configure(options);
+}
 
-    right_camera_.BalanceRatioSelector.SetValue(BalanceRatioSelector_Blue);
-    right_camera_.BalanceRatio.SetValue(blue_ratio);
+void SteroCamera::SetDemosaicOptions(const DemosaicOptions& options) {
+    std::unique_lock<std::mutex> grabbing_lock(grabbing_mutex_);
+    if (grabbing_) {
+        throw std::runtime_error("ɼ޷޸ȥ");
+    }
+    stereo_frame_assembler_.ConfigureDemosaic(options);
 }
 
-void SteroCamera::StartLeftGrabThread() {
-    left_grab_thread_stop_flag_ = false;
-    left_grab_thread_ = std::thread([this]() {
-        try {
-            rate_.Init();
-            CGrabResultPtr left_grab_result;
+DemosaicStats SteroCamera::GetDemosaicStats() const {
+    return stereo_frame_assembler_.GetDemosaicStats();
+}
 
-            size_t trigger_count = 0;
+StereoFrameStats SteroCamera::GetStereoFrameStats() const {
+    return stereo_frame_assembler_.GetStats();
+}
 
-            while (!left_grab_thread_stop_flag_) {
+void SteroCamera::SetParameterSyncOptions(
+        const ParameterSyncOptions& options) {
+    std::unique_lock<std::mutex> grabbing_lock(grabbing_mutex_);
+    if (grabbing_) {
+        throw std::runtime_error("ɼ޷޸Ĳͬ");
+    }
+    parameter_sync_.Configure(options);
+}
 
-                SyncGain();
-                SyncExposureTime();
-                SyncWhiteBalance();
-                left_camera_.WaitForFrameTriggerReady(
-                        1000, TimeoutHandling_ThrowException);
-                right_camera_.WaitForFrameTriggerReady(
-                        1000, TimeoutHandling_ThrowException);
+ParameterSyncStats SteroCamera::GetParameterSyncStats() const {
+    return parameter_sync_.GetStats();
+}
+
+BufferPoolStats SteroCamera::GetLeftBufferStats() const {
+    return left_camera_->GetBufferStats();
+}
 
-                TriggerPulse(left_camera_);
+BufferPoolStats SteroCamera::GetRightBufferStats() const {
+    return right_camera_->GetBufferStats();
+}
+
+QueueStats SteroCamera::GetLeftQueueStats() const {
+    return left_grab_result_queue_.GetStats();
+}
 
-                left_camera_.RetrieveResult(5000, left_grab_result,
-                                            TimeoutHandling_ThrowException);
+QueueStats SteroCamera::GetRightQueueStats() const {
+    return right_grab_result_queue_.GetStats();
+}
+
+void SteroCamera::OnException(std::function<void(void)> callback) {
+    exception_callback_ = callback;
+}
 
-                ++trigger_count;
-                {
-                    std::lock_guard<std::mutex> lock(grab_result_queue_mutex_);
-                    left_grab_result_queue_.push_back(left_grab_result);
+void SteroCamera::StartTriggerThread() {
+    trigger_thread_stop_flag_ = false;
+    trigger_thread_ = std::thread([this]() {
+        try {
+            rate_.Init();
+
+            while (!trigger_thread_stop_flag_) {
+                if (!trigger_pipeline_.AcquireSlot(
+                            std::chrono::milliseconds(kRetrieveTimeoutMs))) {
+                    break;
                 }
-                grab_result_queue_condition_variable_.notify_all();
+                left_camera_->WaitForFrameTriggerReady(kTriggerReadyTimeoutMs);
+                right_camera_->WaitForFrameTriggerReady(kTriggerReadyTimeoutMs);
+
+                uint64_t parameter_epoch = parameter_sync_.Epoch();
+                auto trigger_time = left_camera_->Trigger();
+                trigger_pipeline_.OnTriggered(trigger_time, parameter_epoch);
 
                 rate_.Sleep();
             }
-        } catch (const Pylon::GenericException& e) {
-            std::cerr << "쳣(): " << std::endl;
-            std::cerr << e.GetDescription() << std::endl;
+        } catch (const std::exception& e) {
+            if (trigger_thread_stop_flag_) {
+                return;
+            }
+            std::cerr << "쳣(): " << std::endl;
+            std::cerr << e.what() << std::endl;
             if (exception_callback_) {
                 exception_callback_();
             }
             std::cin.get();
             return;
-        } catch (const std::runtime_error& e) {
-            std::cerr << "쳣: " << std::endl;
+        }
+    });
+}
+
+void SteroCamera::StartLeftGrabThread() {
+    left_grab_thread_stop_flag_ = false;
+    left_grab_thread_ = std::thread([this]() {
+        try {
+            CameraFrame left_frame;
+            bool software_trigger = sync_mode_ == SyncMode::kSoftwareTrigger;
+
+            while (!left_grab_thread_stop_flag_) {
+                left_frame = left_camera_->RetrieveFrame(kRetrieveTimeoutMs);
+                auto delivery_time = std::chrono::steady_clock::now();
+
+                // Failed frames carry no reliable timestamp.
+                int64_t timestamp_ns =
+                        left_frame.succeeded
+                                ? static_cast<int64_t>(
+                                          left_frame.timestamp *
+                                          left_timestamp_tick_ns_)
+                                : -1;
+                std::chrono::steady_clock::time_point trigger_time;
+                uint64_t parameter_epoch = 0;
+                if (software_trigger &&
+                    trigger_pipeline_.OnDelivered(
+                            left_frame.block_id, timestamp_ns, delivery_time,
+                            trigger_time, parameter_epoch)) {
+                    left_frame.trigger_time = ToNanoseconds(trigger_time);
+                } else {
+                    parameter_epoch = parameter_sync_.Epoch();
+                }
+                left_frame.parameter_epoch = parameter_epoch;
+
+                if (left_frame.succeeded) {
+                    if (place_by_block_id_) {
+                        left_frame = stereo_frame_assembler_.PlaceLeft(
+                                left_frame, left_frame.block_id);
+                    }
+                    left_grab_result_queue_.Push(left_frame);
+                } else {
+                    std::cerr << "Ŀͼʧ: " << left_frame.block_id
+                              << std::endl;
+                }
+            }
+        } catch (const std::exception& e) {
+            if (left_grab_thread_stop_flag_) {
+                return;
+            }
+            std::cerr << "쳣(): " << std::endl;
             std::cerr << e.what() << std::endl;
             if (exception_callback_) {
                 exception_callback_();
@@ -240,31 +457,31 @@ void SteroCamera::StartLeftGrabThread() {
         }
     });
 }
+
 void SteroCamera::StartRightGrabThread() {
     right_grab_thread_stop_flag_ = false;
     right_grab_thread_ = std::thread([this]() {
         try {
-            CGrabResultPtr right_grab_result;
+            CameraFrame right_frame;
             while (!right_grab_thread_stop_flag_) {
-                right_camera_.RetrieveResult(5000, right_grab_result,
-                                             TimeoutHandling_ThrowException);
-
-                {
-                    std::lock_guard<std::mutex> lock(grab_result_queue_mutex_);
-                    right_grab_result_queue_.push_back(right_grab_result);
+                right_frame = right_camera_->RetrieveFrame(kRetrieveTimeoutMs);
+
+                if (right_frame.succeeded) {
+                    if (place_by_block_id_) {
+                        right_frame = stereo_frame_assembler_.PlaceRight(
+                                right_frame, right_frame.block_id);
+                    }
+                    right_grab_result_queue_.Push(right_frame);
+                } else {
+                    std::cerr << "Ŀͼʧ: " << right_frame.block_id
+                              << std::endl;
                 }
-                grab_result_queue_condition_variable_.notify_all();
             }
-        } catch (const Pylon::GenericException& e) {
-            std::cerr << "쳣(): " << std::endl;
-            std::cerr << e.GetDescription() << std::endl;
-            if (exception_callback_) {
-                exception_callback_();
+        } catch (const std::exception& e) {
+            if (right_grab_thread_stop_flag_) {
+                return;
             }
-            std::cin.get();
-            return;
-        } catch (const std::runtime_error& e) {
-            std::cerr << "쳣: " << std::endl;
+            std::cerr << "쳣(): " << std::endl;
             std::cerr << e.what() << std::endl;
             if (exception_callback_) {
                 exception_callback_();
@@ -274,104 +491,3 @@ void SteroCamera::StartRightGrabThread() {
         }
     });
 }
-
-void PrintDeviceInfo(const CDeviceInfo& device) {
-    if (device.IsSerialNumberAvailable()) {
-        std::cout << "SerialNumber: " << device.GetSerialNumber() << std::endl;
-    }
-
-    if (device.IsUserDefinedNameAvailable()) {
-        std::cout << "UserDefinedName: " << device.GetUserDefinedName()
-                  << std::endl;
-    }
-
-    if (device.IsModelNameAvailable()) {
-        std::cout << "ModelName: " << device.GetModelName() << std::endl;
-    }
-
-    if (device.IsDeviceVersionAvailable()) {
-        std::cout << "DeviceVersion: " << device.GetDeviceVersion()
-                  << std::endl;
-    }
-
-    if (device.IsDeviceFactoryAvailable()) {
-        std::cout << "DeviceFactory: " << device.GetDeviceFactory()
-                  << std::endl;
-    }
-
-    if (device.IsInterfaceIDAvailable()) {
-        std::cout << "InterfaceID: " << device.GetInterfaceID() << std::endl;
-    }
-
-    if (device.IsDeviceGUIDAvailable()) {
-        std::cout << "DeviceGUID: " << device.GetDeviceGUID() << std::endl;
-    }
-
-    if (device.IsManufacturerInfoAvailable()) {
-        std::cout << "ManufacturerInfo: " << device.GetManufacturerInfo()
-                  << std::endl;
-    }
-
-    if (device.IsDeviceIdxAvailable()) {
-        std::cout << "DeviceIdx: " << device.GetDeviceIdx() << std::endl;
-    }
-
-    if (device.IsProductIdAvailable()) {
-        std::cout << "ProductId: " << device.GetProductId() << std::endl;
-    }
-
-    if (device.IsVendorIdAvailable()) {
-        std::cout << "VendorId: " << device.GetVendorId() << std::endl;
-    }
-
-    if (device.IsDriverKeyNameAvailable()) {
-        std::cout << "DriverKeyName: " << device.GetDriverKeyName()
-                  << std::endl;
-    }
-
-    if (device.IsUsbDriverTypeAvailable()) {
-        std::cout << "UsbDriverType: " << device.GetUsbDriverType()
-                  << std::endl;
-    }
-
-    if (device.IsTransferModeAvailable()) {
-        std::cout << "TransferMode: " << device.GetTransferMode() << std::endl;
-    }
-}
-
-std::pair<size_t, size_t> FindCameras(const std::string& left_camera_sn,
-                                      const std::string& right_camera_sn,
-                                      const DeviceInfoList_t& devices) {
-    int left_index = -1;
-    int right_index = -1;
-
-    for (int i = 0; i < devices.size(); ++i) {
-        if (std::string(devices[i].GetSerialNumber().c_str()) ==
-            left_camera_sn) {
-            left_index = i;
-        }
-
-        if (std::string(devices[i].GetSerialNumber().c_str()) ==
-            right_camera_sn) {
-            right_index = i;
-        }
-    }
-
-    if (left_index == -1) {
-        throw std::runtime_error("δ");
-    }
-
-    if (right_index == -1) {
-        throw std::runtime_error("δ");
-    }
-
-    return std::make_pair(static_cast<size_t>(left_index),
-                          static_cast<size_t>(right_index));
-}
-
-void TriggerPulse(CBaslerUniversalInstantCamera& camera) {
-    camera.UserOutputSelector.SetValue(UserOutputSelector_UserOutput3);
-    camera.UserOutputValue.SetValue(kIoHigh);
-    Sleep(1);
-    camera.UserOutputValue.SetValue(kIoLow);
-}
\ No newline at end of file
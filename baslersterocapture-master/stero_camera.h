@@ -2,23 +2,21 @@
 #define STERO_CAMERA_H_
 
 #include <atomic>
-#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
 
 #include "date.h"
 
-// Include files to use the pylon API.
-#include <pylon/PylonIncludes.h>
-#ifdef PYLON_WIN_BUILD
-#include <pylon/PylonGUI.h>
-#endif
-
-// Settings to use any camera type.
-#include <pylon/BaslerUniversalInstantCamera.h>
-
+#include "camera_source.h"
+#include "capture_queue.h"
+#include "parameter_sync.h"
 #include "rate.h"
+#include "stereo_frame.h"
+#include "stereo_pair_matcher.h"
+#include "trigger_pipeline.h"
 
 class SteroCamera {
 public:
@@ -29,24 +27,59 @@ public:
     void Open(const std::string& left_camera_sn,
               const std::string& right_camera_sn, double frame_rate);
     void Open(const std::string& stero_config_file_name);
+    void Open(std::unique_ptr<CameraSource> left_camera,
+              std::unique_ptr<CameraSource> right_camera, double frame_rate);
+
+    // Takes effect at the next Init().
+    void SetSyncMode(SyncMode sync_mode);
+    SyncMode GetSyncMode() const;
+    // Length of a left camera timestamp tick, in ns, as the camera reports
+    // it. Needs Open().
+    double GetTimestampTickNs() const;
+    // Capture format, e.g. kBayerRG8 to send raw frames and demosaic them on
+    // the host. Takes effect at the next Init(); kUnknown keeps the format
+    // of the feature file.
+    void SetPixelFormat(PixelFormat pixel_format);
 
     void Init(const std::string& pylon_feature_stream_file);
 
     void StartGrab();
     void StopGrab();
 
-    std::pair<Pylon::CGrabResultPtr, Pylon::CGrabResultPtr> Grab();
+    StereoFrame Grab();
 
     double GetFrameRate() const;
 
+    void SetRateOptions(const RateOptions& options);
+    RateStats GetRateStats() const;
+
+    void SetPipelineOptions(const PipelineOptions& options);
+    PipelineStats GetPipelineStats() const;
+
+    BufferPoolStats GetLeftBufferStats() const;
+    BufferPoolStats GetRightBufferStats() const;
+
+    void SetGrabQueueOptions(const QueueOptions& options);
+    QueueStats GetLeftQueueStats() const;
+    QueueStats GetRightQueueStats() const;
+
+    void SetPairMatcherOptions(const PairMatcherOptions& options);
+    PairMatcherStats GetPairMatcherStats() const;
+
+    void SetFramePoolOptions(const FramePoolOptions& options);
+    void SetDemosaicOptions(const DemosaicOptions& options);
+    DemosaicStats GetDemosaicStats() const;
+    StereoFrameStats GetStereoFrameStats() const;
+
+    void SetParameterSyncOptions(const ParameterSyncOptions& options);
+    ParameterSyncStats GetParameterSyncStats() const;
+
 	void OnException(std::function<void(void)> callback);
 
 private:
-    void SyncGain();
-    void SyncExposureTime();
-    void SyncWhiteBalance();
+    void PopPair(CameraFrame& left_frame, CameraFrame& right_frame);
 
-private:
+    void StartTriggerThread();
     void StartLeftGrabThread();
     void StartRightGrabThread();
 
@@ -55,20 +88,34 @@ private:
 
 private:
     Rate rate_;
+    SyncMode sync_mode_;
+    PixelFormat pixel_format_;
 
 	std::function<void(void)> exception_callback_;
 
-    Pylon::CBaslerUniversalInstantCamera left_camera_;
-    Pylon::CBaslerUniversalInstantCamera right_camera_;
+    std::unique_ptr<CameraSource> left_camera_;
+    std::unique_ptr<CameraSource> right_camera_;
 
     std::atomic_bool grabbing_;
     std::mutex grabbing_mutex_;
 
-    std::deque<Pylon::CGrabResultPtr> left_grab_result_queue_;
-    std::deque<Pylon::CGrabResultPtr> right_grab_result_queue_;
+    CaptureQueue<CameraFrame> left_grab_result_queue_;
+    CaptureQueue<CameraFrame> right_grab_result_queue_;
+
+    StereoPairMatcher<CameraFrame> pair_matcher_;
+
+    StereoFrameAssembler stereo_frame_assembler_;
+    // Grab threads place frames side by side only when pairs share a BlockID.
+    bool place_by_block_id_;
+
+    ParameterSync parameter_sync_;
+
+    TriggerPipeline trigger_pipeline_;
+    // Of the left camera, read when grabbing starts.
+    double left_timestamp_tick_ns_;
 
-    std::mutex grab_result_queue_mutex_;
-    std::condition_variable grab_result_queue_condition_variable_;
+    std::thread trigger_thread_;
+    std::atomic_bool trigger_thread_stop_flag_;
 
     std::thread left_grab_thread_;
     std::atomic_bool left_grab_thread_stop_flag_;
@@ -0,0 +1,442 @@
+#include "synthetic_camera_source.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "aligned_buffer_pool.h"
+#include "periodic_thread.h"
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+const int kLeft = 0;
+const int kRight = 1;
+const int kDisparity = 32;
+const int kCheckerSize = 64;
+const int kBarWidth = 16;
+const double kPi = 3.14159265358979323846;
+
+// Hands out AlignedBufferPool buffers that return to the pool when the
+// last CameraFrame referring to them goes away.
+class BufferPool {
+public:
+    BufferPool(size_t buffer_size, size_t count)
+            : pool_(std::make_shared<AlignedBufferPool>()) {
+        pool_->Reserve(buffer_size, count);
+    }
+
+    std::shared_ptr<uint8_t> Acquire() {
+        uint8_t* buffer = pool_->TryAcquire();
+        if (!buffer) {
+            return nullptr;
+        }
+        auto pool = pool_;
+        return std::shared_ptr<uint8_t>(
+                buffer, [pool](uint8_t* released) { pool->Release(released); });
+    }
+
+    BufferPoolStats GetStats() const {
+        return pool_->GetStats();
+    }
+
+private:
+    std::shared_ptr<AlignedBufferPool> pool_;
+};
+
+std::vector<uint8_t> RenderBgrPattern(int width, int height, int shift) {
+    std::vector<uint8_t> bgr(static_cast<size_t>(width) * height * 3);
+    for (int y = 0; y < height; ++y) {
+        uint8_t* row = &bgr[static_cast<size_t>(y) * width * 3];
+        for (int x = 0; x < width; ++x) {
+            int u = x + shift;
+            bool checker = ((u / kCheckerSize) + (y / kCheckerSize)) % 2 == 0;
+            row[x * 3 + 0] = static_cast<uint8_t>(255 * y / height);
+            row[x * 3 + 1] = checker ? 200 : 55;
+            row[x * 3 + 2] = static_cast<uint8_t>((u * 255 / width) & 0xff);
+        }
+    }
+    return bgr;
+}
+
+std::vector<uint8_t> ConvertPattern(const std::vector<uint8_t>& bgr,
+                                    int width, int height,
+                                    PixelFormat pixel_format) {
+    size_t pixels = static_cast<size_t>(width) * height;
+    std::vector<uint8_t> out(pixels * BytesPerPixel(pixel_format));
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            size_t i = static_cast<size_t>(y) * width + x;
+            const uint8_t* p = &bgr[i * 3];
+            switch (pixel_format) {
+                case PixelFormat::kBgr8:
+                    out[i * 3 + 0] = p[0];
+                    out[i * 3 + 1] = p[1];
+                    out[i * 3 + 2] = p[2];
+                    break;
+                case PixelFormat::kMono8:
+                    out[i] = static_cast<uint8_t>((p[0] + 2 * p[1] + p[2]) / 4);
+                    break;
+                case PixelFormat::kBayerRG8:
+                case PixelFormat::kBayerBG8: {
+                    bool red_first = pixel_format == PixelFormat::kBayerRG8;
+                    if ((y % 2) != (x % 2)) {
+                        out[i] = p[1];
+                    } else if ((y % 2 == 0) == red_first) {
+                        out[i] = p[2];
+                    } else {
+                        out[i] = p[0];
+                    }
+                    break;
+                }
+                case PixelFormat::kYCbCr422_8: {
+                    int luma = (29 * p[0] + 150 * p[1] + 77 * p[2]) >> 8;
+                    int chroma = x % 2 == 0
+                                         ? 128 + ((p[0] - luma) * 144 >> 8)
+                                         : 128 + ((p[2] - luma) * 182 >> 8);
+                    out[i * 2 + 0] = static_cast<uint8_t>(luma);
+                    out[i * 2 + 1] = static_cast<uint8_t>(
+                            std::min(255, std::max(0, chroma)));
+                    break;
+                }
+                default:
+                    throw std::runtime_error("ϳָ֧ظʽ");
+            }
+        }
+    }
+    return out;
+}
+
+class SyntheticRig {
+public:
+    explicit SyntheticRig(const SyntheticOptions& options)
+            : options_(options),
+              epoch_(Clock::now()),
+              random_(42),
+              free_run_rate_(0.0) {
+        RenderPatterns();
+    }
+
+    // Before grabbing starts, like a camera's PixelFormat.
+    void SetPixelFormat(PixelFormat pixel_format) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pixel_format == PixelFormat::kUnknown ||
+            pixel_format == options_.pixel_format) {
+            return;
+        }
+        options_.pixel_format = pixel_format;
+        RenderPatterns();
+    }
+
+    void SetFreeRun(double frame_rate) {
+        free_run_rate_ = frame_rate;
+    }
+
+    void StartGrabbing(int camera) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cameras_[camera].grabbing = true;
+            cameras_[camera].next_block_id = 0;
+            cameras_[camera].pending.clear();
+        }
+        if (camera == kLeft && free_run_rate_ > 0.0) {
+            free_run_.Start(free_run_rate_, [this]() { Fire(); });
+        }
+    }
+
+    void StopGrabbing(int camera) {
+        if (camera == kLeft) {
+            free_run_.Stop();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cameras_[camera].grabbing = false;
+            cameras_[camera].pending.clear();
+        }
+        condition_variable_.notify_all();
+    }
+
+    Clock::time_point Fire() {
+        auto now = Clock::now();
+        auto skew = std::chrono::microseconds(options_.skew_us);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (int camera = kLeft; camera <= kRight; ++camera) {
+                Camera& state = cameras_[camera];
+                if (!state.grabbing ||
+                    (camera == kRight &&
+                     Uniform() < options_.missed_trigger_rate)) {
+                    continue;
+                }
+                Pending pending;
+                pending.block_id = state.next_block_id++;
+                pending.lost = Uniform() < options_.drop_rate;
+
+                auto exposure_time = now;
+                int64_t clock_offset = 0;
+                if (camera == kRight) {
+                    exposure_time += skew;
+                    clock_offset = options_.clock_offset_ns;
+                }
+                pending.timestamp = static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                exposure_time - epoch_)
+                                .count() +
+                        Jitter() * 1000 + clock_offset);
+                pending.ready_time =
+                        exposure_time +
+                        std::chrono::microseconds(options_.latency_us +
+                                                  Jitter());
+                if (!state.pending.empty() &&
+                    pending.ready_time < state.pending.back().ready_time) {
+                    pending.ready_time = state.pending.back().ready_time;
+                }
+                state.pending.push_back(pending);
+            }
+        }
+        condition_variable_.notify_all();
+        return now;
+    }
+
+    CameraFrame Retrieve(int camera, unsigned int timeout_ms) {
+        auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+        Camera& state = cameras_[camera];
+        Pending pending;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            bool ready = condition_variable_.wait_until(lock, deadline, [&]() {
+                return !state.pending.empty() || !state.grabbing;
+            });
+            if (!state.grabbing) {
+                throw std::runtime_error("ϳδʼɼ");
+            }
+            if (!ready || state.pending.front().ready_time > deadline) {
+                throw std::runtime_error("ϳȡͼʱ");
+            }
+            pending = state.pending.front();
+            state.pending.pop_front();
+        }
+        std::this_thread::sleep_until(pending.ready_time);
+
+        CameraFrame frame;
+        frame.block_id = pending.block_id;
+        frame.timestamp = pending.timestamp;
+        frame.width = options_.width;
+        frame.height = options_.height;
+        frame.pixel_format = options_.pixel_format;
+        frame.stride = options_.width * BytesPerPixel(options_.pixel_format);
+
+        auto buffer = pending.lost ? nullptr : state.pool->Acquire();
+        if (!buffer) {
+            frame.succeeded = false;
+            return frame;
+        }
+        Render(state, pending.block_id, buffer.get());
+        frame.buffer = buffer.get();
+        frame.holder = buffer;
+        return frame;
+    }
+
+    BufferPoolStats GetBufferStats(int camera) const {
+        return cameras_[camera].pool->GetStats();
+    }
+
+    CameraParameters GetParameters(int camera) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (camera == kLeft) {
+            // Emulates the master's auto functions slowly settling.
+            double t = std::chrono::duration<double>(Clock::now() - epoch_)
+                               .count();
+            CameraParameters& parameters = cameras_[camera].parameters;
+            parameters.gain = 6.0 + 3.0 * std::sin(2.0 * kPi * t / 20.0);
+            parameters.exposure_time =
+                    10000.0 + 2000.0 * std::sin(2.0 * kPi * t / 30.0);
+            parameters.balance_red = 1.5;
+            parameters.balance_green = 1.0;
+            parameters.balance_blue =
+                    1.8 + 0.1 * std::sin(2.0 * kPi * t / 45.0);
+        }
+        return cameras_[camera].parameters;
+    }
+
+    void SetParameters(int camera, const CameraParameters& parameters) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cameras_[camera].parameters = parameters;
+    }
+
+private:
+    struct Pending {
+        uint64_t block_id = 0;
+        uint64_t timestamp = 0;
+        Clock::time_point ready_time;
+        bool lost = false;
+    };
+
+    struct Camera {
+        bool grabbing = false;
+        uint64_t next_block_id = 0;
+        std::deque<Pending> pending;
+        std::vector<uint8_t> pattern;
+        std::unique_ptr<BufferPool> pool;
+        CameraParameters parameters;
+    };
+
+    double Uniform() {
+        return std::uniform_real_distribution<double>(0.0, 1.0)(random_);
+    }
+
+    int64_t Jitter() {
+        if (options_.jitter_us <= 0) {
+            return 0;
+        }
+        return std::uniform_int_distribution<int64_t>(
+                -options_.jitter_us, options_.jitter_us)(random_);
+    }
+
+    void RenderPatterns() {
+        size_t bytes_per_pixel = BytesPerPixel(options_.pixel_format);
+        if (bytes_per_pixel == 0 || options_.width < kBarWidth ||
+            options_.height < 1) {
+            throw std::runtime_error("ϳ");
+        }
+        for (int camera = kLeft; camera <= kRight; ++camera) {
+            auto bgr = RenderBgrPattern(options_.width, options_.height,
+                                        camera == kLeft ? 0 : kDisparity);
+            cameras_[camera].pattern =
+                    ConvertPattern(bgr, options_.width, options_.height,
+                                   options_.pixel_format);
+            cameras_[camera].pool.reset(
+                    new BufferPool(cameras_[camera].pattern.size(),
+                                   options_.buffer_count));
+        }
+    }
+
+    void Render(const Camera& state, uint64_t block_id,
+                uint8_t* buffer) const {
+        std::memcpy(buffer, state.pattern.data(), state.pattern.size());
+
+        size_t bytes_per_pixel = BytesPerPixel(options_.pixel_format);
+        size_t stride = options_.width * bytes_per_pixel;
+        int bar_x = static_cast<int>((block_id * 8) %
+                                     (options_.width - kBarWidth));
+        for (int y = 0; y < options_.height; ++y) {
+            std::memset(buffer + y * stride + bar_x * bytes_per_pixel, 255,
+                        kBarWidth * bytes_per_pixel);
+        }
+        std::memcpy(buffer, &block_id, sizeof(block_id));
+    }
+
+private:
+    SyntheticOptions options_;
+    Clock::time_point epoch_;
+
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+    std::mt19937_64 random_;
+
+    Camera cameras_[2];
+
+    double free_run_rate_;
+    PeriodicThread free_run_;
+};
+
+class SyntheticCameraSource : public CameraSource {
+public:
+    SyntheticCameraSource(std::shared_ptr<SyntheticRig> rig, int camera)
+            : rig_(rig), camera_(camera) {}
+
+    std::string Name() const override {
+        return camera_ == kLeft ? "synthetic-left" : "synthetic-right";
+    }
+
+    void LoadFeatures(const std::string& /*feature_file*/) override {}
+    void SetPixelFormat(PixelFormat pixel_format) override {
+        rig_->SetPixelFormat(pixel_format);
+    }
+    void Configure(CameraRole role, SyncMode sync_mode,
+                   double frame_rate) override {
+        if (role == CameraRole::kMaster && sync_mode == SyncMode::kFreeRun) {
+            rig_->SetFreeRun(frame_rate);
+        }
+    }
+
+    void StartGrabbing() override {
+        rig_->StartGrabbing(camera_);
+    }
+
+    void StopGrabbing() override {
+        rig_->StopGrabbing(camera_);
+    }
+
+    void WaitForFrameTriggerReady(unsigned int /*timeout_ms*/) override {}
+
+    std::chrono::steady_clock::time_point Trigger() override {
+        return rig_->Fire();
+    }
+
+    CameraFrame RetrieveFrame(unsigned int timeout_ms) override {
+        return rig_->Retrieve(camera_, timeout_ms);
+    }
+
+    double TimestampTickNs() override {
+        return 1.0;
+    }
+
+    BufferPoolStats GetBufferStats() const override {
+        return rig_->GetBufferStats(camera_);
+    }
+
+    CameraParameters GetParameters() override {
+        return rig_->GetParameters(camera_);
+    }
+
+    void SetParameters(const CameraParameters& parameters) override {
+        rig_->SetParameters(camera_, parameters);
+    }
+
+private:
+    std::shared_ptr<SyntheticRig> rig_;
+    int camera_;
+};
+}  // namespace
+
+SyntheticOptions ParseSyntheticOptions(const nlohmann::json& config,
+                                       const SyntheticOptions& defaults) {
+    SyntheticOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    options.width = config.value("width", options.width);
+    options.height = config.value("height", options.height);
+    if (config.count("pixel_format")) {
+        options.pixel_format = ParsePixelFormat(config["pixel_format"]);
+    }
+    options.latency_us = config.value("latency_us", options.latency_us);
+    options.jitter_us = config.value("jitter_us", options.jitter_us);
+    options.drop_rate = config.value("drop_rate", options.drop_rate);
+    options.missed_trigger_rate =
+            config.value("missed_trigger_rate", options.missed_trigger_rate);
+    options.skew_us = config.value("skew_us", options.skew_us);
+    options.clock_offset_ns =
+            config.value("clock_offset_ns", options.clock_offset_ns);
+    options.buffer_count = config.value("buffer_count", options.buffer_count);
+    return options;
+}
+
+std::pair<std::unique_ptr<CameraSource>, std::unique_ptr<CameraSource>>
+OpenSyntheticCameras(const SyntheticOptions& options) {
+    auto rig = std::make_shared<SyntheticRig>(options);
+    std::unique_ptr<CameraSource> left_camera(
+            new SyntheticCameraSource(rig, kLeft));
+    std::unique_ptr<CameraSource> right_camera(
+            new SyntheticCameraSource(rig, kRight));
+    return std::make_pair(std::move(left_camera), std::move(right_camera));
+}
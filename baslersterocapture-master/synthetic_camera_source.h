@@ -0,0 +1,48 @@
+#ifndef SYNTHETIC_CAMERA_SOURCE_H_
+#define SYNTHETIC_CAMERA_SOURCE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "json.hpp"
+
+#include "camera_source.h"
+
+struct SyntheticOptions {
+    int width = 1920;
+    int height = 1080;
+    PixelFormat pixel_format = PixelFormat::kBgr8;
+    // Trigger to delivery time of a frame.
+    int64_t latency_us = 2000;
+    // Uniform +-jitter applied to delivery time and camera timestamp.
+    int64_t jitter_us = 0;
+    // Probability that a frame is lost in transfer. It is delivered as a
+    // failed frame, like an incomplete pylon grab result.
+    double drop_rate = 0.0;
+    // Probability that the right camera ignores a trigger pulse; it
+    // delivers nothing and uses no BlockID.
+    double missed_trigger_rate = 0.0;
+    // The right camera exposes this much later than the left one.
+    int64_t skew_us = 0;
+    // Right camera clock minus left camera clock.
+    int64_t clock_offset_ns = 0;
+    // Frame buffers per camera, like pylon's MaxNumBuffer. A frame arriving
+    // while all buffers are held downstream is delivered as failed.
+    size_t buffer_count = 10;
+};
+
+SyntheticOptions ParseSyntheticOptions(
+        const nlohmann::json& config,
+        const SyntheticOptions& defaults = SyntheticOptions());
+
+// A simulated stereo rig. Triggering the left camera fires both, like the
+// hardware trigger line; in free-run the left camera fires both on its own
+// clock. Frames carry a fixed stereo pattern, a moving bar
+// and their BlockID in the first bytes, so dropped or mismatched frames are
+// visible in the recording.
+std::pair<std::unique_ptr<CameraSource>, std::unique_ptr<CameraSource>>
+OpenSyntheticCameras(const SyntheticOptions& options);
+
+#endif
@@ -0,0 +1,162 @@
+#include "trigger_pipeline.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+const std::chrono::milliseconds kTriggerRecordTimeout(100);
+}  // namespace
+
+PipelineOptions ParsePipelineOptions(const nlohmann::json& config,
+                                     const PipelineOptions& defaults) {
+    PipelineOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    options.max_in_flight =
+            config.value("max_in_flight", options.max_in_flight);
+    if (options.max_in_flight == 0) {
+        throw std::runtime_error("ͬʱ֡0");
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const PipelineStats& stats) {
+    os << "triggers " << stats.triggers << ", delivered " << stats.delivered
+       << ", overlapped " << stats.overlapped << ", lost " << stats.lost
+       << ", missed " << stats.missed << ", max in flight "
+       << stats.max_in_flight << ", latency mean " << stats.mean_latency_us
+       << " us, max " << stats.max_latency_us << " us";
+    return os;
+}
+
+TriggerPipeline::TriggerPipeline(const PipelineOptions& options)
+        : options_(options),
+          closed_(false),
+          has_block_id_(false),
+          last_block_id_(0),
+          has_match_(false),
+          match_timestamp_ns_(0),
+          total_latency_us_(0.0) {}
+
+void TriggerPipeline::Configure(const PipelineOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    options_ = options;
+}
+
+void TriggerPipeline::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_flight_.clear();
+    closed_ = false;
+    has_block_id_ = false;
+    last_block_id_ = 0;
+    has_match_ = false;
+    match_timestamp_ns_ = 0;
+    stats_ = PipelineStats();
+    total_latency_us_ = 0.0;
+}
+
+void TriggerPipeline::Close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    condition_variable_.notify_all();
+}
+
+bool TriggerPipeline::AcquireSlot(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool ready = condition_variable_.wait_for(lock, timeout, [this]() {
+        return closed_ || in_flight_.size() < options_.max_in_flight;
+    });
+    if (closed_) {
+        return false;
+    }
+    if (!ready) {
+        in_flight_.pop_front();
+        ++stats_.missed;
+    }
+    return true;
+}
+
+void TriggerPipeline::OnTriggered(
+        std::chrono::steady_clock::time_point trigger_time,
+        uint64_t parameter_epoch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!in_flight_.empty()) {
+        ++stats_.overlapped;
+    }
+    in_flight_.push_back(Trigger{trigger_time, parameter_epoch});
+    ++stats_.triggers;
+    stats_.max_in_flight = std::max(stats_.max_in_flight, in_flight_.size());
+    condition_variable_.notify_all();
+}
+
+bool TriggerPipeline::OnDelivered(
+        uint64_t block_id, int64_t timestamp_ns,
+        std::chrono::steady_clock::time_point delivery_time,
+        std::chrono::steady_clock::time_point& trigger_time,
+        uint64_t& parameter_epoch) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_variable_.wait_for(lock, kTriggerRecordTimeout, [this]() {
+            return closed_ || !in_flight_.empty();
+        });
+        // Frames skipped by the BlockIDs were triggered before this one.
+        // A BlockID that went back, e.g. the 16-bit GigE counter wrapping,
+        // skips nothing.
+        uint64_t skipped = has_block_id_ && block_id > last_block_id_
+                                   ? block_id - last_block_id_ - 1
+                                   : 0;
+        has_block_id_ = true;
+        last_block_id_ = block_id;
+        for (; skipped > 0 && in_flight_.size() > 1; --skipped) {
+            in_flight_.pop_front();
+            ++stats_.lost;
+        }
+        // The frame came from the trigger whose distance to the last
+        // matched one is closest to that of the timestamps; the camera
+        // ignored the triggers before it.
+        if (has_match_ && timestamp_ns >= 0) {
+            auto mismatch_ns = [this, timestamp_ns](const Trigger& trigger) {
+                int64_t trigger_ns =
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                trigger.time - match_trigger_time_)
+                                .count();
+                return std::llabs(trigger_ns -
+                                  (timestamp_ns - match_timestamp_ns_));
+            };
+            while (in_flight_.size() > 1 &&
+                   mismatch_ns(in_flight_[1]) < mismatch_ns(in_flight_[0])) {
+                in_flight_.pop_front();
+                ++stats_.missed;
+            }
+        }
+        if (in_flight_.empty()) {
+            return false;
+        }
+        trigger_time = in_flight_.front().time;
+        parameter_epoch = in_flight_.front().parameter_epoch;
+        in_flight_.pop_front();
+        if (timestamp_ns >= 0) {
+            has_match_ = true;
+            match_trigger_time_ = trigger_time;
+            match_timestamp_ns_ = timestamp_ns;
+        }
+        double latency_us = std::chrono::duration<double, std::micro>(
+                                    delivery_time - trigger_time)
+                                    .count();
+        ++stats_.delivered;
+        total_latency_us_ += latency_us;
+        stats_.mean_latency_us = total_latency_us_ / stats_.delivered;
+        stats_.max_latency_us = std::max(stats_.max_latency_us, latency_us);
+    }
+    condition_variable_.notify_all();
+    return true;
+}
+
+PipelineStats TriggerPipeline::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
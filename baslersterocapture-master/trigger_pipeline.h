@@ -0,0 +1,115 @@
+#ifndef TRIGGER_PIPELINE_H_
+#define TRIGGER_PIPELINE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+
+#include "json.hpp"
+
+struct PipelineOptions {
+    // Triggers issued but not yet retrieved. 1 serialises exposure, readout
+    // and transfer as before; 2 or more lets the readout of frame k overlap
+    // the exposure of frame k + 1.
+    size_t max_in_flight = 2;
+};
+
+// Reads {"max_in_flight": N}.
+PipelineOptions ParsePipelineOptions(
+        const nlohmann::json& config,
+        const PipelineOptions& defaults = PipelineOptions());
+
+struct PipelineStats {
+    uint64_t triggers = 0;
+    uint64_t delivered = 0;
+    // Triggers issued while an earlier frame was still in flight.
+    uint64_t overlapped = 0;
+    // Triggers dropped because the BlockIDs skipped their frames.
+    uint64_t lost = 0;
+    // Triggers dropped because the camera never exposed them: a later
+    // trigger fit the frame's timestamp, or none came back within the
+    // timeout.
+    uint64_t missed = 0;
+    size_t max_in_flight = 0;
+    // Trigger to delivery on the host.
+    double mean_latency_us = 0.0;
+    double max_latency_us = 0.0;
+};
+
+std::ostream& operator<<(std::ostream& os, const PipelineStats& stats);
+
+// Bookkeeping between the trigger thread and the master's retrieve thread.
+// The trigger thread takes a slot per trigger; each retrieved frame returns
+// a slot together with the trigger time and parameter epoch it was
+// triggered with. The camera delivers frames in trigger order, but may
+// lose a frame or ignore a trigger, so triggers without a frame are
+// dropped rather than handed to the next one: frames missing from the
+// BlockIDs take their triggers along, and a trigger the camera ignored is
+// recognised by the camera timestamps, which put the frame a trigger
+// later than the oldest one in flight.
+class TriggerPipeline {
+public:
+    explicit TriggerPipeline(
+            const PipelineOptions& options = PipelineOptions());
+    ~TriggerPipeline() = default;
+
+    TriggerPipeline(const TriggerPipeline&) = delete;
+    TriggerPipeline& operator=(const TriggerPipeline&) = delete;
+
+public:
+    void Configure(const PipelineOptions& options);
+
+    // Clears the in-flight triggers and statistics and reopens.
+    void Reset();
+    // Wakes a trigger thread blocked in AcquireSlot().
+    void Close();
+
+    // Trigger side. Returns false once closed. When no frame came back
+    // within `timeout`, the oldest trigger is taken as missed and dropped.
+    bool AcquireSlot(std::chrono::milliseconds timeout);
+    void OnTriggered(std::chrono::steady_clock::time_point trigger_time,
+                     uint64_t parameter_epoch);
+
+    // Retrieve side, for every frame including failed ones.
+    // `timestamp_ns` is the frame's camera timestamp in ns, or -1 if it has
+    // none. Returns false if no trigger was in flight. OnTriggered() runs
+    // after Trigger() returns, which can be after the frame already
+    // arrived, so this waits a little for it.
+    bool OnDelivered(uint64_t block_id, int64_t timestamp_ns,
+                     std::chrono::steady_clock::time_point delivery_time,
+                     std::chrono::steady_clock::time_point& trigger_time,
+                     uint64_t& parameter_epoch);
+
+    PipelineStats GetStats() const;
+
+private:
+    struct Trigger {
+        std::chrono::steady_clock::time_point time;
+        uint64_t parameter_epoch;
+    };
+
+private:
+    PipelineOptions options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable condition_variable_;
+    std::deque<Trigger> in_flight_;
+    bool closed_;
+    // BlockID of the last frame delivered.
+    bool has_block_id_;
+    uint64_t last_block_id_;
+    // Trigger time and camera timestamp of the last frame matched with a
+    // timestamp. Both clocks advance alike between two frames, so the next
+    // frame's timestamp tells which trigger it came from.
+    bool has_match_;
+    std::chrono::steady_clock::time_point match_trigger_time_;
+    int64_t match_timestamp_ns_;
+
+    PipelineStats stats_;
+    double total_latency_us_;
+};
+
+#endif
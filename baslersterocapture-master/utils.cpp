@@ -1,6 +1,18 @@
 #include "utils.h"
 
 #include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#endif
 
 #include "date.h"
 //#include "tz.h"
@@ -20,7 +32,70 @@ std::string TimeStrLocal() {
     time_t t = time(0);
     char tmp[64];
     struct tm buf;
+#ifdef _WIN32
     localtime_s(&buf, &t);
+#else
+    localtime_r(&t, &buf);
+#endif
     strftime(tmp, sizeof(tmp), "%Y-%m-%d-%H-%M-%S", &buf);
     return "[" + std::string(tmp) + "]";
+}
+
+void SleepUntil(std::chrono::steady_clock::time_point deadline,
+                std::chrono::nanoseconds spin) {
+    if (spin.count() > 0) {
+        std::this_thread::sleep_until(deadline - spin);
+    } else {
+        std::this_thread::sleep_until(deadline);
+    }
+    while (std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+}
+
+int64_t ToNanoseconds(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   time.time_since_epoch())
+            .count();
+}
+
+bool SetCurrentThreadAffinity(const std::vector<int>& cpus) {
+#ifdef _WIN32
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= static_cast<int>(sizeof(mask) * 8)) {
+            return false;
+        }
+        mask |= static_cast<DWORD_PTR>(1) << cpu;
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE) {
+            return false;
+        }
+        CPU_SET(cpu, &set);
+    }
+    return !cpus.empty() &&
+           pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+bool MakeDirectory(const std::string& path) {
+#ifdef _WIN32
+    if (CreateDirectoryA(path.c_str(), nullptr)) {
+        return true;
+    }
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES &&
+           (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+    if (mkdir(path.c_str(), 0777) == 0) {
+        return true;
+    }
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
 }
\ No newline at end of file
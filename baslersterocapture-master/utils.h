@@ -1,10 +1,27 @@
 #ifndef UTILS_H_
 #define UTILS_H_
 
+#include <chrono>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 std::string TimeStr();
 
 std::string TimeStrLocal();
 
+// Sleeps until `spin` before the deadline and busy-waits the rest, since
+// OS sleeps wake up late by up to a scheduler tick.
+void SleepUntil(std::chrono::steady_clock::time_point deadline,
+                std::chrono::nanoseconds spin);
+
+int64_t ToNanoseconds(std::chrono::steady_clock::time_point time);
+
+// Restricts the calling thread to `cpus` (indexes in the first processor
+// group on Windows). Returns false if the OS refused.
+bool SetCurrentThreadAffinity(const std::vector<int>& cpus);
+
+// Creates one directory level. Returns true if it exists afterwards.
+bool MakeDirectory(const std::string& path);
+
 #endif
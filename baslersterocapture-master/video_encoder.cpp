@@ -0,0 +1,367 @@
+#include "video_encoder.h"
+
+#include <chrono>
+#include <stdexcept>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+}
+
+namespace {
+AVPixelFormat ParsePixelFormat(const std::string& name) {
+    AVPixelFormat format = av_get_pix_fmt(name.c_str());
+    if (format != AV_PIX_FMT_YUV420P && format != AV_PIX_FMT_YUV422P &&
+        format != AV_PIX_FMT_YUV444P && format != AV_PIX_FMT_GBRP &&
+        format != AV_PIX_FMT_GRAY8) {
+        throw std::runtime_error("ֵ֧ıظʽ: " + name);
+    }
+    return format;
+}
+
+int ParseThreadType(const std::string& name) {
+    if (name == "slice") {
+        return FF_THREAD_SLICE;
+    }
+    if (name == "frame") {
+        return FF_THREAD_FRAME;
+    }
+    if (name == "auto") {
+        return FF_THREAD_SLICE | FF_THREAD_FRAME;
+    }
+    throw std::runtime_error("δ֪ı߳: " + name);
+}
+
+// Sends `frame` (nullptr flushes) and drops the packets that come out,
+// adding up their size in `bytes`.
+void EncodeAndDiscard(AVCodecContext* context, AVFrame* frame,
+                      AVPacket* packet, int64_t* bytes) {
+    int ret = avcodec_send_frame(context, frame);
+    while (ret >= 0) {
+        ret = avcodec_receive_packet(context, packet);
+        if (ret >= 0) {
+            *bytes += packet->size;
+            av_packet_unref(packet);
+        }
+    }
+    if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+        throw std::runtime_error("Լʧ: " + GetErrorString(ret));
+    }
+}
+
+void ReadEncoderOptions(const nlohmann::json& config,
+                        EncoderOptions* options) {
+    options->codec = config.value("codec", options->codec);
+    if (config.count("codec_options")) {
+        for (auto& item : config["codec_options"].items()) {
+            // Numbers are accepted as well as strings, e.g. "crf": 18.
+            options->codec_options[item.key()] =
+                    item.value().is_string()
+                            ? item.value().get<std::string>()
+                            : item.value().dump();
+        }
+    }
+    if (config.count("pixel_format")) {
+        options->pixel_format = ParsePixelFormat(config["pixel_format"]);
+    }
+    options->gop_size = config.value("gop_size", options->gop_size);
+    options->max_b_frames =
+            config.value("max_b_frames", options->max_b_frames);
+    options->qmin = config.value("qmin", options->qmin);
+    options->qmax = config.value("qmax", options->qmax);
+    options->container = config.value("container", options->container);
+    options->tracks = config.value("tracks", options->tracks);
+    if (config.count("pts")) {
+        options->pts = ParsePtsSource(config["pts"]);
+    }
+    options->timestamp_tick_ns =
+            config.value("timestamp_tick_ns", options->timestamp_tick_ns);
+    options->shards = config.value("shards", options->shards);
+    options->threads = config.value("threads", options->threads);
+    if (config.count("thread_type")) {
+        options->thread_type = ParseThreadType(config["thread_type"]);
+    }
+    if (config.count("affinity")) {
+        options->affinity = config["affinity"].get<std::vector<int>>();
+    }
+    options->self_check_frames =
+            config.value("self_check_frames", options->self_check_frames);
+}
+}  // namespace
+
+PtsSource ParsePtsSource(const std::string& name) {
+    if (name == "frame_count") {
+        return PtsSource::kFrameCount;
+    }
+    if (name == "camera") {
+        return PtsSource::kCamera;
+    }
+    if (name == "trigger") {
+        return PtsSource::kTrigger;
+    }
+    throw std::runtime_error("δ֪PTSԴ: " + name);
+}
+
+std::string PtsSourceName(PtsSource source) {
+    switch (source) {
+        case PtsSource::kCamera:
+            return "camera";
+        case PtsSource::kTrigger:
+            return "trigger";
+        default:
+            return "frame_count";
+    }
+}
+
+EncoderOptions ParseEncoderOptions(const nlohmann::json& config,
+                                   const EncoderOptions& defaults) {
+    EncoderOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    if (config.count("profile")) {
+        std::string name = config["profile"];
+        if (!config.count("profiles") || !config["profiles"].count(name)) {
+            throw std::runtime_error("δ֪ı: " + name);
+        }
+        ReadEncoderOptions(config["profiles"][name], &options);
+        options.profile = name;
+    }
+    ReadEncoderOptions(config, &options);
+    if (options.codec.empty()) {
+        throw std::runtime_error("δָ");
+    }
+    if (options.gop_size < 0 || options.max_b_frames < 0) {
+        throw std::runtime_error("ؼ֡B֡Ϊ");
+    }
+    if (options.tracks != 1 && options.tracks != 2) {
+        throw std::runtime_error("ƵֻΪ12");
+    }
+    if (options.timestamp_tick_ns < 0.0) {
+        throw std::runtime_error("ʱڲΪ");
+    }
+    if (options.shards <= 0) {
+        throw std::runtime_error("Ƭ0");
+    }
+    if (options.threads < 0) {
+        throw std::runtime_error("߳Ϊ");
+    }
+    return options;
+}
+
+std::string ThreadTypeName(int thread_type) {
+    switch (thread_type) {
+        case FF_THREAD_SLICE:
+            return "slice";
+        case FF_THREAD_FRAME:
+            return "frame";
+        case FF_THREAD_SLICE | FF_THREAD_FRAME:
+            return "auto";
+        default:
+            return "none";
+    }
+}
+
+YuvLayout YuvLayoutOf(AVPixelFormat pixel_format) {
+    switch (pixel_format) {
+        case AV_PIX_FMT_YUV420P:
+            return YuvLayout::k420;
+        case AV_PIX_FMT_YUV422P:
+            return YuvLayout::k422;
+        case AV_PIX_FMT_YUV444P:
+            return YuvLayout::k444;
+        case AV_PIX_FMT_GBRP:
+            return YuvLayout::kGbr;
+        case AV_PIX_FMT_GRAY8:
+            return YuvLayout::kGray;
+        default:
+            throw std::runtime_error("ֵ֧ıظʽ");
+    }
+}
+
+int64_t RawFrameBytes(AVPixelFormat pixel_format, int width, int height) {
+    return av_image_get_buffer_size(pixel_format, width, height, 1);
+}
+
+std::ostream& operator<<(std::ostream& os, const EncoderStats& stats) {
+    const char* pixel_format = av_get_pix_fmt_name(stats.pixel_format);
+    os << stats.codec << " " << (pixel_format ? pixel_format : "none");
+    if (!stats.profile.empty()) {
+        os << " (profile " << stats.profile << ")";
+    }
+    os << ", " << stats.shards << " shards x " << stats.threads << " threads ("
+       << ThreadTypeName(stats.thread_type) << "), self-check "
+       << stats.self_check.fps << " fps, frames " << stats.frames
+       << ", written " << stats.bytes / 1e6 << " MB, mean " << stats.mean_ms
+       << " ms, max " << stats.max_ms << " ms, reorder high water "
+       << stats.reorder_high_water_mark << ", window waits "
+       << stats.window_waits << ", pts adjusted " << stats.pts_adjusted
+       << ", pts estimated " << stats.pts_estimated;
+    return os;
+}
+
+const AVCodec* FindEncoder(const EncoderOptions& options) {
+    const AVCodec* codec = avcodec_find_encoder_by_name(options.codec.c_str());
+    if (!codec) {
+        throw std::runtime_error("޷ҵ: " + options.codec);
+    }
+    return codec;
+}
+
+AVCodecContext* OpenEncoder(const AVCodec* codec, int width, int height,
+                            double fps, int64_t bit_rate, bool global_header,
+                            const EncoderOptions& options) {
+    if (codec->pix_fmts) {
+        const AVPixelFormat* format = codec->pix_fmts;
+        while (*format != AV_PIX_FMT_NONE && *format != options.pixel_format) {
+            ++format;
+        }
+        if (*format == AV_PIX_FMT_NONE) {
+            throw std::runtime_error(
+                    std::string(" ") + codec->name + " ֧ظʽ " +
+                    av_get_pix_fmt_name(options.pixel_format));
+        }
+    }
+
+    AVCodecContext* context = avcodec_alloc_context3(codec);
+    if (!context) {
+        throw std::runtime_error("޷ʼ");
+    }
+
+    context->codec_id = codec->id;
+    context->codec_type = AVMEDIA_TYPE_VIDEO;
+    context->bit_rate = bit_rate;
+    context->width = width;
+    context->height = height;
+    context->time_base = AVRational{1, static_cast<int>(fps * 1)};
+    context->gop_size = options.gop_size;
+    context->max_b_frames = options.max_b_frames;
+    if (options.qmin >= 0) {
+        context->qmin = options.qmin;
+    }
+    if (options.qmax >= 0) {
+        context->qmax = options.qmax;
+    }
+    context->pix_fmt = options.pixel_format;
+    // What YuvConverter writes. The lossless layouts are camera samples.
+    switch (YuvLayoutOf(options.pixel_format)) {
+        case YuvLayout::kGbr:
+            context->color_range = AVCOL_RANGE_JPEG;
+            context->colorspace = AVCOL_SPC_RGB;
+            break;
+        case YuvLayout::kGray:
+            context->color_range = AVCOL_RANGE_JPEG;
+            break;
+        default:
+            context->color_range = AVCOL_RANGE_MPEG;
+            context->colorspace = AVCOL_SPC_SMPTE170M;
+            break;
+    }
+    context->thread_count = options.threads;
+    context->thread_type = options.thread_type;
+
+    if (codec->id == AV_CODEC_ID_MPEG1VIDEO) {
+        context->mb_decision = 2;
+    }
+
+    if (global_header) {
+        context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    if (codec->id == AV_CODEC_ID_H264 &&
+        !options.codec_options.count("preset")) {
+        av_opt_set(context->priv_data, "preset", "slow", 0);
+    }
+
+    for (auto& option : options.codec_options) {
+        if (av_opt_set(context, option.first.c_str(), option.second.c_str(),
+                       AV_OPT_SEARCH_CHILDREN) < 0) {
+            std::string name = codec->name;
+            avcodec_free_context(&context);
+            throw std::runtime_error(" " + name + " ֲ֧ " +
+                                     option.first + "=" + option.second);
+        }
+    }
+
+    int ret = avcodec_open2(context, codec, nullptr);
+    if (ret < 0) {
+        avcodec_free_context(&context);
+        throw std::runtime_error("޷򿪱: " + GetErrorString(ret));
+    }
+    return context;
+}
+
+EncoderRate MeasureEncoderRate(const AVCodec* codec, int width, int height,
+                               double fps, int64_t bit_rate,
+                               const EncoderOptions& options, int frames) {
+    AVCodecContext* context = OpenEncoder(codec, width, height, fps, bit_rate,
+                                          false, options);
+    AVFrame* frame = av_frame_alloc();
+    AVPacket* packet = av_packet_alloc();
+    EncoderRate rate;
+    try {
+        if (!frame || !packet) {
+            throw std::runtime_error("޷ʼƵ֡");
+        }
+        frame->format = context->pix_fmt;
+        frame->width = width;
+        frame->height = height;
+        if (av_frame_get_buffer(frame, 32) < 0) {
+            throw std::runtime_error("޷Ƶ֡ռ");
+        }
+
+        // Noisy gradients, as intra encoders spend more on texture than on
+        // flat images.
+        const AVPixFmtDescriptor* descriptor =
+                av_pix_fmt_desc_get(context->pix_fmt);
+        int chroma_rows = AV_CEIL_RSHIFT(height, descriptor->log2_chroma_h);
+        int chroma_columns = AV_CEIL_RSHIFT(width, descriptor->log2_chroma_w);
+        int planes = av_pix_fmt_count_planes(context->pix_fmt);
+        uint32_t noise = 1;
+        for (int plane = 0; plane < planes; ++plane) {
+            int rows = plane == 0 ? height : chroma_rows;
+            int columns = plane == 0 ? width : chroma_columns;
+            for (int y = 0; y < rows; ++y) {
+                uint8_t* row = frame->data[plane] + y * frame->linesize[plane];
+                for (int x = 0; x < columns; ++x) {
+                    noise = noise * 1103515245 + 12345;
+                    row[x] = static_cast<uint8_t>(x / 4 + y / 2 +
+                                                  (noise >> 16) % 16);
+                }
+            }
+        }
+
+        int64_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; ++i) {
+            if (av_frame_make_writable(frame) < 0) {
+                throw std::runtime_error("׼дƵ֡");
+            }
+            frame->pts = i;
+            EncodeAndDiscard(context, frame, packet, &bytes);
+        }
+        EncodeAndDiscard(context, nullptr, packet, &bytes);
+        double seconds = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+        rate.fps = seconds > 0.0 ? frames / seconds : 0.0;
+        rate.bytes_per_frame =
+                frames > 0 ? static_cast<double>(bytes) / frames : 0.0;
+    } catch (...) {
+        av_packet_free(&packet);
+        av_frame_free(&frame);
+        avcodec_free_context(&context);
+        throw;
+    }
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&context);
+    return rate;
+}
+
+std::string GetErrorString(int error_num) {
+    char av_error[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_make_error_string(av_error, AV_ERROR_MAX_STRING_SIZE, error_num);
+    return std::string(av_error);
+}
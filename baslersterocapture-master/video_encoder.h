@@ -0,0 +1,155 @@
+#ifndef VIDEO_ENCODER_H_
+#define VIDEO_ENCODER_H_
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#include "yuv_converter.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Where the pts of the recorded frames come from.
+enum class PtsSource {
+    // Frame n has pts n in 1 / fps, so dropped frames shift the rest.
+    kFrameCount,
+    // The left camera's timestamp, in microseconds from the first frame.
+    kCamera,
+    // The host trigger time, in microseconds from the first frame. Needs
+    // the software trigger.
+    kTrigger,
+};
+
+PtsSource ParsePtsSource(const std::string& name);
+std::string PtsSourceName(PtsSource source);
+
+// An encoder profile. The defaults are the former compiled-in mpeg4 setup.
+struct EncoderOptions {
+    // Name of the profile these options came from, if any.
+    std::string profile;
+    // ffmpeg encoder name, e.g. "mpeg4", "libx264", "ffv1", "mjpeg".
+    std::string codec = "mpeg4";
+    // AVOptions of the encoder or its context, e.g. "preset", "tune",
+    // "crf".
+    std::map<std::string, std::string> codec_options;
+    // AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P or AV_PIX_FMT_YUV444P, or for
+    // lossless recording AV_PIX_FMT_GBRP (BGR8 and demosaiced Bayer frames)
+    // or AV_PIX_FMT_GRAY8 (Mono8 frames and the raw Bayer mosaic).
+    AVPixelFormat pixel_format = AV_PIX_FMT_YUV420P;
+    int gop_size = 1;
+    int max_b_frames = 0;
+    // Quantizer range; -1 keeps the encoder's default.
+    int qmin = 1;
+    int qmax = 1;
+    // ffmpeg muxer name, e.g. "avi", "matroska", "nut". Empty guesses it
+    // from the file name.
+    std::string container = "avi";
+    // 1 records the side-by-side frames as one stream. 2 records the left
+    // and right halves as two streams of the same file, each with its own
+    // encoders, so readers can decode one view alone.
+    int tracks = 1;
+    // kCamera and kTrigger need a container with free timestamps, not AVI.
+    PtsSource pts = PtsSource::kFrameCount;
+    // Length of a camera timestamp tick in ns, for PtsSource::kCamera. 0
+    // uses the tick the camera reports; set it only to override that.
+    double timestamp_tick_ns = 0.0;
+    // Independent encoders that take frames in turn, each on its own
+    // thread, per track. Only for all-intra streams of encoders that do
+    // not hold frames back, so not for libx264 or ffv1.
+    int shards = 1;
+    // ffmpeg threads per encoder. 0 lets ffmpeg start one per core.
+    int threads = 0;
+    // FF_THREAD_SLICE and/or FF_THREAD_FRAME; ffmpeg uses what the codec
+    // supports.
+    int thread_type = FF_THREAD_SLICE | FF_THREAD_FRAME;
+    // CPUs the shard threads run on, which convert and encode; empty
+    // leaves them to the OS. ffmpeg's own threads are not pinned.
+    std::vector<int> affinity;
+    // Frames encoded by Open() to measure the rate the encoder sustains.
+    // 0 skips the check.
+    int self_check_frames = 30;
+};
+
+// Reads {"codec": name, "codec_options": {name: value, ...},
+// "pixel_format": "yuv420p"|"yuv422p"|"yuv444p"|"gbrp"|"gray",
+// "gop_size": N,
+// "max_b_frames": N, "qmin": N, "qmax": N, "container": name, "tracks": N,
+// "pts": "frame_count"|"camera"|"trigger", "timestamp_tick_ns": x,
+// "shards": N,
+// "threads": N, "thread_type": "slice"|"frame"|"auto",
+// "affinity": [cpu, ...], "self_check_frames": N}. With "profile": name,
+// the options of "profiles"[name] apply first and the other keys override
+// them.
+EncoderOptions ParseEncoderOptions(
+        const nlohmann::json& config,
+        const EncoderOptions& defaults = EncoderOptions());
+
+std::string ThreadTypeName(int thread_type);
+
+// Planes the converter writes for an encoder pixel format.
+YuvLayout YuvLayoutOf(AVPixelFormat pixel_format);
+
+// Bytes of one uncompressed frame, i.e. what rawvideo writes per frame.
+int64_t RawFrameBytes(AVPixelFormat pixel_format, int width, int height);
+
+struct EncoderRate {
+    double fps = 0.0;
+    // Mean packet size. The frames are synthetic, so for lossy and lossless
+    // codecs alike it only hints at the disk bandwidth of real images.
+    double bytes_per_frame = 0.0;
+};
+
+struct EncoderStats {
+    std::string profile;
+    std::string codec;
+    AVPixelFormat pixel_format = AV_PIX_FMT_NONE;
+    int shards = 0;
+    // What ffmpeg actually started per shard, after resolving 0 and "auto".
+    int threads = 0;
+    int thread_type = 0;
+    EncoderRate self_check;
+    uint64_t frames = 0;
+    // Packet bytes written.
+    uint64_t bytes = 0;
+    // Encode time of one frame on its shard.
+    double mean_ms = 0.0;
+    double max_ms = 0.0;
+    // Packets held back until the frames before them were written.
+    size_t reorder_high_water_mark = 0;
+    // Submits that waited for a shard to take a frame.
+    uint64_t window_waits = 0;
+    // Frames whose pts did not increase and was moved past the last one.
+    uint64_t pts_adjusted = 0;
+    // Trigger pts frames without a trigger time, placed a frame after the
+    // previous one instead.
+    uint64_t pts_estimated = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, const EncoderStats& stats);
+
+// Looks up options.codec. Throws if ffmpeg has no such encoder.
+const AVCodec* FindEncoder(const EncoderOptions& options);
+
+// Opens an encoder context for the profile in `options`, checking that the
+// encoder takes its pixel format and codec options. `global_header` is for
+// containers that want the codec headers out of band. Throws on failure;
+// the caller frees the context.
+AVCodecContext* OpenEncoder(const AVCodec* codec, int width, int height,
+                            double fps, int64_t bit_rate, bool global_header,
+                            const EncoderOptions& options);
+
+// Encodes `frames` synthetic frames on a private encoder opened like
+// OpenEncoder() and returns the frames/s it managed, flush included.
+EncoderRate MeasureEncoderRate(const AVCodec* codec, int width, int height,
+                               double fps, int64_t bit_rate,
+                               const EncoderOptions& options, int frames);
+
+std::string GetErrorString(int error_num);
+
+#endif
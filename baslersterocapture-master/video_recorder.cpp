@@ -1,86 +1,131 @@
 #include "video_recorder.h"
 
+#include <cmath>
+#include <cstring>
 #include <iostream>
 
 #pragma comment(lib, "avformat.lib")
 #pragma comment(lib, "avutil.lib")
 #pragma comment(lib, "avcodec.lib")
-#pragma comment(lib, "swscale.lib")
 
 namespace {
-const char* kCodecName = "mpeg4";
-const AVPixelFormat kPixelFormat = AV_PIX_FMT_YUV420P;
-//const AVPixelFormat kPixelFormat = AV_PIX_FMT_YUV422P;
-
-std::string GetErrorString(int error_num) {
-    char av_error[AV_ERROR_MAX_STRING_SIZE] = {0};
-    av_make_error_string(av_error, AV_ERROR_MAX_STRING_SIZE, error_num);
-    return std::string(av_error);
+// Packet time base of the timestamp pts sources.
+const AVRational kMicroseconds = {1, 1000000};
+
+// What VideoRecorder::FramePts() counts in; the encoder's for frame counts.
+AVRational PtsTimeBase(PtsSource source, double fps) {
+    return source == PtsSource::kFrameCount
+                   ? AVRational{1, static_cast<int>(fps)}
+                   : kMicroseconds;
 }
-
 }  // namespace
 
+std::string ContainerExtension(const std::string& container) {
+    AVOutputFormat* format = av_guess_format(container.c_str(), nullptr,
+                                             nullptr);
+    if (!format) {
+        throw std::runtime_error("޷ҵװʽ: " + container);
+    }
+    std::string extensions = format->extensions ? format->extensions : "";
+    if (extensions.empty()) {
+        return "";
+    }
+    return "." + extensions.substr(0, extensions.find(','));
+}
+
 VideoRecorder::VideoRecorder()
         : is_opened_(false),
-          writer_thread_stop_flag_(false),
           format_(nullptr),
-          format_context_(nullptr),
           codec_(nullptr),
-          codec_context_(nullptr),
-          stream_(nullptr),
-          frame_(nullptr),
-          packet_(nullptr),
-          sws_context_(nullptr),
-          frame_count_(0) {}
+          self_check_(),
+          frames_submitted_(0),
+          first_timestamp_set_(false),
+          first_timestamp_(0),
+          last_pts_(0),
+          frame_duration_us_(0),
+          pts_estimated_(0),
+          timestamp_tick_ns_(1.0) {}
 
 VideoRecorder::~VideoRecorder() {
     Close();
 }
 
 void VideoRecorder::Open(const std::string& name, size_t width, size_t height,
-                         double fps, int64_t bit_rate) {
+                         double fps, int64_t bit_rate, SyncMode sync_mode,
+                         double timestamp_tick_ns,
+                         const QueueOptions& queue_options,
+                         const YuvConverterOptions& converter_options,
+                         const EncoderOptions& encoder_options,
+                         const MuxerOptions& muxer_options,
+                         const ImageSequenceOptions& image_options,
+                         const SidecarOptions& sidecar_options) {
     if (is_opened_) {
         return;
     }
+    // Free-run frames carry no trigger time.
+    if (encoder_options.pts == PtsSource::kTrigger &&
+        sync_mode != SyncMode::kSoftwareTrigger) {
+        throw std::runtime_error("ʱPTSֻģʽ");
+    }
 
-    is_opened_ = true;
-    writer_thread_stop_flag_ = false;
+    image_queue_.Configure(queue_options);
+    image_queue_.Open();
+    converter_.Configure(converter_options);
+    encoder_options_ = encoder_options;
+    muxer_options_ = muxer_options;
+    image_options_ = image_options;
+    sidecar_options_ = sidecar_options;
+    frames_submitted_ = 0;
+    first_timestamp_set_ = false;
+    last_pts_ = 0;
+    frame_duration_us_ = static_cast<int64_t>(1e6 / fps);
+    pts_estimated_ = 0;
+    timestamp_tick_ns_ = encoder_options.timestamp_tick_ns > 0.0
+                                 ? encoder_options.timestamp_tick_ns
+                                 : timestamp_tick_ns;
 
     /*writer_.open(name, cv::VideoWriter::fourcc('D', 'I', 'V', 'X'), fps,
                  cv::Size(static_cast<int>(width), static_cast<int>(height)),
                  true);*/
-    Init(name, width, height, fps, bit_rate);
+    try {
+        if (image_options_.enabled) {
+            image_writer_.Open(name, image_options_);
+            if (sidecar_options_.enabled) {
+                AVRational time_base = PtsTimeBase(encoder_options_.pts, fps);
+                sidecar_.Open(name + "/frames.meta", 0, fps, time_base.num,
+                              time_base.den, sidecar_options_);
+            }
+        } else {
+            Init(name, width, height, fps, bit_rate);
+            CheckEncoderRate(fps, bit_rate);
+        }
+    } catch (...) {
+        image_queue_.Close();
+        CloseOutputs();
+        throw;
+    }
 
+    is_opened_ = true;
     writer_thread_ = std::thread([this]() {
         size_t count = 0;
         try {
             std::cout << "ʼ¼" << std::endl;
-            while (!writer_thread_stop_flag_) {
-                cv::Mat image;
-                {
-                    std::unique_lock<std::mutex> lock(image_queue_mutex_);
-                    if (image_queue_.empty()) {
-                        image_queue_condition_variable_.wait(lock, [this]() {
-                            return !image_queue_.empty() ||
-                                   writer_thread_stop_flag_;
-                        });
-                    }
-                    if (writer_thread_stop_flag_) {
-                        break;
-                    }
-                    image = image_queue_.front();
-                    image_queue_.pop_front();
+            StereoFrame frame;
+            while (image_queue_.WaitNotEmpty()) {
+                if (image_queue_.IsClosed()) {
+                    break;
                 }
-                Encode(image);
+                if (!image_queue_.TryPop(frame)) {
+                    continue;
+                }
+                Submit(frame);
                 ++count;
                 std::cout << "д " << count << " ֡" << std::endl;
             }
-            std::unique_lock<std::mutex> lock(image_queue_mutex_);
-            while (!image_queue_.empty()) {
-                std::cout << "дƵʣ: " << image_queue_.size()
+            while (image_queue_.TryPop(frame)) {
+                std::cout << "дƵʣ: " << image_queue_.Size() + 1
                           << " ֡" << std::endl;
-                Encode(image_queue_.front());
-                image_queue_.pop_front();
+                Submit(frame);
             }
         } catch (const std::exception& e) {
             std::cout << "Ƶд쳣: " << e.what() << std::endl;
@@ -93,189 +138,233 @@ void VideoRecorder::Close() {
     if (!is_opened_) {
         return;
     }
-    writer_thread_stop_flag_ = true;
-    image_queue_condition_variable_.notify_all();
-    writer_thread_.join();
+    image_queue_.Close();
+    // Close() may run twice, from the camera's error callback and main().
+    if (writer_thread_.joinable()) {
+        writer_thread_.join();
+    }
     /*writer_.release();*/
-    EncodeAVFrame(codec_context_, nullptr, packet_);
-
-    av_write_trailer(format_context_);
-    avio_close(format_context_->pb);
-
-    avcodec_close(codec_context_);
-    avcodec_free_context(&codec_context_);
-    av_frame_free(&frame_);
-    av_packet_free(&packet_);
-    sws_freeContext(sws_context_);
-    avformat_free_context(format_context_);
-
-    format_ = nullptr;
-    format_context_ = nullptr;
-    codec_ = nullptr;
-    codec_context_ = nullptr;
-    frame_ = nullptr;
-    packet_ = nullptr;
-    sws_context_ = nullptr;
+    CloseOutputs();
 
 	std::cout << "ֹͣ¼ƣƵѹر" << std::endl;
 }
 
-void VideoRecorder::Write(const cv::Mat& image) {
-    if (!is_opened_) {
-        return;
-    }
-    {
-        std::unique_lock<std::mutex> lock(image_queue_mutex_);
-        image_queue_.push_back(image);
-    }
-    image_queue_condition_variable_.notify_all();
-}
-
-void VideoRecorder::Init(const std::string& name, size_t width, size_t height,
-                         double fps, int64_t bit_rate) {
-    format_ = av_guess_format(nullptr, name.c_str(), nullptr);
-    if (!format_) {
-        throw std::runtime_error("޷ҵװʽ");
-    }
-
-    avformat_alloc_output_context2(&format_context_, format_, format_->name,
-                                   name.c_str());
-    if (!format_context_) {
-        throw std::runtime_error("޷װ");
+void VideoRecorder::CloseOutputs() {
+    for (auto& encoder : encoders_) {
+        try {
+            encoder.Close();
+        } catch (const std::exception& e) {
+            std::cout << "Ƶд쳣: " << e.what() << std::endl;
+        }
     }
 
-    stream_ = avformat_new_stream(format_context_, nullptr);
-    if (!stream_) {
-        throw std::runtime_error("޷Ƶ");
+    try {
+        muxer_.Close();
+    } catch (const std::exception& e) {
+        std::cout << "Ƶд쳣: " << e.what() << std::endl;
     }
 
-    codec_ = avcodec_find_encoder_by_name(kCodecName);
-    if (!codec_) {
-        throw std::runtime_error("޷ҵ");
+    try {
+        image_writer_.Close();
+    } catch (const std::exception& e) {
+        std::cout << "ͼд쳣: " << e.what() << std::endl;
     }
 
-    codec_context_ = avcodec_alloc_context3(codec_);
-    if (!codec_context_) {
-        throw std::runtime_error("޷ʼ");
+    try {
+        sidecar_.Close();
+    } catch (const std::exception& e) {
+        std::cout << "Ԫд쳣: " << e.what() << std::endl;
     }
 
-    codec_context_->codec_id = codec_->id;
-    codec_context_->codec_type = AVMEDIA_TYPE_VIDEO;
-    codec_context_->bit_rate = bit_rate;
-    codec_context_->width = static_cast<int>(width);
-    codec_context_->height = static_cast<int>(height);
-    codec_context_->time_base = AVRational{1, static_cast<int>(fps * 1)};
-    codec_context_->gop_size = 1;
-    codec_context_->max_b_frames = 0;
-    codec_context_->qmin = 1;
-    codec_context_->qmax = 1;
-    codec_context_->pix_fmt = kPixelFormat;
-
-    if (codec_->id == AV_CODEC_ID_MPEG2VIDEO) {
-        codec_context_->max_b_frames = 2;
-    }
+    format_ = nullptr;
+    codec_ = nullptr;
+}
 
-    if (codec_->id == AV_CODEC_ID_MPEG1VIDEO) {
-        codec_context_->mb_decision = 2;
+void VideoRecorder::Write(const StereoFrame& frame) {
+    if (!is_opened_) {
+        return;
     }
+    image_queue_.Push(frame);
+}
 
-    if (format_context_->oformat->flags & AVFMT_GLOBALHEADER) {
-        codec_context_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-    }
+QueueStats VideoRecorder::GetQueueStats() const {
+    return image_queue_.GetStats();
+}
 
-    if (codec_->id == AV_CODEC_ID_H264) {
-        av_opt_set(codec_context_->priv_data, "preset", "slow", 0);
-    }
+YuvConverterStats VideoRecorder::GetConverterStats() const {
+    return converter_.GetStats();
+}
 
-    int ret = avcodec_open2(codec_context_, codec_, nullptr);
-    if (ret < 0) {
-        throw std::runtime_error("޷򿪱: " + GetErrorString(ret));
-    }
+EncoderStats VideoRecorder::GetEncoderStats(size_t track) const {
+    EncoderStats stats = encoders_[track].GetStats();
+    stats.self_check = self_check_;
+    stats.pts_estimated = pts_estimated_;
+    return stats;
+}
 
-    avcodec_parameters_from_context(stream_->codecpar, codec_context_);
+MuxerStats VideoRecorder::GetMuxerStats() const {
+    return muxer_.GetStats();
+}
 
-    av_dump_format(format_context_, 0, name.c_str(), 1);
+ImageSequenceStats VideoRecorder::GetImageSequenceStats() const {
+    return image_writer_.GetStats();
+}
 
-    stream_->time_base = codec_context_->time_base =
-            AVRational{1, static_cast<int>(fps * 1)};
-    stream_->r_frame_rate = stream_->avg_frame_rate =
-            AVRational{static_cast<int>(fps), 1};
+SidecarStats VideoRecorder::GetSidecarStats() const {
+    return sidecar_.GetStats();
+}
 
-    ret = avio_open(&format_context_->pb, name.c_str(), AVIO_FLAG_WRITE);
-    if (ret < 0) {
-        throw std::runtime_error("޷ļ: " + name);
+void VideoRecorder::Init(const std::string& name, size_t width, size_t height,
+                         double fps, int64_t bit_rate) {
+    const std::string& container = encoder_options_.container;
+    if (container.empty()) {
+        format_ = av_guess_format(nullptr, name.c_str(), nullptr);
+    } else {
+        format_ = av_guess_format(container.c_str(), nullptr, nullptr);
     }
-
-    avformat_write_header(format_context_, nullptr);
-
-    int buffer_size = av_image_get_buffer_size(codec_context_->pix_fmt,
-                                               codec_context_->width,
-                                               codec_context_->height, 1);
-
-    frame_ = av_frame_alloc();
-    if (!frame_) {
-        throw std::runtime_error("޷ʼƵ֡");
+    if (!format_) {
+        throw std::runtime_error("޷ҵװʽ: " + container);
     }
 
-    frame_->format = codec_context_->pix_fmt;
-    frame_->width = codec_context_->width;
-    frame_->height = codec_context_->height;
-
-    ret = av_frame_get_buffer(frame_, 32);
-    if (ret < 0) {
-        throw std::runtime_error("޷Ƶ֡ռ");
+    // AVI has a fixed frame rate and fills gaps in the pts with empty
+    // frames.
+    if (encoder_options_.pts != PtsSource::kFrameCount &&
+        std::strcmp(format_->name, "avi") == 0) {
+        throw std::runtime_error("AVIװֻʹ֡ΪPTS");
     }
 
-    packet_ = av_packet_alloc();
-    if (!packet_) {
-        throw std::runtime_error("޷ʼƵݰ");
+    codec_ = FindEncoder(encoder_options_);
+    if (avformat_query_codec(format_, codec_->id, FF_COMPLIANCE_NORMAL) == 0) {
+        throw std::runtime_error(std::string("װʽ ") + format_->name +
+                                 " ֱ֧ " + codec_->name);
     }
 
-    sws_context_ = sws_getContext(
-            codec_context_->width, codec_context_->height, AV_PIX_FMT_BGR24,
-            codec_context_->width, codec_context_->height,
-            codec_context_->pix_fmt, SWS_BICUBIC, nullptr, nullptr, nullptr);
-    if (!sws_context_) {
-        throw std::runtime_error("޷ʼ֡ʽת");
+    bool global_header = (format_->flags & AVFMT_GLOBALHEADER) != 0;
+    AVRational time_base = encoder_options_.pts == PtsSource::kFrameCount
+                                   ? AVRational{0, 1}
+                                   : kMicroseconds;
+    std::vector<MuxerTrack> tracks;
+    if (encoder_options_.tracks == 2) {
+        const StereoView views[2] = {StereoView::kLeft, StereoView::kRight};
+        const char* titles[2] = {"left", "right"};
+        for (size_t i = 0; i < 2; ++i) {
+            encoders_[i].Open(
+                    codec_, static_cast<int>(width / 2),
+                    static_cast<int>(height), fps, bit_rate / 2,
+                    global_header, encoder_options_, views[i], &converter_,
+                    [this, i](AVPacket* packet) { muxer_.Write(packet, i); });
+            MuxerTrack track;
+            track.context = encoders_[i].GetContext();
+            track.time_base = time_base;
+            track.title = titles[i];
+            tracks.push_back(track);
+        }
+    } else {
+        encoders_[0].Open(
+                codec_, static_cast<int>(width), static_cast<int>(height),
+                fps, bit_rate, global_header, encoder_options_,
+                StereoView::kSideBySide, &converter_,
+                [this](AVPacket* packet) { muxer_.Write(packet); });
+        MuxerTrack track;
+        track.context = encoders_[0].GetContext();
+        track.time_base = time_base;
+        tracks.push_back(track);
     }
 
-    frame_count_ = 0;
+    AsyncMuxer::PacketCallback on_written;
+    if (sidecar_options_.enabled) {
+        AVRational pts_time_base = PtsTimeBase(encoder_options_.pts, fps);
+        sidecar_.Open(name + ".meta", encoder_options_.tracks, fps,
+                      pts_time_base.num, pts_time_base.den, sidecar_options_);
+        on_written = [this](size_t track, int64_t pts, int64_t offset,
+                            int64_t size) {
+            sidecar_.OnPacket(track, pts, offset, size);
+        };
+    }
+    muxer_.Open(name, format_, tracks, fps, muxer_options_, on_written);
 }
 
-void VideoRecorder::Encode(const cv::Mat& image) {
-    /*writer_ << image;*/
-    int ret = av_frame_make_writable(frame_);
-    if (ret < 0) {
-        throw std::runtime_error("׼дƵ֡");
+void VideoRecorder::CheckEncoderRate(double fps, int64_t bit_rate) {
+    const AVCodecContext* context = encoders_[0].GetContext();
+    int tracks = encoder_options_.tracks;
+    double raw_mb_per_second =
+            RawFrameBytes(context->pix_fmt, context->width, context->height) *
+            tracks * fps / 1e6;
+    std::cout << ": " << av_get_pix_fmt_name(context->pix_fmt) << ", "
+              << raw_mb_per_second << " MB/" << std::endl;
+    if (encoder_options_.self_check_frames <= 0) {
+        return;
+    }
+    // The shards of all tracks run at once, so they are measured together
+    // on track-sized frames; a frame below is a whole pair.
+    EncoderOptions all_tracks = encoder_options_;
+    all_tracks.shards *= tracks;
+    self_check_ = MeasureShardedEncoderRate(
+            codec_, context->width, context->height, fps, bit_rate / tracks,
+            all_tracks, encoder_options_.self_check_frames);
+    self_check_.fps /= tracks;
+    self_check_.bytes_per_frame *= tracks;
+    std::cout << "Լ: " << codec_->name << ", " << self_check_.fps
+              << " ֡/, " << tracks << "  x " << encoder_options_.shards
+              << " Ƭ x " << context->thread_count << " ߳ ("
+              << ThreadTypeName(context->active_thread_type) << ")"
+              << std::endl;
+    // Measured on noisy synthetic frames, so a rough figure for lossless
+    // codecs; exact for rawvideo.
+    std::cout << "Ԥд̴: " << self_check_.bytes_per_frame * fps / 1e6
+              << " MB/" << std::endl;
+    if (self_check_.fps < fps) {
+        std::cerr << "ٶȵڲɼ֡ " << fps
+                  << " ֡/, ¼нѹ" << std::endl;
     }
-
-    int cv_line_sizes[1];
-    cv_line_sizes[0] = static_cast<int>(image.step1());
-
-    sws_scale(sws_context_, &(image.data), cv_line_sizes, 0, image.rows,
-              frame_->data, frame_->linesize);
-
-    frame_->pts = frame_count_;
-    EncodeAVFrame(codec_context_, frame_, packet_);
-
-    ++frame_count_;
 }
 
-void VideoRecorder::EncodeAVFrame(AVCodecContext* codec_context, AVFrame* frame,
-                                  AVPacket* packet) {
-    int ret = avcodec_send_frame(codec_context, frame);
-    if (ret < 0) {
-        throw std::runtime_error("Ƶ֡");
+void VideoRecorder::Submit(const StereoFrame& frame) {
+    int64_t pts = FramePts(frame);
+    if (sidecar_options_.enabled) {
+        sidecar_.Add(frame, pts);
     }
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(codec_context, packet);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-            return;
-        else if (ret < 0) {
-            throw std::runtime_error("Ƶ֡");
+    if (image_options_.enabled) {
+        image_writer_.Write(frame);
+    } else {
+        for (int i = 0; i < encoder_options_.tracks; ++i) {
+            encoders_[i].Submit(frame, pts);
         }
-        packet->stream_index = stream_->index;
-        av_write_frame(format_context_, packet_);
-        av_packet_unref(packet);
     }
+    ++frames_submitted_;
+}
+
+int64_t VideoRecorder::FramePts(const StereoFrame& frame) {
+    int64_t timestamp;
+    switch (encoder_options_.pts) {
+        case PtsSource::kCamera:
+            timestamp = static_cast<int64_t>(frame.left.timestamp);
+            break;
+        case PtsSource::kTrigger:
+            timestamp = frame.left.trigger_time;
+            break;
+        default:
+            return frames_submitted_;
+    }
+    int64_t next_pts =
+            frames_submitted_ == 0 ? 0 : last_pts_ + frame_duration_us_;
+    if (encoder_options_.pts == PtsSource::kTrigger && timestamp == 0) {
+        ++pts_estimated_;
+        last_pts_ = next_pts;
+        return last_pts_;
+    }
+    if (!first_timestamp_set_) {
+        // Frames estimated before it keep their pts. Only trigger pts
+        // estimates, and trigger times are in ns.
+        first_timestamp_ = timestamp - next_pts * 1000;
+        first_timestamp_set_ = true;
+    }
+    // From the first frame, so the ticks since the camera started are not
+    // scaled through a double.
+    double elapsed_ns = static_cast<double>(timestamp - first_timestamp_);
+    if (encoder_options_.pts == PtsSource::kCamera) {
+        elapsed_ns *= timestamp_tick_ns_;
+    }
+    last_pts_ = static_cast<int64_t>(std::floor(elapsed_ns / 1000.0));
+    return last_pts_;
 }
\ No newline at end of file
@@ -2,21 +2,39 @@
 #define VIDEO_RECORDER_H_
 
 #include <atomic>
-#include <deque>
 #include <memory>
-#include <mutex>
 #include <opencv2/opencv.hpp>
 #include <string>
 #include <thread>
 
+#include "async_muxer.h"
+#include "camera_source.h"
+#include "capture_queue.h"
+#include "image_sequence_writer.h"
+#include "metadata_sidecar.h"
+#include "sharded_encoder.h"
+#include "stereo_frame.h"
+#include "video_encoder.h"
+#include "yuv_converter.h"
+
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
-#include <libswscale/swscale.h>
 }
 
+// File name extension, with the dot, of an ffmpeg muxer such as "matroska".
+std::string ContainerExtension(const std::string& container);
+
+// Records StereoFrames to a video file through ffmpeg, side by side or with
+// encoder_options.tracks == 2 as a left and a right stream, or, if
+// image_options.enabled, to left and right image sequences in the
+// directory `name`. Unless disabled, a MetadataSidecar with a record per pair
+// goes next to the video, as <name>.meta, or into the directory, as
+// frames.meta. `sync_mode` is how the camera is paced, which decides the
+// pts sources the frames can serve, and `timestamp_tick_ns` the length of
+// the left camera's timestamp tick.
 class VideoRecorder {
 public:
     VideoRecorder();
@@ -24,41 +42,80 @@ public:
 
 public:
     void Open(const std::string& name, size_t width, size_t height, double fps,
-              int64_t bit_rate);
+              int64_t bit_rate, SyncMode sync_mode, double timestamp_tick_ns,
+              const QueueOptions& queue_options = QueueOptions(),
+              const YuvConverterOptions& converter_options =
+                      YuvConverterOptions(),
+              const EncoderOptions& encoder_options = EncoderOptions(),
+              const MuxerOptions& muxer_options = MuxerOptions(),
+              const ImageSequenceOptions& image_options =
+                      ImageSequenceOptions(),
+              const SidecarOptions& sidecar_options = SidecarOptions());
+    // Also safe after a failed Open() and when already closed.
     void Close();
 
-    void Write(const cv::Mat& image);
+    // The queued frame keeps its buffer alive until it is encoded.
+    void Write(const StereoFrame& frame);
+
+    QueueStats GetQueueStats() const;
+    YuvConverterStats GetConverterStats() const;
+    // Track 1 is the right view when recording two tracks.
+    EncoderStats GetEncoderStats(size_t track = 0) const;
+    MuxerStats GetMuxerStats() const;
+    ImageSequenceStats GetImageSequenceStats() const;
+    SidecarStats GetSidecarStats() const;
 
 private:
     void Init(const std::string& name, size_t width, size_t height, double fps,
               int64_t bit_rate);
-    void Encode(const cv::Mat& image);
-    void EncodeAVFrame(AVCodecContext* codec_context, AVFrame* frame,
-                       AVPacket* packet);
+    // Logs the input bandwidth of the encoders, and the frames/s and disk
+    // bandwidth scratch copies of them sustain.
+    void CheckEncoderRate(double fps, int64_t bit_rate);
+    // Closes the encoders, the muxer, the image writer and the sidecar,
+    // logging their errors.
+    void CloseOutputs();
+    // Records the frame's metadata and hands it to the encoders or the image
+    // writer.
+    void Submit(const StereoFrame& frame);
+    // In the packet time base of encoder_options_.pts. A frame the trigger
+    // pipeline could not match has no trigger time; it gets the previous
+    // pts plus a frame duration.
+    int64_t FramePts(const StereoFrame& frame);
 
 private:
     bool is_opened_;
 
-    std::deque<cv::Mat> image_queue_;
-    std::mutex image_queue_mutex_;
-    std::condition_variable image_queue_condition_variable_;
+    CaptureQueue<StereoFrame> image_queue_;
+    YuvConverter converter_;
+    EncoderOptions encoder_options_;
+    MuxerOptions muxer_options_;
+    ImageSequenceOptions image_options_;
+    SidecarOptions sidecar_options_;
 
     std::thread writer_thread_;
-    std::atomic_bool writer_thread_stop_flag_;
 
     // cv::VideoWriter writer_;
 
     AVOutputFormat* format_;
-    AVFormatContext* format_context_;
-    AVCodec* codec_;
-    AVCodecContext* codec_context_;
-
-    AVStream* stream_;
-    AVFrame* frame_;
-    AVPacket* packet_;
-    SwsContext* sws_context_;
+    const AVCodec* codec_;
+    // Filled in by the muxer's I/O thread, so declared before the muxer.
+    MetadataSidecar sidecar_;
+    // Declared first so it outlives the encoders that write into it.
+    AsyncMuxer muxer_;
+    // One per track; the second is only opened for two tracks.
+    ShardedEncoder encoders_[2];
+    ImageSequenceWriter image_writer_;
 
-    size_t frame_count_;
+    EncoderRate self_check_;
+    // Writer thread only.
+    int64_t frames_submitted_;
+    bool first_timestamp_set_;
+    int64_t first_timestamp_;
+    int64_t last_pts_;
+    int64_t frame_duration_us_;
+    std::atomic<uint64_t> pts_estimated_;
+    // Camera timestamp tick in ns, or the encoder options' override.
+    double timestamp_tick_ns_;
 };
 
 #endif
\ No newline at end of file
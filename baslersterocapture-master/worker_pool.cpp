@@ -0,0 +1,124 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <exception>
+
+// Lives on the stack of the ParallelFor() caller; only touched with mutex_
+// held.
+struct WorkerPool::Job {
+    const std::function<void(size_t)>* task = nullptr;
+    size_t count = 0;
+    size_t next = 0;
+    size_t done = 0;
+    std::exception_ptr error;
+};
+
+WorkerPool::WorkerPool() : stop_(false) {}
+
+WorkerPool::~WorkerPool() {
+    Stop();
+}
+
+void WorkerPool::Start(size_t threads) {
+    Stop();
+    if (threads == 0) {
+        size_t cores = std::thread::hardware_concurrency();
+        threads = cores > 1 ? cores - 1 : 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = false;
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back([this]() { Run(); });
+    }
+}
+
+void WorkerPool::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    job_added_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+}
+
+size_t WorkerPool::Size() const {
+    return threads_.size();
+}
+
+void WorkerPool::ParallelFor(size_t count,
+                             const std::function<void(size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+
+    Job job;
+    job.task = &task;
+    job.count = count;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!threads_.empty() && count > 1) {
+        jobs_.push_back(&job);
+        job_added_.notify_all();
+    }
+    // The caller works on its own job too.
+    while (job.next < job.count) {
+        size_t index = job.next++;
+        if (job.next == job.count) {
+            jobs_.erase(std::remove(jobs_.begin(), jobs_.end(), &job),
+                        jobs_.end());
+        }
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            task(index);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+        Finish(&job, error);
+    }
+    job_done_.wait(lock, [&job]() { return job.done == job.count; });
+
+    if (job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
+
+void WorkerPool::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        job_added_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+        if (stop_) {
+            return;
+        }
+
+        Job* job = jobs_.front();
+        size_t index = job->next++;
+        if (job->next == job->count) {
+            jobs_.pop_front();
+        }
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            (*job->task)(index);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+        Finish(job, error);
+        if (job->done == job->count) {
+            job_done_.notify_all();
+        }
+    }
+}
+
+void WorkerPool::Finish(Job* job, std::exception_ptr error) {
+    ++job->done;
+    if (error && !job->error) {
+        job->error = error;
+    }
+}
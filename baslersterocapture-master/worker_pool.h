@@ -0,0 +1,54 @@
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that run the tiles of image kernels. Several threads
+// may call ParallelFor() at once, e.g. both grab threads; their tiles share
+// the workers.
+class WorkerPool {
+public:
+    WorkerPool();
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+public:
+    // Stops the current threads first. 0 starts one per core, less the
+    // calling thread that also runs tiles.
+    void Start(size_t threads);
+    void Stop();
+
+    size_t Size() const;
+
+    // Runs task(0) to task(count - 1) on the workers and the calling thread
+    // and returns when all have finished. Rethrows the first exception a
+    // task threw. Runs everything on the calling thread if not started.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    struct Job;
+
+    void Run();
+    // Called with mutex_ held.
+    static void Finish(Job* job, std::exception_ptr error);
+
+private:
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable job_added_;
+    std::condition_variable job_done_;
+    std::deque<Job*> jobs_;
+    bool stop_;
+};
+
+#endif
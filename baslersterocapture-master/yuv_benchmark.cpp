@@ -0,0 +1,189 @@
+#include "yuv_benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "camera_source.h"
+#include "demosaic.h"
+#include "stereo_frame.h"
+#include "yuv_converter.h"
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+#pragma comment(lib, "swscale.lib")
+
+namespace {
+const int kHalfWidth = 1920;
+const int kHeight = 1080;
+const int kFrames = 50;
+const PixelFormat kPixelFormats[] = {PixelFormat::kBgr8,
+                                     PixelFormat::kBayerRG8,
+                                     PixelFormat::kMono8,
+                                     PixelFormat::kYCbCr422_8};
+
+using Clock = std::chrono::steady_clock;
+
+struct Planes {
+    std::vector<uint8_t> data[3];
+    uint8_t* pointers[3];
+    int linesizes[3];
+
+    Planes(int width, int height) {
+        for (int plane = 0; plane < 3; ++plane) {
+            linesizes[plane] = plane == 0 ? width : width / 2;
+            data[plane].resize(linesizes[plane] *
+                               (plane == 0 ? height : height / 2));
+            pointers[plane] = data[plane].data();
+        }
+    }
+};
+
+// A gradient with noise, so neither path sees flat regions only.
+StereoFrame MakeFrame(PixelFormat pixel_format, std::vector<uint8_t>* storage) {
+    StereoFrame frame;
+    frame.width = kHalfWidth * 2;
+    frame.height = kHeight;
+    frame.pixel_format = pixel_format;
+    frame.stride = frame.width * BytesPerPixel(pixel_format);
+    storage->resize(frame.stride * frame.height);
+    uint32_t noise = 1;
+    for (int y = 0; y < frame.height; ++y) {
+        for (size_t x = 0; x < frame.stride; ++x) {
+            noise = noise * 1103515245 + 12345;
+            (*storage)[y * frame.stride + x] = static_cast<uint8_t>(
+                    (x / 8 + y / 4 + (noise >> 16) % 32) & 0xff);
+        }
+    }
+    frame.buffer = storage->data();
+
+    frame.left.width = kHalfWidth;
+    frame.left.height = kHeight;
+    frame.left.pixel_format = pixel_format;
+    frame.left.stride = frame.stride;
+    frame.left.buffer = frame.buffer;
+    frame.right = frame.left;
+    frame.right.buffer =
+            frame.buffer + kHalfWidth * BytesPerPixel(pixel_format);
+    return frame;
+}
+
+double MeanMs(const std::function<void()>& convert) {
+    convert();
+    auto start = Clock::now();
+    for (int i = 0; i < kFrames; ++i) {
+        convert();
+    }
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+                   .count() /
+           kFrames;
+}
+
+int MaxDifference(const Planes& a, const Planes& b, int plane) {
+    int difference = 0;
+    for (size_t i = 0; i < a.data[plane].size(); ++i) {
+        difference = std::max(
+                difference, std::abs(a.data[plane][i] - b.data[plane][i]));
+    }
+    return difference;
+}
+
+void PrintRow(const std::string& name, double ms) {
+    std::cout << std::setw(22) << name << std::fixed << std::setprecision(2)
+              << " | " << std::setw(7) << ms << " ms/frame" << std::endl;
+}
+
+void RunFormat(PixelFormat pixel_format) {
+    std::vector<uint8_t> storage;
+    StereoFrame frame = MakeFrame(pixel_format, &storage);
+
+    // The former path: demosaic stage for Bayer, then sws_scale.
+    DemosaicOptions demosaic_options;
+    Demosaicer demosaicer;
+    demosaicer.Configure(demosaic_options);
+    bool bayer = IsBayer(pixel_format);
+    size_t bgr_stride = frame.width * 3;
+    std::vector<uint8_t> bgr(bayer ? bgr_stride * frame.height : 0);
+
+    AVPixelFormat sws_format = AV_PIX_FMT_BGR24;
+    if (pixel_format == PixelFormat::kMono8) {
+        sws_format = AV_PIX_FMT_GRAY8;
+    } else if (pixel_format == PixelFormat::kYCbCr422_8) {
+        sws_format = AV_PIX_FMT_YUYV422;
+    }
+    SwsContext* sws_context = sws_getContext(
+            frame.width, frame.height, sws_format, frame.width, frame.height,
+            AV_PIX_FMT_YUV420P, SWS_BICUBIC, nullptr, nullptr, nullptr);
+    if (!sws_context) {
+        throw std::runtime_error("޷ʼ֡ʽת");
+    }
+
+    Planes sws_planes(frame.width, frame.height);
+    double sws_ms = MeanMs([&]() {
+        const uint8_t* data[1] = {frame.buffer};
+        int line_sizes[1] = {static_cast<int>(frame.stride)};
+        if (bayer) {
+            demosaicer.Process(frame.left, bgr.data(), bgr_stride);
+            demosaicer.Process(frame.right, bgr.data() + kHalfWidth * 3,
+                               bgr_stride);
+            data[0] = bgr.data();
+            line_sizes[0] = static_cast<int>(bgr_stride);
+        }
+        sws_scale(sws_context, data, line_sizes, 0, frame.height,
+                  sws_planes.pointers, sws_planes.linesizes);
+    });
+    sws_freeContext(sws_context);
+
+    // One thread, to separate the kernels from the striping.
+    Planes planes(frame.width, frame.height);
+    auto single_thread = [&](SimdLevel simd) {
+        return MeanMs([&]() {
+            uint8_t* right[3] = {planes.pointers[0] + kHalfWidth,
+                                 planes.pointers[1] + kHalfWidth / 2,
+                                 planes.pointers[2] + kHalfWidth / 2};
+            ConvertRowsToYuv(frame.left, 0, frame.height, YuvLayout::k420,
+                             DemosaicQuality::kBilinear, simd, planes.pointers,
+                             planes.linesizes);
+            ConvertRowsToYuv(frame.right, 0, frame.height, YuvLayout::k420,
+                             DemosaicQuality::kBilinear, simd, right,
+                             planes.linesizes);
+        });
+    };
+    double scalar_ms = single_thread(SimdLevel::kScalar);
+    double simd_ms = single_thread(DetectSimdLevel());
+
+    YuvConverter converter;
+    converter.Configure(YuvConverterOptions());
+    double converter_ms = MeanMs([&]() {
+        converter.Convert(frame, YuvLayout::k420, planes.pointers,
+                          planes.linesizes);
+    });
+
+    std::cout << "== " << PixelFormatName(pixel_format) << " "
+              << frame.width << "x" << frame.height << " ==" << std::endl;
+    PrintRow(bayer ? "demosaic + sws_scale" : "sws_scale", sws_ms);
+    PrintRow("scalar, 1 thread", scalar_ms);
+    PrintRow(SimdLevelName(DetectSimdLevel()) + ", 1 thread", simd_ms);
+    PrintRow("YuvConverter", converter_ms);
+    std::cout << std::setw(22) << "max diff vs sws"
+              << " | Y " << MaxDifference(planes, sws_planes, 0) << ", U "
+              << MaxDifference(planes, sws_planes, 1) << ", V "
+              << MaxDifference(planes, sws_planes, 2) << " ("
+              << converter.GetStats() << ")" << std::endl;
+}
+}  // namespace
+
+void RunYuvBenchmark() {
+    for (PixelFormat pixel_format : kPixelFormats) {
+        RunFormat(pixel_format);
+    }
+}
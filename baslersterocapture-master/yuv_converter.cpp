@@ -0,0 +1,668 @@
+#include "yuv_converter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+// Two source rows and the planar rows they turn into. For 4:2:0 both
+// chroma pointers are the same row.
+struct PairArgs {
+    const uint8_t* rows[2];
+    uint8_t* y[2];
+    uint8_t* u[2];
+    uint8_t* v[2];
+    int width;
+};
+
+using PairKernel = void (*)(const PairArgs& args);
+
+// BT.601 limited range, in 8-bit fixed point. The SIMD kernels use the same
+// 16-bit arithmetic, so all kernels give identical images.
+inline uint8_t Luma(int b, int g, int r) {
+    return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+inline uint8_t Cb(int b, int g, int r) {
+    return static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) +
+                                128);
+}
+
+inline uint8_t Cr(int b, int g, int r) {
+    return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) +
+                                128);
+}
+
+inline uint8_t Average(uint8_t a, uint8_t b) {
+    return static_cast<uint8_t>((a + b + 1) >> 1);
+}
+
+// Pixels x and x + 1 of both rows. Chroma is sampled per pixel, or from
+// the average of the pixels the layout merges.
+template <YuvLayout kLayout>
+void BgrPixelPair(const PairArgs& args, int x) {
+    int sums[2][3] = {{0, 0, 0}, {0, 0, 0}};
+    for (int row = 0; row < 2; ++row) {
+        for (int i = 0; i < 2; ++i) {
+            const uint8_t* p = args.rows[row] + (x + i) * 3;
+            args.y[row][x + i] = Luma(p[0], p[1], p[2]);
+            if (kLayout == YuvLayout::k444) {
+                args.u[row][x + i] = Cb(p[0], p[1], p[2]);
+                args.v[row][x + i] = Cr(p[0], p[1], p[2]);
+            }
+            for (int channel = 0; channel < 3; ++channel) {
+                sums[row][channel] += p[channel];
+            }
+        }
+        if (kLayout == YuvLayout::k422) {
+            int b = (sums[row][0] + 1) >> 1;
+            int g = (sums[row][1] + 1) >> 1;
+            int r = (sums[row][2] + 1) >> 1;
+            args.u[row][x / 2] = Cb(b, g, r);
+            args.v[row][x / 2] = Cr(b, g, r);
+        }
+    }
+    if (kLayout == YuvLayout::k420) {
+        int b = (sums[0][0] + sums[1][0] + 2) >> 2;
+        int g = (sums[0][1] + sums[1][1] + 2) >> 2;
+        int r = (sums[0][2] + sums[1][2] + 2) >> 2;
+        args.u[0][x / 2] = Cb(b, g, r);
+        args.v[0][x / 2] = Cr(b, g, r);
+    }
+}
+
+void MonoPixelPair(const PairArgs& args, int x) {
+    for (int row = 0; row < 2; ++row) {
+        for (int i = 0; i < 2; ++i) {
+            int g = args.rows[row][x + i];
+            args.y[row][x + i] =
+                    static_cast<uint8_t>(((220 * g + 128) >> 8) + 16);
+        }
+    }
+}
+
+// Grey has no colour: Cb = Cr = 128 across the chroma rows.
+template <YuvLayout kLayout>
+void FillNeutralChroma(const PairArgs& args) {
+    int width = ChromaWidth(kLayout, args.width);
+    int rows = kLayout == YuvLayout::k420 ? 1 : 2;
+    for (int row = 0; row < rows; ++row) {
+        std::memset(args.u[row], 128, width);
+        std::memset(args.v[row], 128, width);
+    }
+}
+
+// YCbCr422_8 is Y0 Cb Y1 Cr. 4:2:0 averages the chroma of the two rows and
+// 4:4:4 repeats it for both pixels.
+template <YuvLayout kLayout>
+void YuyvPixelPair(const PairArgs& args, int x) {
+    for (int row = 0; row < 2; ++row) {
+        const uint8_t* p = args.rows[row] + x * 2;
+        args.y[row][x] = p[0];
+        args.y[row][x + 1] = p[2];
+        if (kLayout == YuvLayout::k422) {
+            args.u[row][x / 2] = p[1];
+            args.v[row][x / 2] = p[3];
+        } else if (kLayout == YuvLayout::k444) {
+            args.u[row][x] = args.u[row][x + 1] = p[1];
+            args.v[row][x] = args.v[row][x + 1] = p[3];
+        }
+    }
+    if (kLayout == YuvLayout::k420) {
+        args.u[0][x / 2] =
+                Average(args.rows[0][x * 2 + 1], args.rows[1][x * 2 + 1]);
+        args.v[0][x / 2] =
+                Average(args.rows[0][x * 2 + 3], args.rows[1][x * 2 + 3]);
+    }
+}
+
+template <YuvLayout kLayout>
+void BgrPairScalar(const PairArgs& args) {
+    for (int x = 0; x < args.width; x += 2) {
+        BgrPixelPair<kLayout>(args, x);
+    }
+}
+
+template <YuvLayout kLayout>
+void MonoPairScalar(const PairArgs& args) {
+    for (int x = 0; x < args.width; x += 2) {
+        MonoPixelPair(args, x);
+    }
+    FillNeutralChroma<kLayout>(args);
+}
+
+template <YuvLayout kLayout>
+void YuyvPairScalar(const PairArgs& args) {
+    for (int x = 0; x < args.width; x += 2) {
+        YuyvPixelPair<kLayout>(args, x);
+    }
+}
+
+// kGbr keeps G in plane 0, B in plane 1 and R in plane 2, the order of
+// ffmpeg's gbrp.
+inline void GbrPixel(const PairArgs& args, int row, int x) {
+    const uint8_t* bgr = args.rows[row] + x * 3;
+    args.u[row][x] = bgr[0];
+    args.y[row][x] = bgr[1];
+    args.v[row][x] = bgr[2];
+}
+
+void GbrPairScalar(const PairArgs& args) {
+    for (int row = 0; row < 2; ++row) {
+        for (int x = 0; x < args.width; ++x) {
+            GbrPixel(args, row, x);
+        }
+    }
+}
+
+void GrayPair(const PairArgs& args) {
+    for (int row = 0; row < 2; ++row) {
+        std::memcpy(args.y[row], args.rows[row], args.width);
+    }
+}
+
+#ifdef SIMD_X86
+// pshufb masks that spread one channel of 8 BGR pixels into 16-bit lanes:
+// `low` picks from bytes 0-15 and `high` from bytes 8-23.
+struct DeinterleaveMasks {
+    alignas(16) uint8_t low[3][16];
+    alignas(16) uint8_t high[3][16];
+
+    DeinterleaveMasks() {
+        for (int channel = 0; channel < 3; ++channel) {
+            for (int i = 0; i < 16; ++i) {
+                int byte = (i / 2) * 3 + channel;
+                bool lane_low_byte = i % 2 == 0;
+                low[channel][i] = lane_low_byte && byte < 16 ? byte : 0x80;
+                high[channel][i] =
+                        lane_low_byte && byte >= 16 ? byte - 8 : 0x80;
+            }
+        }
+    }
+};
+
+// pshufb masks that gather Y, Cb and Cr of 16 YCbCr422_8 pixels, indexed by
+// which 16 source bytes they read. The `_444` masks repeat each chroma
+// sample for both of its pixels.
+struct YuyvMasks {
+    alignas(16) uint8_t luma[2][16];
+    alignas(16) uint8_t cb[2][16];
+    alignas(16) uint8_t cr[2][16];
+    alignas(16) uint8_t cb_444[2][16];
+    alignas(16) uint8_t cr_444[2][16];
+
+    YuyvMasks() {
+        for (int part = 0; part < 2; ++part) {
+            for (int i = 0; i < 16; ++i) {
+                bool own = i / 8 == part;
+                luma[part][i] = own ? (i % 8) * 2 : 0x80;
+                bool chroma = i < 8 && i / 4 == part;
+                cb[part][i] = chroma ? (i % 4) * 4 + 1 : 0x80;
+                cr[part][i] = chroma ? (i % 4) * 4 + 3 : 0x80;
+                cb_444[part][i] = own ? ((i % 8) / 2) * 4 + 1 : 0x80;
+                cr_444[part][i] = own ? ((i % 8) / 2) * 4 + 3 : 0x80;
+            }
+        }
+    }
+};
+
+const DeinterleaveMasks kDeinterleave;
+const YuyvMasks kYuyv;
+
+SIMD_TARGET("ssse3")
+inline __m128i Load128(const uint8_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+SIMD_TARGET("ssse3")
+inline void Store64(uint8_t* p, __m128i value) {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p), value);
+}
+
+SIMD_TARGET("ssse3")
+inline void Store128(uint8_t* p, __m128i value) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), value);
+}
+
+// Channels of 8 BGR pixels as 16-bit lanes.
+SIMD_TARGET("ssse3")
+inline void LoadBgr8(const uint8_t* p, __m128i channels[3]) {
+    __m128i low = Load128(p);
+    __m128i high = Load128(p + 8);
+    for (int channel = 0; channel < 3; ++channel) {
+        channels[channel] = _mm_or_si128(
+                _mm_shuffle_epi8(low, Load128(kDeinterleave.low[channel])),
+                _mm_shuffle_epi8(high, Load128(kDeinterleave.high[channel])));
+    }
+}
+
+// The weighted sum reaches 56228, so it is shifted unsigned.
+SIMD_TARGET("ssse3")
+inline __m128i Luma8(const __m128i channels[3]) {
+    __m128i sum = _mm_add_epi16(
+            _mm_add_epi16(
+                    _mm_mullo_epi16(channels[2], _mm_set1_epi16(66)),
+                    _mm_mullo_epi16(channels[1], _mm_set1_epi16(129))),
+            _mm_add_epi16(_mm_mullo_epi16(channels[0], _mm_set1_epi16(25)),
+                          _mm_set1_epi16(128)));
+    return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+}
+
+// Every partial sum stays within +-28560, so 16-bit lanes do not overflow.
+SIMD_TARGET("ssse3")
+inline __m128i Chroma8(const __m128i channels[3], short kb, short kg,
+                       short kr) {
+    __m128i sum = _mm_add_epi16(
+            _mm_add_epi16(_mm_mullo_epi16(channels[2], _mm_set1_epi16(kr)),
+                          _mm_mullo_epi16(channels[1], _mm_set1_epi16(kg))),
+            _mm_add_epi16(_mm_mullo_epi16(channels[0], _mm_set1_epi16(kb)),
+                          _mm_set1_epi16(128)));
+    return _mm_add_epi16(_mm_srai_epi16(sum, 8), _mm_set1_epi16(128));
+}
+
+// Adds neighbouring lanes of `first` then `second` and rounds the sums of
+// `count` samples to their average.
+SIMD_TARGET("ssse3")
+inline __m128i PairAverage(__m128i first, __m128i second, int shift) {
+    __m128i pairs = _mm_hadd_epi16(first, second);
+    __m128i round = _mm_set1_epi16(static_cast<short>(1 << (shift - 1)));
+    return _mm_srli_epi16(_mm_add_epi16(pairs, round), shift);
+}
+
+SIMD_TARGET("ssse3")
+inline void StoreChroma8(uint8_t* u, uint8_t* v, const __m128i average[3]) {
+    __m128i cb = Chroma8(average, 112, -74, -38);
+    __m128i cr = Chroma8(average, -18, -94, 112);
+    Store64(u, _mm_packus_epi16(cb, cb));
+    Store64(v, _mm_packus_epi16(cr, cr));
+}
+
+template <YuvLayout kLayout>
+SIMD_TARGET("ssse3")
+void BgrPairSsse3(const PairArgs& args) {
+    int x = 0;
+    for (; x + 16 <= args.width; x += 16) {
+        // For 4:2:0, sums of both rows per channel, for pixels 0-7 and
+        // 8-15.
+        __m128i sums[2][3];
+        for (int row = 0; row < 2; ++row) {
+            __m128i channels[2][3];
+            __m128i luma[2];
+            for (int half = 0; half < 2; ++half) {
+                LoadBgr8(args.rows[row] + (x + half * 8) * 3,
+                         channels[half]);
+                luma[half] = Luma8(channels[half]);
+                for (int channel = 0; channel < 3; ++channel) {
+                    sums[half][channel] =
+                            row == 0 ? channels[half][channel]
+                                     : _mm_add_epi16(sums[half][channel],
+                                                     channels[half][channel]);
+                }
+            }
+            Store128(args.y[row] + x, _mm_packus_epi16(luma[0], luma[1]));
+
+            if (kLayout == YuvLayout::k444) {
+                __m128i cb[2], cr[2];
+                for (int half = 0; half < 2; ++half) {
+                    cb[half] = Chroma8(channels[half], 112, -74, -38);
+                    cr[half] = Chroma8(channels[half], -18, -94, 112);
+                }
+                Store128(args.u[row] + x, _mm_packus_epi16(cb[0], cb[1]));
+                Store128(args.v[row] + x, _mm_packus_epi16(cr[0], cr[1]));
+            } else if (kLayout == YuvLayout::k422) {
+                __m128i average[3];
+                for (int channel = 0; channel < 3; ++channel) {
+                    average[channel] = PairAverage(
+                            channels[0][channel], channels[1][channel], 1);
+                }
+                StoreChroma8(args.u[row] + x / 2, args.v[row] + x / 2,
+                             average);
+            }
+        }
+
+        if (kLayout == YuvLayout::k420) {
+            __m128i average[3];
+            for (int channel = 0; channel < 3; ++channel) {
+                average[channel] =
+                        PairAverage(sums[0][channel], sums[1][channel], 2);
+            }
+            StoreChroma8(args.u[0] + x / 2, args.v[0] + x / 2, average);
+        }
+    }
+
+    for (; x < args.width; x += 2) {
+        BgrPixelPair<kLayout>(args, x);
+    }
+}
+
+template <YuvLayout kLayout>
+SIMD_TARGET("ssse3")
+void MonoPairSsse3(const PairArgs& args) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i scale = _mm_set1_epi16(220);
+    __m128i round = _mm_set1_epi16(128);
+    __m128i offset = _mm_set1_epi16(16);
+    int x = 0;
+    for (; x + 16 <= args.width; x += 16) {
+        for (int row = 0; row < 2; ++row) {
+            __m128i gray = Load128(args.rows[row] + x);
+            __m128i luma[2];
+            for (int half = 0; half < 2; ++half) {
+                __m128i wide = half == 0 ? _mm_unpacklo_epi8(gray, zero)
+                                         : _mm_unpackhi_epi8(gray, zero);
+                __m128i sum =
+                        _mm_add_epi16(_mm_mullo_epi16(wide, scale), round);
+                luma[half] = _mm_add_epi16(_mm_srli_epi16(sum, 8), offset);
+            }
+            Store128(args.y[row] + x, _mm_packus_epi16(luma[0], luma[1]));
+        }
+    }
+
+    for (; x < args.width; x += 2) {
+        MonoPixelPair(args, x);
+    }
+    FillNeutralChroma<kLayout>(args);
+}
+
+SIMD_TARGET("ssse3")
+inline __m128i Gather(__m128i first, __m128i second,
+                      const uint8_t (&masks)[2][16]) {
+    return _mm_or_si128(_mm_shuffle_epi8(first, Load128(masks[0])),
+                        _mm_shuffle_epi8(second, Load128(masks[1])));
+}
+
+template <YuvLayout kLayout>
+SIMD_TARGET("ssse3")
+void YuyvPairSsse3(const PairArgs& args) {
+    int x = 0;
+    for (; x + 16 <= args.width; x += 16) {
+        // Source bytes 0-15 and 16-31 of both rows.
+        __m128i parts[2][2];
+        for (int row = 0; row < 2; ++row) {
+            parts[row][0] = Load128(args.rows[row] + x * 2);
+            parts[row][1] = Load128(args.rows[row] + x * 2 + 16);
+            Store128(args.y[row] + x,
+                     Gather(parts[row][0], parts[row][1], kYuyv.luma));
+            if (kLayout == YuvLayout::k422) {
+                Store64(args.u[row] + x / 2,
+                        Gather(parts[row][0], parts[row][1], kYuyv.cb));
+                Store64(args.v[row] + x / 2,
+                        Gather(parts[row][0], parts[row][1], kYuyv.cr));
+            } else if (kLayout == YuvLayout::k444) {
+                Store128(args.u[row] + x,
+                         Gather(parts[row][0], parts[row][1], kYuyv.cb_444));
+                Store128(args.v[row] + x,
+                         Gather(parts[row][0], parts[row][1], kYuyv.cr_444));
+            }
+        }
+        if (kLayout == YuvLayout::k420) {
+            __m128i first = _mm_avg_epu8(parts[0][0], parts[1][0]);
+            __m128i second = _mm_avg_epu8(parts[0][1], parts[1][1]);
+            Store64(args.u[0] + x / 2, Gather(first, second, kYuyv.cb));
+            Store64(args.v[0] + x / 2, Gather(first, second, kYuyv.cr));
+        }
+    }
+
+    for (; x < args.width; x += 2) {
+        YuyvPixelPair<kLayout>(args, x);
+    }
+}
+
+SIMD_TARGET("ssse3")
+void GbrPairSsse3(const PairArgs& args) {
+    int x = 0;
+    for (; x + 16 <= args.width; x += 16) {
+        for (int row = 0; row < 2; ++row) {
+            __m128i channels[2][3];
+            for (int half = 0; half < 2; ++half) {
+                LoadBgr8(args.rows[row] + (x + half * 8) * 3,
+                         channels[half]);
+            }
+            uint8_t* planes[3] = {args.u[row], args.y[row], args.v[row]};
+            for (int channel = 0; channel < 3; ++channel) {
+                Store128(planes[channel] + x,
+                         _mm_packus_epi16(channels[0][channel],
+                                          channels[1][channel]));
+            }
+        }
+    }
+
+    for (; x < args.width; ++x) {
+        GbrPixel(args, 0, x);
+        GbrPixel(args, 1, x);
+    }
+}
+#endif
+
+PairKernel SelectLosslessKernel(PixelFormat pixel_format, YuvLayout layout,
+                                SimdLevel simd) {
+    if (layout == YuvLayout::kGray && pixel_format == PixelFormat::kMono8) {
+        return GrayPair;
+    }
+    if (layout == YuvLayout::kGbr && pixel_format == PixelFormat::kBgr8) {
+#ifdef SIMD_X86
+        if (simd >= SimdLevel::kSsse3) {
+            return GbrPairSsse3;
+        }
+#endif
+        return GbrPairScalar;
+    }
+    throw std::runtime_error("޷תظʽ: " +
+                             PixelFormatName(pixel_format));
+}
+
+template <YuvLayout kLayout>
+PairKernel SelectLayoutKernel(PixelFormat pixel_format, SimdLevel simd) {
+#ifdef SIMD_X86
+    // The kernels are bound by the deinterleave shuffles, which AVX2 does
+    // not widen across lanes, so AVX2 CPUs use the SSSE3 kernels.
+    if (simd >= SimdLevel::kSsse3) {
+        switch (pixel_format) {
+            case PixelFormat::kBgr8:
+                return BgrPairSsse3<kLayout>;
+            case PixelFormat::kMono8:
+                return MonoPairSsse3<kLayout>;
+            case PixelFormat::kYCbCr422_8:
+                return YuyvPairSsse3<kLayout>;
+            default:
+                break;
+        }
+    }
+#endif
+    switch (pixel_format) {
+        case PixelFormat::kBgr8:
+            return BgrPairScalar<kLayout>;
+        case PixelFormat::kMono8:
+            return MonoPairScalar<kLayout>;
+        case PixelFormat::kYCbCr422_8:
+            return YuyvPairScalar<kLayout>;
+        default:
+            throw std::runtime_error("޷תΪYUVظʽ: " +
+                                     PixelFormatName(pixel_format));
+    }
+}
+
+PairKernel SelectKernel(PixelFormat pixel_format, YuvLayout layout,
+                        SimdLevel simd) {
+    switch (layout) {
+        case YuvLayout::k422:
+            return SelectLayoutKernel<YuvLayout::k422>(pixel_format, simd);
+        case YuvLayout::k444:
+            return SelectLayoutKernel<YuvLayout::k444>(pixel_format, simd);
+        case YuvLayout::kGbr:
+        case YuvLayout::kGray:
+            return SelectLosslessKernel(pixel_format, layout, simd);
+        default:
+            return SelectLayoutKernel<YuvLayout::k420>(pixel_format, simd);
+    }
+}
+}  // namespace
+
+YuvConverterOptions ParseYuvConverterOptions(
+        const nlohmann::json& config, const YuvConverterOptions& defaults) {
+    YuvConverterOptions options = defaults;
+    if (!config.is_object()) {
+        return options;
+    }
+    options.threads = config.value("threads", options.threads);
+    options.stripe_rows = config.value("stripe_rows", options.stripe_rows);
+    if (config.count("simd")) {
+        options.simd = ParseSimdLevel(config["simd"]);
+    }
+    if (config.count("bayer_quality")) {
+        options.bayer_quality = ParseDemosaicQuality(config["bayer_quality"]);
+    }
+    if (options.stripe_rows <= 0 || options.stripe_rows % 2 != 0) {
+        throw std::runtime_error("YUVתΪż");
+    }
+    return options;
+}
+
+std::ostream& operator<<(std::ostream& os, const YuvConverterStats& stats) {
+    os << SimdLevelName(stats.simd) << ", " << stats.threads
+       << " workers, frames " << stats.frames << ", mean " << stats.mean_ms
+       << " ms, max " << stats.max_ms << " ms";
+    return os;
+}
+
+int ChromaWidth(YuvLayout layout, int width) {
+    switch (layout) {
+        case YuvLayout::k444:
+        case YuvLayout::kGbr:
+            return width;
+        case YuvLayout::kGray:
+            return 0;
+        default:
+            return width / 2;
+    }
+}
+
+void ConvertRowsToYuv(const CameraFrame& frame, int begin, int end,
+                      YuvLayout layout, DemosaicQuality bayer_quality,
+                      SimdLevel simd, uint8_t* const planes[3],
+                      const int linesizes[3]) {
+    // kGray keeps the Bayer mosaic as it is; the others demosaic it.
+    bool bayer = IsBayer(frame.pixel_format) && layout != YuvLayout::kGray;
+    PixelFormat source = frame.pixel_format;
+    if (IsBayer(source)) {
+        source = bayer ? PixelFormat::kBgr8 : PixelFormat::kMono8;
+    }
+    PairKernel kernel = SelectKernel(source, layout, simd);
+
+    // Bayer rows are demosaiced a pair at a time into a buffer that stays
+    // in cache for the BGR kernel. Each worker keeps its buffer across
+    // stripes and frames.
+    size_t bgr_stride = frame.width * 3;
+    static thread_local std::vector<uint8_t> bgr;
+    if (bayer && bgr.size() < bgr_stride * 2) {
+        bgr.resize(bgr_stride * 2);
+    }
+
+    for (int y = begin; y < end; y += 2) {
+        PairArgs args;
+        if (bayer) {
+            DemosaicRows(frame, y, y + 2, bayer_quality, simd, bgr.data(),
+                         bgr_stride);
+            args.rows[0] = bgr.data();
+            args.rows[1] = bgr.data() + bgr_stride;
+        } else {
+            args.rows[0] = frame.buffer + y * frame.stride;
+            args.rows[1] = frame.buffer + (y + 1) * frame.stride;
+        }
+        args.y[0] = planes[0] + y * linesizes[0];
+        args.y[1] = planes[0] + (y + 1) * linesizes[0];
+        for (int row = 0; row < 2; ++row) {
+            if (layout == YuvLayout::kGray) {
+                args.u[row] = args.v[row] = nullptr;
+                continue;
+            }
+            int chroma_row = layout == YuvLayout::k420 ? y / 2 : y + row;
+            args.u[row] = planes[1] + chroma_row * linesizes[1];
+            args.v[row] = planes[2] + chroma_row * linesizes[2];
+        }
+        args.width = frame.width;
+        kernel(args);
+    }
+}
+
+YuvConverter::YuvConverter(const YuvConverterOptions& options)
+        : options_(options), total_ms_(0.0) {
+    stats_.simd = options_.simd;
+}
+
+void YuvConverter::Configure(const YuvConverterOptions& options) {
+    options_ = options;
+    workers_.Start(options_.threads);
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_ = YuvConverterStats();
+    stats_.simd = options_.simd;
+    stats_.threads = workers_.Size();
+    total_ms_ = 0.0;
+}
+
+void YuvConverter::Convert(const StereoFrame& frame, YuvLayout layout,
+                           uint8_t* const planes[3], const int linesizes[3]) {
+    if (frame.left.height != frame.height ||
+        frame.right.height != frame.height) {
+        throw std::runtime_error("ͼ߶Ȳһ, ޷ƴתΪYUV");
+    }
+    const CameraFrame* halves[2] = {&frame.left, &frame.right};
+    ConvertHalves(halves, 2, layout, planes, linesizes);
+}
+
+void YuvConverter::Convert(const CameraFrame& half, YuvLayout layout,
+                           uint8_t* const planes[3], const int linesizes[3]) {
+    const CameraFrame* halves[1] = {&half};
+    ConvertHalves(halves, 1, layout, planes, linesizes);
+}
+
+void YuvConverter::ConvertHalves(const CameraFrame* const halves[],
+                                 size_t count, YuvLayout layout,
+                                 uint8_t* const planes[3],
+                                 const int linesizes[3]) {
+    for (size_t i = 0; i < count; ++i) {
+        if (halves[i]->width % 2 != 0 || halves[i]->height % 2 != 0) {
+            throw std::runtime_error("ͼ߱ΪżתΪYUV");
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    int stripe_rows = options_.stripe_rows;
+    size_t stripes = (halves[0]->height + stripe_rows - 1) / stripe_rows;
+    workers_.ParallelFor(stripes * count, [&](size_t task) {
+        const CameraFrame& half = *halves[task % count];
+        int begin = static_cast<int>(task / count) * stripe_rows;
+        int end = std::min(begin + stripe_rows, half.height);
+        int x = task % count == 0 ? 0 : halves[0]->width;
+        uint8_t* half_planes[3] = {planes[0] + x, nullptr, nullptr};
+        if (layout != YuvLayout::kGray) {
+            int chroma_x = ChromaWidth(layout, x);
+            half_planes[1] = planes[1] + chroma_x;
+            half_planes[2] = planes[2] + chroma_x;
+        }
+        ConvertRowsToYuv(half, begin, end, layout, options_.bayer_quality,
+                         options_.simd, half_planes, linesizes);
+    });
+
+    double elapsed_ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ++stats_.frames;
+    total_ms_ += elapsed_ms;
+    stats_.mean_ms = total_ms_ / stats_.frames;
+    stats_.max_ms = std::max(stats_.max_ms, elapsed_ms);
+}
+
+YuvConverterStats YuvConverter::GetStats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
@@ -0,0 +1,110 @@
+#ifndef YUV_CONVERTER_H_
+#define YUV_CONVERTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+#include "json.hpp"
+
+#include "camera_source.h"
+#include "demosaic.h"
+#include "simd.h"
+#include "stereo_frame.h"
+#include "worker_pool.h"
+
+// Planes of the output. k420, k422 and k444 are YUV with that chroma
+// subsampling. kGbr and kGray are for lossless recording: kGbr splits BGR8
+// and demosaiced Bayer pixels into G, B and R planes, and kGray copies Mono8
+// pixels or the raw Bayer mosaic into a single plane.
+enum class YuvLayout {
+    k420,
+    k422,
+    k444,
+    kGbr,
+    kGray,
+};
+
+// Samples in planes 1 and 2 for `width` samples in plane 0.
+int ChromaWidth(YuvLayout layout, int width);
+
+struct YuvConverterOptions {
+    // 0 uses one worker per core.
+    size_t threads = 0;
+    // Rows per worker task; even, as 4:2:0 chroma covers two rows.
+    int stripe_rows = 64;
+    SimdLevel simd = DetectSimdLevel();
+    // For raw Bayer frames, demosaiced two rows at a time on the fly.
+    DemosaicQuality bayer_quality = DemosaicQuality::kBilinear;
+};
+
+// Reads {"threads": N, "stripe_rows": N, "simd": "auto"|"avx2"|"ssse3"|
+// "scalar", "bayer_quality": "bilinear"|"edge_aware"}.
+YuvConverterOptions ParseYuvConverterOptions(
+        const nlohmann::json& config,
+        const YuvConverterOptions& defaults = YuvConverterOptions());
+
+struct YuvConverterStats {
+    SimdLevel simd = SimdLevel::kScalar;
+    size_t threads = 0;
+    uint64_t frames = 0;
+    double mean_ms = 0.0;
+    double max_ms = 0.0;
+};
+
+std::ostream& operator<<(std::ostream& os, const YuvConverterStats& stats);
+
+// Converts rows [begin, end) of `frame` (BGR8, BayerRG8, BayerBG8, Mono8 or
+// YCbCr422_8; `begin` and `end` even) to BT.601 limited range planar YUV
+// rows of `planes`, on the calling thread, or to the lossless kGbr and kGray
+// planes, which only take the formats they hold without loss. Plane rows
+// are indexed like the frame.
+void ConvertRowsToYuv(const CameraFrame& frame, int begin, int end,
+                      YuvLayout layout, DemosaicQuality bayer_quality,
+                      SimdLevel simd, uint8_t* const planes[3],
+                      const int linesizes[3]);
+
+// Turns StereoFrames into the encoder's planar YUV in one pass over the
+// source, in place of sws_scale: no BGR intermediate for raw Bayer frames,
+// and the rows are split into stripes that run on a worker pool. Each half
+// is converted on its own, so raw Bayer halves are not demosaiced across the
+// seam.
+class YuvConverter {
+public:
+    explicit YuvConverter(
+            const YuvConverterOptions& options = YuvConverterOptions());
+    ~YuvConverter() = default;
+
+    YuvConverter(const YuvConverter&) = delete;
+    YuvConverter& operator=(const YuvConverter&) = delete;
+
+public:
+    // Not while Convert() runs.
+    void Configure(const YuvConverterOptions& options);
+
+    // The halves must have even sizes.
+    void Convert(const StereoFrame& frame, YuvLayout layout,
+                 uint8_t* const planes[3], const int linesizes[3]);
+    // Converts a single half, e.g. for a track of its own.
+    void Convert(const CameraFrame& half, YuvLayout layout,
+                 uint8_t* const planes[3], const int linesizes[3]);
+
+    YuvConverterStats GetStats() const;
+
+private:
+    // Places the halves side by side in `planes`.
+    void ConvertHalves(const CameraFrame* const halves[], size_t count,
+                       YuvLayout layout, uint8_t* const planes[3],
+                       const int linesizes[3]);
+
+private:
+    YuvConverterOptions options_;
+    WorkerPool workers_;
+
+    mutable std::mutex stats_mutex_;
+    YuvConverterStats stats_;
+    double total_ms_;
+};
+
+#endif